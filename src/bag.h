@@ -13,6 +13,7 @@
 #include <string.h>
 #include <zlib.h>
 #include <assert.h>
+#include <stdint.h>
 #include "utils.h"
 #include "kseq.h"
 
@@ -35,6 +36,19 @@ typedef struct {
     UT_hash_handle hh;
 } junction_t;
 
+/* kmers at consecutive positions of a read uniquely hitting one exon */
+typedef struct {
+	int32_t exon;       /* id of the exon in the kmer index */
+	uint16_t pos;       /* position of the first kmer on the read */
+	uint16_t len;       /* number of kmers */
+} hit_run_t;
+
+/* kmer hits of a read pair, the runs of read1 then of read2 by position */
+typedef struct {
+	int n[2];
+	hit_run_t run[];
+} hit_prof_t;
+
 /*
  * the BAG_uthash object
  */
@@ -43,8 +57,14 @@ typedef struct{
 	char *gname1; // gene1 and gene2 has order
 	char *gname2;
 	int weight;
+	int n_seen;         /* number of read pairs added to this edge, never sampled */
+	int n_dup;          /* exact duplicates of those pairs, collapsed and not in n_seen */
+	int n_evidence;     /* number of read pairs kept in read_names and evidence */
+	uint64_t rng;       /* state of the reservoir sampler */
 	char **read_names;  /* stores the name of read pair that support this edge*/
 	char **evidence;    /* stores the read pair that support this edge*/
+	hit_prof_t **prof;  /* kmer hits of every kept pair, NULL until known */
+	uint64_t *key;      /* fq_hash of every kept pair, two words each, NULL if unknown */
 	bool junc_flag;
 	float likehood;
 	float pvalue;    /* likelihood of the junction */
@@ -56,7 +76,8 @@ typedef struct{
 static inline bag_t *bag_init();
 static inline int bag_destory(bag_t **);
 static inline int bag_display(bag_t *);
-static inline int bag_add(bag_t**, char*, char*, char*);
+static inline int bag_add(bag_t**, char*, char*, char*, const hit_prof_t*, const uint64_t*, int, uint64_t);
+static inline int bag_merge(bag_t**, bag_t*, int, uint64_t);
 static inline bag_t *find_edge(bag_t *, char*);
 static inline int bag_uniq(bag_t **);
 static inline int bag_trim(bag_t **bag, int min_weight);
@@ -78,9 +99,15 @@ static inline bag_t *bag_init() {
 	t->edge = NULL;
 	t->junc_flag = false;
 	t->weight = 0;
+	t->n_seen = 0;
+	t->n_dup = 0;
+	t->n_evidence = 0;
+	t->rng = 0;
 	t->likehood = 0;
 	t->evidence = mycalloc(1, char*);
 	t->read_names = mycalloc(1, char*);
+	t->prof = mycalloc(1, hit_prof_t*);
+	t->key = NULL;
 	t->junc = NULL;
 	return t;
 }
@@ -118,27 +145,162 @@ static inline int bag_display(bag_t *bag) {
 	return 0;
 }
 
+/* splitmix64, the next pseudo random number of state x */
+static inline uint64_t bag_rand(uint64_t *x){
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/* FNV-1a of the edge name so that every edge draws its own sequence */
+static inline uint64_t bag_seed(const char *edge_name, uint64_t seed){
+	uint64_t x = 0xCBF29CE484222325ULL ^ seed;
+	for(; *edge_name; edge_name++) x = (x ^ (unsigned char)*edge_name) * 0x100000001B3ULL;
+	return x;
+}
+
+/* copy of the hit profile prof, NULL if prof is NULL */
+static inline hit_prof_t *prof_dup(const hit_prof_t *prof){
+	if(prof == NULL) return NULL;
+	size_t l = sizeof(hit_prof_t) + (prof->n[0] + prof->n[1]) * sizeof(hit_run_t);
+	hit_prof_t *ret = malloc(l);
+	memcpy(ret, prof, l);
+	return ret;
+}
+
 /*
  * add one edge to graph
+ * prof         - kmer hits of the pair, copied if the pair is kept, may be NULL.
+ * key          - fq_hash of the pair, kept with it, NULL for none.
+ * max_evidence - keep at most max_evidence read pairs per edge, 0 keeps all.
+ *                weight counts every read pair while the kept ones are a 
+ *                uniform reservoir sample of them, the sample only depends 
+ *                on seed, the edge and the order of reads.
  */
 static inline int 
-bag_add(bag_t** bag, char* edge_name, char* read_name, char* evidence){
+bag_add(bag_t** bag, char* edge_name, char* read_name, char* evidence, const hit_prof_t *prof, const uint64_t *key, int max_evidence, uint64_t seed){
 	if(edge_name == NULL || evidence == NULL) return -1;
 	bag_t *bag_cur;
-	register int n;
+	uint64_t j;
 	if((bag_cur = find_edge(*bag, edge_name)) == NULL){ /* if edge does not exist */
 		bag_cur = bag_init();
 		bag_cur->edge = strdup(edge_name);
-		bag_cur->weight = 1;
-		bag_cur->read_names[0] = strdup(read_name);
-		bag_cur->evidence[0] = strdup(evidence);       /* first and only 1 element*/
+		bag_cur->rng = bag_seed(edge_name, seed);
 		HASH_ADD_STR(*bag, edge, bag_cur);								
-	}else{
-		bag_cur->weight++;
-		bag_cur->read_names = realloc(bag_cur->read_names, bag_cur->weight * sizeof(*bag_cur->read_names));
-		bag_cur->evidence = realloc(bag_cur->evidence, bag_cur->weight * sizeof(*bag_cur->evidence));
-		bag_cur->read_names[bag_cur->weight-1] = strdup(read_name);
-		bag_cur->evidence[bag_cur->weight-1] = strdup(evidence);
+	}
+	bag_cur->weight++;
+	bag_cur->n_seen++;
+	if(max_evidence <= 0 || bag_cur->n_evidence < max_evidence){
+		bag_cur->n_evidence++;
+		bag_cur->read_names = realloc(bag_cur->read_names, bag_cur->n_evidence * sizeof(*bag_cur->read_names));
+		bag_cur->evidence = realloc(bag_cur->evidence, bag_cur->n_evidence * sizeof(*bag_cur->evidence));
+		bag_cur->prof = realloc(bag_cur->prof, bag_cur->n_evidence * sizeof(*bag_cur->prof));
+		bag_cur->read_names[bag_cur->n_evidence-1] = strdup(read_name);
+		bag_cur->evidence[bag_cur->n_evidence-1] = strdup(evidence);
+		bag_cur->prof[bag_cur->n_evidence-1] = prof_dup(prof);
+		if(key != NULL){
+			bag_cur->key = realloc(bag_cur->key, 2 * bag_cur->n_evidence * sizeof(uint64_t));
+			memcpy(bag_cur->key + 2 * (bag_cur->n_evidence-1), key, 2 * sizeof(uint64_t));
+		}
+	}else if((j = bag_rand(&bag_cur->rng) % bag_cur->n_seen) < max_evidence){
+		free(bag_cur->read_names[j]);
+		free(bag_cur->evidence[j]);
+		free(bag_cur->prof[j]);
+		bag_cur->read_names[j] = strdup(read_name);
+		bag_cur->evidence[j] = strdup(evidence);
+		bag_cur->prof[j] = prof_dup(prof);
+		if(key != NULL && bag_cur->key != NULL) memcpy(bag_cur->key + 2 * j, key, 2 * sizeof(uint64_t));
+	}
+	return 0;
+}
+
+/* move k of the n kept pairs of e chosen at random to the front */
+static inline void bag_pick(bag_t *e, int k, uint64_t *rng){
+	int i, j;
+	char *t;
+	hit_prof_t *h;
+	uint64_t x[2];
+	for(i=0; i<k && i<e->n_evidence; i++){
+		j = i + bag_rand(rng) % (e->n_evidence - i);
+		t = e->read_names[i]; e->read_names[i] = e->read_names[j]; e->read_names[j] = t;
+		t = e->evidence[i];   e->evidence[i]   = e->evidence[j];   e->evidence[j]   = t;
+		h = e->prof[i];       e->prof[i]       = e->prof[j];       e->prof[j]       = h;
+		if(e->key == NULL) continue;
+		memcpy(x, e->key + 2*i, sizeof(x)); memcpy(e->key + 2*i, e->key + 2*j, sizeof(x)); memcpy(e->key + 2*j, x, sizeof(x));
+	}
+}
+
+/* drop the kept pairs of e flagged in drop, the others keep their order */
+static inline void bag_drop(bag_t *e, const char *drop){
+	int i, n;
+	for(i=n=0; i<e->n_evidence; i++){
+		if(drop[i]){free(e->read_names[i]); free(e->evidence[i]); free(e->prof[i]); continue;}
+		e->read_names[n] = e->read_names[i];
+		e->evidence[n] = e->evidence[i];
+		e->prof[n] = e->prof[i];
+		if(e->key != NULL) memmove(e->key + 2*n, e->key + 2*i, 2 * sizeof(uint64_t));
+		n++;
+	}
+	e->n_evidence = n;
+}
+
+/*
+ * merge the edges of other, a graph built by bag_add on another part of
+ * the reads, into bag and free other. weights and n_seen add up, if both
+ * kept pairs exceed max_evidence the kept pairs of an edge are redrawn
+ * so that they stay a uniform sample of the pairs of both parts.
+ */
+static inline int 
+bag_merge(bag_t** bag, bag_t* other, int max_evidence, uint64_t seed){
+	bag_t *e, *o, *tmp;
+	uint64_t a, b;
+	int i, n, ka, kb;
+	HASH_ITER(hh, other, o, tmp){
+		HASH_DEL(other, o);
+		if((e = find_edge(*bag, o->edge)) == NULL){
+			o->rng = bag_seed(o->edge, seed);
+			HASH_ADD_STR(*bag, edge, o);
+			continue;
+		}
+		n = e->n_evidence + o->n_evidence;
+		ka = e->n_evidence; kb = o->n_evidence;
+		if(max_evidence > 0 && n > max_evidence){
+			/* draw max_evidence pairs from both parts without replacement */
+			a = e->n_seen; b = o->n_seen;
+			for(i=ka=kb=0; i<max_evidence; i++){
+				if(ka == e->n_evidence || (kb < o->n_evidence && bag_rand(&e->rng) % (a + b) >= a)){kb++; b--;}
+				else{ka++; a--;}
+			}
+			bag_pick(e, ka, &e->rng);
+			bag_pick(o, kb, &e->rng);
+			for(i=ka; i<e->n_evidence; i++){free(e->read_names[i]); free(e->evidence[i]); free(e->prof[i]);}
+			n = ka + kb;
+		}
+		e->read_names = realloc(e->read_names, n * sizeof(*e->read_names));
+		e->evidence = realloc(e->evidence, n * sizeof(*e->evidence));
+		e->prof = realloc(e->prof, n * sizeof(*e->prof));
+		memcpy(e->read_names + ka, o->read_names, kb * sizeof(*e->read_names));
+		memcpy(e->evidence + ka, o->evidence, kb * sizeof(*e->evidence));
+		memcpy(e->prof + ka, o->prof, kb * sizeof(*e->prof));
+		if(e->key != NULL && o->key != NULL){
+			e->key = realloc(e->key, 2 * (n + 1) * sizeof(uint64_t));
+			memcpy(e->key + 2*ka, o->key, 2 * kb * sizeof(uint64_t));
+		}else if(e->key != NULL){
+			free(e->key);
+			e->key = NULL;
+		}
+		for(i=kb; i<o->n_evidence; i++){free(o->read_names[i]); free(o->evidence[i]); free(o->prof[i]);}
+		e->n_evidence = n;
+		e->weight += o->weight;
+		e->n_seen += o->n_seen;
+		e->n_dup += o->n_dup;
+		free(o->read_names);
+		free(o->evidence);
+		free(o->prof);
+		free(o->key);
+		free(o->edge);
+		free(o);
 	}
 	return 0;
 }
@@ -151,37 +313,49 @@ static inline bag_t
 	return edge;
 }
 
+/* a kept pair of an edge in the set of bag_uniq */
+typedef struct {
+	char *evidence;
+	UT_hash_handle hh;
+} bag_pair_t;
+
 /*
  * remove duplicate reads that support graph edge, make sure read pairs 
- * that support every egde is unique.
+ * that support every egde is unique. if the evidence of an edge is a 
+ * sample, its weight is scaled by the fraction of unique pairs in the 
+ * sample. pairs of an edge are hashed so that this is linear.
  */
 static inline int 
 bag_uniq(bag_t **bag){
 	if(*bag==NULL) return -1;
 	bag_t *bag_cur;
-	int i, j;
-	bool repeat;
-	int weight;
-	char **names, **evidence;
+	bag_pair_t *set, *pairs, *q, *tmp;
+	int i, n;
 	/* iterate every edge and remove duplicates */
 	for(bag_cur=*bag; bag_cur != NULL; bag_cur=bag_cur->hh.next){
-		evidence = mycalloc(bag_cur->weight, char*);
-		names = mycalloc(bag_cur->weight, char*);
-		weight = 0;
-		for(i=0; i<bag_cur->weight; i++){ /* iterate every evidence */
-			repeat = false;
-			for(j=0; j<weight; j++){if(strcmp(bag_cur->evidence[i], evidence[j])==0){repeat = true;}}
-			if(repeat==false){ // no duplicates
-				evidence[weight] = strdup(bag_cur->evidence[i]);
-				names[weight] = strdup(bag_cur->read_names[i]);
-				weight ++;
+		if(bag_cur->n_evidence == 0) continue;
+		set = NULL;
+		pairs = mycalloc(bag_cur->n_evidence, bag_pair_t);
+		for(i=n=0; i<bag_cur->n_evidence; i++){ /* iterate every evidence */
+			HASH_FIND_STR(set, bag_cur->evidence[i], q);
+			if(q != NULL){ // duplicate
+				free(bag_cur->evidence[i]);
+				free(bag_cur->read_names[i]);
+				free(bag_cur->prof[i]);
+				continue;
 			}
+			bag_cur->evidence[n] = bag_cur->evidence[i];
+			bag_cur->read_names[n] = bag_cur->read_names[i];
+			bag_cur->prof[n] = bag_cur->prof[i];
+			if(bag_cur->key != NULL) memmove(bag_cur->key + 2*n, bag_cur->key + 2*i, 2 * sizeof(uint64_t));
+			pairs[n].evidence = bag_cur->evidence[n];
+			HASH_ADD_KEYPTR(hh, set, pairs[n].evidence, strlen(pairs[n].evidence), &pairs[n]);
+			n++;
 		}
-		if(bag_cur->evidence)  {for(i=0; i<bag_cur->weight; i++) free(bag_cur->evidence[i]);   free(bag_cur->evidence);} 
-		if(bag_cur->read_names){for(i=0; i<bag_cur->weight; i++) free(bag_cur->read_names[i]); free(bag_cur->read_names);} 
-		bag_cur->evidence = evidence;
-		bag_cur->read_names = names;
-		bag_cur->weight = weight;
+		HASH_ITER(hh, set, q, tmp) HASH_DEL(set, q);
+		free(pairs);
+		bag_cur->weight = (bag_cur->n_evidence == bag_cur->n_seen) ? n : (int)((double)bag_cur->n_seen * n / bag_cur->n_evidence + 0.5);
+		bag_cur->n_evidence = n;
 	}
 	return 0;
 }
@@ -264,13 +438,13 @@ bag_trim(bag_t **bag, int min_weight){
 static inline int min_mismatch(char* str, char* pattern){
 	if(str == NULL || pattern == NULL) return INT_MAX;
 	register int i, j, n;
-	int min_mis_match = strlen(pattern)+1;
-	char substring[strlen(pattern)+1];
-	for(i=0;i<strlen(str)-strlen(pattern);i++){
+	int l_str = strlen(str);
+	int l_pattern = strlen(pattern);
+	int min_mis_match = l_pattern+1;
+	/* every window is tested so that matching the reverse complement of both gives the same result */
+	for(i=0;i<=l_str-l_pattern;i++){
 		n = 0;
-		memset(substring, '\0', sizeof(substring));
-		strncpy(substring, &str[i], strlen(pattern));
-		for(j=0; j<strlen(pattern); j++){if(toupper(pattern[j]) != toupper(substring[j])){n++;}}
+		for(j=0; j<l_pattern && n<min_mis_match; j++){if(toupper(pattern[j]) != toupper(str[i+j])){n++;}}
 		if (n < min_mis_match){min_mis_match = n;} // update min_mis_match
 	}
 	return min_mis_match;
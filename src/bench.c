@@ -0,0 +1,295 @@
+/*--------------------------------------------------------------------*/
+/* bench.c                                                            */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Micro benchmarks of the alignment kernels and kmer lookups.        */
+/*--------------------------------------------------------------------*/
+/* Inputs are synthetic and only depend on the seed, so numbers of    */
+/* two builds on the same machine can be compared directly. Every     */
+/* case is repeated until it ran for at least -s seconds. Columns:    */
+/*   kernel, case, ops, ns/op, Mcells/s (DP kernels), reads/s.        */
+/*--------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "alignment.h"
+#include "bag.h"
+#include "kmer_index.h"
+#include "fasta_uthash.h"
+#include "stats.h"
+#include "utils.h"
+
+#define BENCH_EXON_LEN      150  /* mean exon length of synthetic genes */
+#define BENCH_GENE_EXONS    10   /* exons per synthetic gene */
+#define BENCH_ERR           0.01 /* substitution rate of synthetic reads */
+
+static const char BENCH_NT[] = "ACGT";
+static double MIN_SEC = 0.5;
+static uint64_t RNG = 11;
+
+static char *bench_seq(int l){
+	char *s = mycalloc(l + 1, char);
+	int i;
+	for(i=0; i<l; i++) s[i] = BENCH_NT[bag_rand(&RNG) & 3];
+	return s;
+}
+
+/* l bases of s from pos with substitutions */
+static char *bench_read(const char *s, int pos, int l){
+	char *r = mycalloc(l + 1, char);
+	int i;
+	memcpy(r, s + pos, l);
+	for(i=0; i<l; i++) if(bag_rand(&RNG) % 10000 < BENCH_ERR * 10000) r[i] = BENCH_NT[bag_rand(&RNG) & 3];
+	return r;
+}
+
+static void bench_report(const char *kernel, const char *name, long ops, double sec, double cells, double reads){
+	printf("%-16s %-28s %10ld %14.1f", kernel, name, ops, sec * 1e9 / ops);
+	if(cells > 0) printf(" %10.1f", cells / sec / 1e6); else printf(" %10s", "-");
+	if(reads > 0) printf(" %12.0f", reads / sec); else printf(" %12s", "-");
+	printf("\n");
+	fflush(stdout);
+}
+
+/* fusion transcript of about l bases joining two genes of n exons each */
+typedef struct {
+	char *s;
+	int l;
+	int junction;
+	int S1[64], S2[64];
+	int S1_num, S2_num;
+} bench_tx_t;
+
+static bench_tx_t *bench_tx(int l){
+	bench_tx_t *t = mycalloc(1, bench_tx_t);
+	int n = l / BENCH_EXON_LEN / 2, i;
+	if(n > 64) n = 64;
+	if(n < 1) n = 1;
+	t->s = bench_seq(l);
+	t->l = l;
+	t->junction = l / 2;
+	for(i=0; i<n; i++) t->S1[i] = (i + 1) * (t->junction / n);
+	for(i=0; i<n; i++) t->S2[i] = t->junction + i * ((l - t->junction) / n);
+	t->S1_num = t->S2_num = n;
+	return t;
+}
+
+static void bench_tx_destroy(bench_tx_t *t){
+	free(t->s);
+	free(t);
+}
+
+static void bench_align(){
+	int read_len[] = {75, 100, 150}, tx_len[] = {2000, 5000, 20000};
+	int i, j;
+	long ops;
+	double t0, sec, cells;
+	char name[64], *read;
+	bench_tx_t *tx;
+	solution_t *sol;
+	for(j=0; j<3; j++){
+		tx = bench_tx(tx_len[j]);
+		for(i=0; i<3; i++){
+			/* reads span the junction */
+			read = bench_read(tx->s, tx->junction - read_len[i] / 2, read_len[i]);
+			sprintf(name, "read=%d tx=%d", read_len[i], tx_len[j]);
+			for(ops=0, t0=stats_clock(); (sec = stats_clock() - t0) < MIN_SEC || ops < 3; ops++){
+				if((sol = align(read, tx->s, tx->junction, 2, -2, -5, -1, -10)) != NULL) solution_destory(&sol);
+			}
+			cells = (double)ops * read_len[i] * tx_len[j];
+			bench_report("align", name, ops, sec, cells, ops);
+			for(ops=0, t0=stats_clock(); (sec = stats_clock() - t0) < MIN_SEC || ops < 3; ops++){
+				if((sol = align_exon_jump(read, tx->s, tx->S1, tx->S2, tx->S1_num, tx->S2_num, 2, -2, -5, -1, -8)) != NULL) solution_destory(&sol);
+			}
+			cells = (double)ops * read_len[i] * tx_len[j];
+			bench_report("align_exon_jump", name, ops, sec, cells, ops);
+			free(read);
+		}
+		bench_tx_destroy(tx);
+	}
+}
+
+static void bench_min_mismatch(){
+	int read_len[] = {75, 100, 150};
+	int i, n = 10000, r, seed_len = 20;
+	long ops;
+	double t0, sec;
+	char name[64], **reads, *junc, *ref = bench_seq(100000);
+	volatile int sink = 0;
+	junc = bench_seq(seed_len);
+	for(i=0; i<3; i++){
+		reads = mycalloc(n, char*);
+		for(r=0; r<n; r++) reads[r] = bench_read(ref, bag_rand(&RNG) % (100000 - read_len[i]), read_len[i]);
+		sprintf(name, "read=%d seed=%d", read_len[i], seed_len);
+		for(ops=0, t0=stats_clock(); (sec = stats_clock() - t0) < MIN_SEC || ops < n; ops++) sink += min_mismatch(reads[ops % n], junc);
+		bench_report("min_mismatch", name, ops, sec, (double)ops * (read_len[i] - seed_len + 1) * seed_len, ops);
+		for(r=0; r<n; r++) free(reads[r]);
+		free(reads);
+	}
+	free(junc);
+	free(ref);
+}
+
+/* a panel of n_gene genes of BENCH_GENE_EXONS exons named GENE.i */
+static fasta_t *bench_panel(int n_gene){
+	fasta_t *tb = NULL, *s;
+	char name[64];
+	int g, e;
+	for(g=0; g<n_gene; g++){
+		for(e=1; e<=BENCH_GENE_EXONS; e++){
+			s = fasta_init();
+			sprintf(name, "G%d.%d", g, e);
+			s->name = strdup(name);
+			s->seq = bench_seq(BENCH_EXON_LEN / 2 + bag_rand(&RNG) % BENCH_EXON_LEN);
+			HASH_ADD_STR(tb, name, s);
+		}
+	}
+	return tb;
+}
+
+static void bench_kmer(){
+	int n_genes[] = {500, 1000, 3000}, types[] = {KIDX_HASH, KIDX_SORTED};
+	int i, j, r, n_reads = 20000, read_len = 100, k = 15, pos, strand, exon;
+	long ops, probes;
+	double t0, sec;
+	char name[64], **reads;
+	fasta_t *tb, *s, **exons;
+	kidx_t *idx = NULL;
+	uint64_t kmer;
+	kmer_itr_t itr;
+	volatile long sink = 0;
+	for(i=0; i<3; i++){
+		tb = bench_panel(n_genes[i]);
+		/* reads from the panel */
+		exons = mycalloc(HASH_COUNT(tb), fasta_t*);
+		for(j=0, s=tb; s!=NULL; s=s->hh.next) if(strlen(s->seq) >= read_len) exons[j++] = s;
+		reads = mycalloc(n_reads, char*);
+		for(r=0; r<n_reads; r++){
+			s = exons[bag_rand(&RNG) % j];
+			reads[r] = bench_read(s->seq, bag_rand(&RNG) % (strlen(s->seq) - read_len + 1), read_len);
+		}
+		for(j=0; j<2; j++){
+			sprintf(name, "genes=%d %s", n_genes[i], (types[j] == KIDX_SORTED) ? "sorted" : "hash");
+			/* only builds are timed, the last index is kept for the scan */
+			for(ops=0, sec=0; sec < MIN_SEC || ops < 1; ops++){
+				kidx_destroy(idx);
+				t0 = stats_clock();
+				if((idx = kidx_build(tb, k, 1, types[j])) == NULL) die("[%s] can't build the index", __func__);
+				sec += stats_clock() - t0;
+			}
+			bench_report("kidx_build", name, ops, sec, 0, 0);
+			sprintf(name, "genes=%d %s read=%d", n_genes[i], (types[j] == KIDX_SORTED) ? "sorted" : "hash", read_len);
+			for(ops=0, probes=0, t0=stats_clock(); (sec = stats_clock() - t0) < MIN_SEC || ops < n_reads; ops++){
+				kmer_itr_init(&itr, reads[ops % n_reads], k);
+				while(kmer_itr_next(&itr, &pos, &kmer, &strand)){
+					if((exon = kidx_uniq_hit(idx, kmer, strand)) >= 0) sink += exon;
+					probes++;
+				}
+			}
+			bench_report("kmer_scan", name, ops, sec, 0, ops);
+			sprintf(name, "genes=%d %s", n_genes[i], (types[j] == KIDX_SORTED) ? "sorted" : "hash");
+			bench_report("kmer_probe", name, probes, sec, 0, 0);
+			kidx_destroy(idx);
+			idx = NULL;
+		}
+		for(r=0; r<n_reads; r++) free(reads[r]);
+		free(reads);
+		free(exons);
+		/* fasta_destroy leaves the names to their owner */
+		for(s=tb; s!=NULL; s=s->hh.next) free(s->name);
+		fasta_destroy(&tb);
+	}
+}
+
+/* edges with n_pairs pairs of evidence each, half of them duplicates */
+static bag_t *bench_bag(int n_edges, int n_pairs, char **pool, int n_pool){
+	bag_t *bag = NULL;
+	char edge[64], rname[64];
+	int e, p;
+	for(e=0; e<n_edges; e++){
+		sprintf(edge, "G%d_G%d", e, e + 1);
+		for(p=0; p<n_pairs; p++){
+			sprintf(rname, "r%d.%d", e, p);
+			bag_add(&bag, edge, rname, pool[((p % 2) ? p - 1 : p) % n_pool], NULL, NULL, 0, 11);
+		}
+	}
+	return bag;
+}
+
+/* bag_destory leaves the pairs of the edges to their owner */
+static void bench_bag_destroy(bag_t **bag){
+	bag_t *e;
+	int i;
+	for(e=*bag; e!=NULL; e=e->hh.next){
+		for(i=0; i<e->n_evidence; i++){free(e->read_names[i]); free(e->evidence[i]); free(e->prof[i]);}
+		free(e->read_names);
+		free(e->evidence);
+		free(e->prof);
+		free(e->key);
+		free(e->edge);
+	}
+	bag_destory(bag);
+}
+
+static void bench_bag_uniq(){
+	int n_pairs[] = {100, 1000, 5000}, n_edges = 20, n_pool = 10000;
+	int i, p;
+	long ops;
+	double t0, tot;
+	char name[64], **pool, *r1, *r2;
+	bag_t *bag;
+	pool = mycalloc(n_pool, char*);
+	for(p=0; p<n_pool; p++){
+		r1 = bench_seq(100); r2 = bench_seq(100);
+		pool[p] = mycalloc(202, char);
+		sprintf(pool[p], "%s_%s", r1, r2);
+		free(r1); free(r2);
+	}
+	for(i=0; i<3; i++){
+		sprintf(name, "edges=%d pairs=%d", n_edges, n_pairs[i]);
+		for(ops=0, tot=0; tot < MIN_SEC || ops < 1; ops++){
+			bag = bench_bag(n_edges, n_pairs[i], pool, n_pool);
+			t0 = stats_clock();
+			bag_uniq(&bag);
+			tot += stats_clock() - t0;
+			bench_bag_destroy(&bag);
+		}
+		bench_report("bag_uniq", name, ops, tot, 0, (double)ops * n_edges * n_pairs[i]);
+	}
+	for(p=0; p<n_pool; p++) free(pool[p]);
+	free(pool);
+}
+
+static int usage(){
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Usage:   tafuco-bench [options] [kernel ...]\n\n");
+	fprintf(stderr, "Details: micro benchmarks on synthetic inputs, kernel is align, min_mismatch,\n");
+	fprintf(stderr, "         kmer or bag_uniq, all of them by default\n\n");
+	fprintf(stderr, "Options: -s FLOAT  min seconds per case [%.2f]\n", MIN_SEC);
+	fprintf(stderr, "         -r INT    seed of the inputs [%llu]\n", (unsigned long long)RNG);
+	return 1;
+}
+
+int main(int argc, char *argv[]){
+	int c, i, all;
+	while((c = getopt(argc, argv, "s:r:h")) >= 0){
+		switch(c){
+			case 's': MIN_SEC = atof(optarg); break;
+			case 'r': RNG = strtoull(optarg, NULL, 10); break;
+			default: return usage();
+		}
+	}
+	all = (optind == argc);
+	printf("%-16s %-28s %10s %14s %10s %12s\n", "kernel", "case", "ops", "ns/op", "Mcells/s", "reads/s");
+	for(i=optind; i<=argc; i++){
+		if(!all && i == argc) break;
+		if(all || strcmp(argv[i], "align") == 0)        bench_align();
+		if(all || strcmp(argv[i], "min_mismatch") == 0) bench_min_mismatch();
+		if(all || strcmp(argv[i], "kmer") == 0)         bench_kmer();
+		if(all || strcmp(argv[i], "bag_uniq") == 0)     bench_bag_uniq();
+		if(all) break;
+	}
+	return 0;
+}
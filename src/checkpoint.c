@@ -0,0 +1,316 @@
+/*--------------------------------------------------------------------*/
+/* checkpoint.c                                                       */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Checkpoints of the pipeline between its major stages.              */
+/*--------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+#include "shard.h"
+
+#define CKPT_NULL  0xFFFFFFFFU  /* length of a NULL string or array */
+
+/* FNV-1a of the n bytes of s on top of h */
+static uint64_t hash_bytes(uint64_t h, const void *s, size_t n){
+	const unsigned char *c = (const unsigned char*)s;
+	for(; n > 0; n--, c++) h = (h ^ *c) * 0x100000001B3ULL;
+	return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s){
+	return (s == NULL) ? hash_bytes(h, "\0", 1) : hash_bytes(h, s, strlen(s) + 1);
+}
+
+/* a file by its path, size and mtime */
+static uint64_t hash_file(uint64_t h, const char *fname){
+	struct stat st;
+	int64_t v[2] = {-1, -1};
+	h = hash_str(h, fname);
+	if(fname != NULL && stat(fname, &st) == 0){v[0] = st.st_size; v[1] = st.st_mtime;}
+	return hash_bytes(h, v, sizeof(v));
+}
+
+void ckpt_hash(const opt_t *opt, uint64_t hash[CKPT_NUM]){
+	uint64_t h = 0xCBF29CE484222325ULL;
+	int32_t v[8];
+	double d;
+	hash[CKPT_NONE] = 0;
+	/* graph, built from the reads and the exons */
+	h = hash_file(h, opt->fq1);
+	h = hash_file(h, opt->fq2);
+	h = hash_file(h, opt->fa);
+	h = hash_file(h, opt->gfile);
+	h = hash_file(h, opt->gtf);
+	v[0] = opt->k; v[1] = opt->min_kmer_match; v[2] = opt->min_edge_weight; v[3] = opt->max_evidence;
+	h = hash_bytes(h, v, 4 * sizeof(int32_t));
+	h = hash_bytes(h, &opt->seed, sizeof(opt->seed));
+	h = hash_bytes(h, &opt->resync, sizeof(opt->resync));
+	h = hash_str(h, opt->trim.adapter);
+	h = hash_bytes(h, &opt->trim.min_qual, sizeof(opt->trim.min_qual));
+	h = hash_bytes(h, &opt->trim.min_entropy, sizeof(opt->trim.min_entropy));
+	hash[CKPT_BAG] = h;
+	/* junctions and transcripts */
+	v[0] = opt->seed_len; v[1] = opt->min_hits; v[2] = opt->match; v[3] = opt->mismatch;
+	v[4] = opt->gap; v[5] = opt->extension; v[6] = opt->jump_gene; v[7] = 0;
+	h = hash_bytes(h, v, 8 * sizeof(int32_t));
+	d = opt->min_align_score;
+	h = hash_bytes(h, &d, sizeof(d));
+	hash[CKPT_JUNCTION] = h;
+	/* alignments of the pairs */
+	v[0] = opt->jump_exon; v[1] = opt->max_mismatch;
+	h = hash_bytes(h, v, 2 * sizeof(int32_t));
+	hash[CKPT_SOLUTION] = h;
+}
+
+static int put_str(FILE *fp, const char *s){
+	uint32_t l = (s == NULL) ? CKPT_NULL : strlen(s);
+	if(fwrite(&l, 4, 1, fp) != 1) return -1;
+	return (s == NULL || fwrite(s, 1, l, fp) == l) ? 0 : -1;
+}
+
+/* *s is NULL for a NULL string, return -1 on failure */
+static int get_str(FILE *fp, char **s){
+	uint32_t l;
+	*s = NULL;
+	if(fread(&l, 4, 1, fp) != 1) return -1;
+	if(l == CKPT_NULL) return 0;
+	*s = mycalloc(l + 1, char);
+	if(fread(*s, 1, l, fp) != l){free(*s); *s = NULL; return -1;}
+	return 0;
+}
+
+static int put_ints(FILE *fp, const int *a, int n){
+	uint32_t l = (a == NULL) ? CKPT_NULL : (uint32_t)n;
+	if(fwrite(&l, 4, 1, fp) != 1) return -1;
+	return (a == NULL || fwrite(a, sizeof(int), n, fp) == n) ? 0 : -1;
+}
+
+static int get_ints(FILE *fp, int **a){
+	uint32_t l;
+	*a = NULL;
+	if(fread(&l, 4, 1, fp) != 1) return -1;
+	if(l == CKPT_NULL) return 0;
+	*a = mycalloc(l + 1, int);
+	return (fread(*a, sizeof(int), l, fp) == l) ? 0 : -1;
+}
+
+/* the scores of an alignment, the aligned strings are not kept */
+static int put_sol(FILE *fp, const solution_t *s){
+	double d[2] = {s->score, s->prob};
+	int32_t v[7] = {s->jump, s->jump_start, s->jump_end, s->pos, s->match, s->insertion, s->deletion};
+	return (fwrite(d, sizeof(double), 2, fp) == 2 && fwrite(v, 4, 7, fp) == 7) ? 0 : -1;
+}
+
+static solution_t *get_sol(FILE *fp){
+	double d[2];
+	int32_t v[7];
+	solution_t *s;
+	if(fread(d, sizeof(double), 2, fp) != 2 || fread(v, 4, 7, fp) != 7) return NULL;
+	s = solution_init();
+	s->score = d[0]; s->prob = d[1];
+	s->jump = v[0]; s->jump_start = v[1]; s->jump_end = v[2]; s->pos = v[3];
+	s->match = v[4]; s->insertion = v[5]; s->deletion = v[6];
+	return s;
+}
+
+static int ckpt_bag_write(FILE *fp, const pipe_t *p){
+	bag_t *e;
+	gene_t *g;
+	dup_t *d;
+	uint64_t n;
+	int32_t v[4];
+	int i;
+	for(g=p->gene; g!=NULL; g=g->hh.next){
+		if(g->hits == 0) continue;
+		v[0] = g->hits; v[1] = g->dups;
+		if(put_str(fp, g->name) != 0 || fwrite(v, 4, 2, fp) != 2) return -1;
+	}
+	if(put_str(fp, NULL) != 0) return -1;
+	for(e=p->bag; e!=NULL; e=e->hh.next){
+		v[0] = e->weight; v[1] = e->n_seen; v[2] = e->n_evidence; v[3] = e->n_dup;
+		if(put_str(fp, e->edge) != 0 || put_str(fp, e->gname1) != 0 || put_str(fp, e->gname2) != 0 || fwrite(v, 4, 4, fp) != 4) return -1;
+		for(i=0; i<e->n_evidence; i++)
+			if(put_str(fp, e->read_names[i]) != 0 || shard_put_pair(fp, e->evidence[i]) != 0) return -1;
+	}
+	n = HASH_COUNT(p->dups);
+	if(fwrite(&n, 8, 1, fp) != 1) return -1;
+	for(d=p->dups; d!=NULL; d=d->hh.next) if(fwrite(d->key, 8, 2, fp) != 2) return -1;
+	return 0;
+}
+
+static int ckpt_bag_read(FILE *fp, pipe_t *p, uint64_t n){
+	bag_t *e;
+	gene_t *g;
+	char *name;
+	int32_t v[4];
+	uint64_t i, key[2];
+	int j;
+	while(1){
+		if(get_str(fp, &name) != 0) return -1;
+		if(name == NULL) break;
+		if(fread(v, 4, 2, fp) != 2){free(name); return -1;}
+		if((g = find_gene(p->gene, name)) != NULL){g->hits = v[0]; g->dups = v[1];}
+		free(name);
+	}
+	for(i=0; i<n; i++){
+		e = bag_init();
+		if(get_str(fp, &e->edge) != 0 || e->edge == NULL){free(e); return -1;}
+		HASH_ADD_STR(p->bag, edge, e);
+		if(get_str(fp, &e->gname1) != 0 || get_str(fp, &e->gname2) != 0 || fread(v, 4, 4, fp) != 4) return -1;
+		e->weight = v[0]; e->n_seen = v[1]; e->n_dup = v[3];
+		e->read_names = realloc(e->read_names, (v[2] + 1) * sizeof(char*));
+		e->evidence = realloc(e->evidence, (v[2] + 1) * sizeof(char*));
+		e->prof = realloc(e->prof, (v[2] + 1) * sizeof(hit_prof_t*));
+		memset(e->prof, 0, (v[2] + 1) * sizeof(hit_prof_t*));
+		for(j=0; j<v[2]; j++, e->n_evidence++){
+			if(get_str(fp, &e->read_names[j]) != 0 || e->read_names[j] == NULL) return -1;
+			if((e->evidence[j] = shard_get_pair(fp)) == NULL){free(e->read_names[j]); return -1;}
+		}
+	}
+	if(fread(&n, 8, 1, fp) != 1) return -1;
+	for(i=0; i<n; i++){
+		if(fread(key, 8, 2, fp) != 2) return -1;
+		dup_add(&p->dups, key);
+	}
+	return 0;
+}
+
+/* junctions with their transcripts, by edge in the order of the graph */
+static int ckpt_junction_write(FILE *fp, const pipe_t *p){
+	bag_t *e;
+	junction_t *j;
+	int32_t v[4];
+	double d;
+	for(e=p->bag; e!=NULL; e=e->hh.next){
+		/* the junction of an edge without one is not in a hash table */
+		v[0] = (e->junc_flag == true); v[1] = 0;
+		for(j=e->junc; j!=NULL; j=j->hh.next) v[1]++;
+		if(put_str(fp, e->edge) != 0 || fwrite(v, 4, 2, fp) != 2) return -1;
+		for(j=e->junc; j!=NULL; j=j->hh.next){
+			v[0] = j->junc_pos; v[1] = j->S1_num; v[2] = j->S2_num; v[3] = j->hits;
+			d = j->likehood;
+			if(put_str(fp, j->idx) != 0 || put_str(fp, j->exon1) != 0 || put_str(fp, j->exon2) != 0 || put_str(fp, j->s) != 0 || put_str(fp, j->transcript) != 0) return -1;
+			if(fwrite(v, 4, 4, fp) != 4 || fwrite(&d, sizeof(d), 1, fp) != 1) return -1;
+			if(put_ints(fp, j->S1, j->S1_num) != 0 || put_ints(fp, j->S2, j->S2_num) != 0) return -1;
+		}
+	}
+	return 0;
+}
+
+static int ckpt_junction_read(FILE *fp, pipe_t *p, uint64_t n){
+	bag_t *e;
+	junction_t *j;
+	char *edge;
+	int32_t v[4];
+	double d;
+	uint64_t i;
+	int k;
+	for(i=0; i<n; i++){
+		if(get_str(fp, &edge) != 0 || edge == NULL || fread(v, 4, 2, fp) != 2){free(edge); return -1;}
+		e = find_edge(p->bag, edge);
+		free(edge);
+		if(e == NULL) return -1;
+		e->junc_flag = (v[0]) ? true : false;
+		for(k=v[1]; k>0; k--){
+			j = mycalloc(1, junction_t);
+			if(get_str(fp, &j->idx) != 0 || get_str(fp, &j->exon1) != 0 || get_str(fp, &j->exon2) != 0 || get_str(fp, &j->s) != 0 || get_str(fp, &j->transcript) != 0) return -1;
+			if(fread(v, 4, 4, fp) != 4 || fread(&d, sizeof(d), 1, fp) != 1) return -1;
+			j->junc_pos = v[0]; j->S1_num = v[1]; j->S2_num = v[2]; j->hits = v[3];
+			j->likehood = d;
+			if(get_ints(fp, &j->S1) != 0 || get_ints(fp, &j->S2) != 0) return -1;
+			HASH_ADD_KEYPTR(hh, e->junc, j->idx, (j->idx) ? strlen(j->idx) : 0, j);
+		}
+	}
+	return 0;
+}
+
+static int ckpt_solution_write(FILE *fp, const pipe_t *p){
+	solution_pair_t *s;
+	for(s=p->sol; s!=NULL; s=s->hh.next){
+		if(put_str(fp, s->idx) != 0 || put_str(fp, s->fuse_name) != 0 || put_str(fp, s->junc_name) != 0) return -1;
+		if(fwrite(&s->prob, sizeof(s->prob), 1, fp) != 1 || put_sol(fp, s->r1) != 0 || put_sol(fp, s->r2) != 0) return -1;
+	}
+	return 0;
+}
+
+static int ckpt_solution_read(FILE *fp, pipe_t *p, uint64_t n){
+	solution_pair_t *s;
+	uint64_t i;
+	for(i=0; i<n; i++){
+		s = mycalloc(1, solution_pair_t);
+		if(get_str(fp, &s->idx) != 0 || s->idx == NULL){free(s); return -1;}
+		HASH_ADD_STR(p->sol, idx, s);
+		if(get_str(fp, &s->fuse_name) != 0 || get_str(fp, &s->junc_name) != 0) return -1;
+		if(fread(&s->prob, sizeof(s->prob), 1, fp) != 1) return -1;
+		if((s->r1 = get_sol(fp)) == NULL || (s->r2 = get_sol(fp)) == NULL) return -1;
+	}
+	return 0;
+}
+
+static char *ckpt_file(const char *dir, int stage){
+	return join(4, (char*)dir, "/", (char*)CKPT_NAMES[stage], ".ckpt");
+}
+
+int ckpt_save(const pipe_t *p, int stage, const uint64_t hash[CKPT_NUM]){
+	const char *dir = p->opt.checkpoint;
+	ckpt_hdr_t hdr;
+	char *fname, *tmp;
+	FILE *fp;
+	int ret;
+	if(dir == NULL || stage <= CKPT_NONE || stage >= CKPT_NUM) return -1;
+	if(mkdir(dir, 0777) != 0 && errno != EEXIST) return -1;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CKPT_MAGIC, 8);
+	hdr.stage = stage;
+	hdr.flip = p->opt.flip;
+	hdr.hash = hash[stage];
+	hdr.n = (stage == CKPT_SOLUTION) ? HASH_COUNT(p->sol) : HASH_COUNT(p->bag);
+	fname = ckpt_file(dir, stage);
+	tmp = join(2, fname, ".tmp");
+	if((fp = fopen(tmp, "wb")) == NULL){free(fname); free(tmp); return -1;}
+	ret = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1) ? 0 : -1;
+	if(ret == 0 && stage == CKPT_BAG)      ret = ckpt_bag_write(fp, p);
+	if(ret == 0 && stage == CKPT_JUNCTION) ret = ckpt_junction_write(fp, p);
+	if(ret == 0 && stage == CKPT_SOLUTION) ret = ckpt_solution_write(fp, p);
+	if(fclose(fp) != 0) ret = -1;
+	/* a checkpoint is complete or absent */
+	if(ret == 0 && rename(tmp, fname) != 0) ret = -1;
+	if(ret != 0) unlink(tmp);
+	free(fname);
+	free(tmp);
+	return ret;
+}
+
+/* open the checkpoint of stage if its hash matches, NULL if not */
+static FILE *ckpt_open(const char *dir, int stage, uint64_t hash, ckpt_hdr_t *hdr){
+	char *fname = ckpt_file(dir, stage);
+	FILE *fp = fopen(fname, "rb");
+	free(fname);
+	if(fp == NULL) return NULL;
+	if(fread(hdr, sizeof(ckpt_hdr_t), 1, fp) != 1 || memcmp(hdr->magic, CKPT_MAGIC, 8) != 0 || hdr->stage != stage || hdr->hash != hash){
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+int ckpt_load(pipe_t *p, const uint64_t hash[CKPT_NUM]){
+	const char *dir = p->opt.checkpoint;
+	ckpt_hdr_t hdr;
+	FILE *fp;
+	int stage, ret;
+	if(dir == NULL) return CKPT_NONE;
+	for(stage=CKPT_BAG; stage<CKPT_NUM; stage++){
+		if((fp = ckpt_open(dir, stage, hash[stage], &hdr)) == NULL) break;
+		if(stage == CKPT_BAG)      ret = ckpt_bag_read(fp, p, hdr.n);
+		if(stage == CKPT_JUNCTION) ret = ckpt_junction_read(fp, p, hdr.n);
+		if(stage == CKPT_SOLUTION) ret = ckpt_solution_read(fp, p, hdr.n);
+		fclose(fp);
+		if(ret != 0) die("[%s] %s/%s.ckpt is truncated, remove it to start over", __func__, dir, CKPT_NAMES[stage]);
+		if(stage == CKPT_BAG) p->opt.flip = hdr.flip;
+	}
+	return stage - 1;
+}
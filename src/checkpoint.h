@@ -0,0 +1,58 @@
+/*--------------------------------------------------------------------*/
+/* checkpoint.h                                                       */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Checkpoints of the pipeline between its major stages.              */
+/*--------------------------------------------------------------------*/
+/* With --checkpoint DIR the pipeline writes DIR/bag.ckpt after the   */
+/* graph is trimmed, DIR/junction.ckpt after junctions and their      */
+/* transcripts are built and DIR/solution.ckpt after the pairs are    */
+/* aligned. Every file starts with ckpt_hdr_t, hash is the config     */
+/* hash of its stage: the inputs (path, size and mtime) and the       */
+/* options the stage depends on, chained with the hash of the stage   */
+/* before. A rerun loads the stages whose hash still matches and goes */
+/* on from the first stage that doesn't, scoring options (-A, -p) are */
+/* in no hash so scoring is redone from the solutions alone.          */
+/*--------------------------------------------------------------------*/
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "predict.h"
+
+#define CKPT_MAGIC          "TFCCKPT3"
+
+/* stages of a checkpoint, each one includes the ones before */
+#define CKPT_NONE           0
+#define CKPT_BAG            1
+#define CKPT_JUNCTION       2
+#define CKPT_SOLUTION       3
+#define CKPT_NUM            4
+
+static const char *CKPT_NAMES[CKPT_NUM] = {"none", "bag", "junction", "solution"};
+
+typedef struct {
+	char magic[8];
+	int32_t stage;
+	int32_t flip;           /* opt->flip of the sample, bag only */
+	uint64_t hash;          /* config hash of the stage */
+	uint64_t n;             /* number of records */
+} ckpt_hdr_t;
+
+/* config hashes of every stage of the run of opt, hash[CKPT_NONE] is 0 */
+void ckpt_hash(const opt_t *opt, uint64_t hash[CKPT_NUM]);
+
+/* write stage of p to opt.checkpoint, return 0 on success */
+int ckpt_save(const pipe_t *p, int stage, const uint64_t hash[CKPT_NUM]);
+
+/*
+ * load the stages of opt.checkpoint into p as long as their hashes
+ * match, return the last stage loaded, CKPT_NONE if none.
+ */
+int ckpt_load(pipe_t *p, const uint64_t hash[CKPT_NUM]);
+
+#endif
@@ -0,0 +1,356 @@
+/*--------------------------------------------------------------------*/
+/* fastq.h                                                            */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Read pairs from two fastq files or one interleaved fastq file.     */
+/*--------------------------------------------------------------------*/
+/* "-" reads stdin. A pipe can't be read twice, so with such an input */
+/* the pipeline spills the pairs hitting a gene to a temporary file   */
+/* (fq_spill) and rescans that one instead. Mates must have the same  */
+/* name up to '/' or whitespace, names are compared in the buffers of */
+/* kseq and reads are only copied while the files are out of step.    */
+/*--------------------------------------------------------------------*/
+
+#ifndef _FASTQ_H
+#define _FASTQ_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include "kstring.h"
+#include "utils.h"
+
+#define FQ_MIN_OVERLAP      5    /* min adapter bases matched at the 3' end of a read */
+#define FQ_POLY_MIN         10   /* min length of a homopolymer tail trimmed */
+
+/* cleaning of every read before it is paired, all off if zero */
+typedef struct {
+	char *adapter;          /* 3' adapter, trimmed with 1 mismatch per 10 bases */
+	int min_qual;           /* 3' bases are trimmed as bwa -q does, phred+33 */
+	double min_entropy;     /* reads of lower trinucleotide entropy (0-1) are masked */
+} fq_trim_t;
+
+typedef struct {
+	kstring_t name, seq;
+} fq_rec_t;
+
+typedef struct {
+	gzFile fp1, fp2;        /* fp2 is NULL if the pairs are interleaved */
+	kseq_t *seq1, *seq2;
+	kstring_t name, read1;  /* R1 of an interleaved pair */
+	char *r_name, *r1, *r2; /* the current pair, valid until the next fq_read */
+	char *r_name2;          /* name of R2, or of the read without a mate after -2 */
+	int l1, l2;
+	int resync;             /* reads looked ahead for a mate, 0 fails on the first unpaired read */
+	fq_trim_t trim;
+	int l_adapter;
+	fq_rec_t *ahead[2];     /* rings of resync + 1 reads of R1 and R2 read ahead */
+	int head[2], n_ahead[2];
+	uint64_t n_pairs;       /* pairs read */
+	uint64_t n_unpaired;    /* reads dropped without a mate */
+	uint64_t n_trimmed;     /* bases trimmed */
+	uint64_t n_masked;      /* reads masked, they are kept with no bases */
+} fq_pair_t;
+
+#define FQ_NAME_END(c)      ((c) == '\0' || (c) == '/' || isspace((unsigned char)(c)))
+#define FQ_AHEAD(fq, s, i)  (&(fq)->ahead[s][((fq)->head[s] + (i)) % ((fq)->resync + 1)])
+
+/* 1 if read names a and b are the same up to '/' or whitespace */
+static inline int fq_name_eq(const char *a, const char *b){
+	for(; !FQ_NAME_END(*a) && *a == *b; a++, b++);
+	return FQ_NAME_END(*a) && FQ_NAME_END(*b);
+}
+
+static inline gzFile fq_gzopen(const char *fname){
+	return (strcmp(fname, "-") == 0) ? gzdopen(fileno(stdin), "r") : gzopen(fname, "r");
+}
+
+/* 1 if fname can't be read twice: stdin, a pipe or anything but a regular file */
+static inline int fq_is_stream(const char *fname){
+	struct stat sb;
+	if(fname == NULL) return 0;
+	if(strcmp(fname, "-") == 0 || stat(fname, &sb) != 0) return 1;
+	return !S_ISREG(sb.st_mode);
+}
+
+/*
+ * pairs of fq1 and fq2, consecutive records of fq1 if fq2 is NULL. 
+ * with resync > 0 reads without a mate within resync reads are
+ * dropped, otherwise fq_read fails on the first one. every read is 
+ * cleaned by trim unless it is NULL.
+ */
+static inline fq_pair_t *fq_open(const char *fq1, const char *fq2, int resync, const fq_trim_t *trim){
+	if(fq1 == NULL) return NULL;
+	fq_pair_t *fq = mycalloc(1, fq_pair_t);
+	if((fq->fp1 = fq_gzopen(fq1)) == NULL) goto FAIL;
+	if(fq2 != NULL && (fq->fp2 = fq_gzopen(fq2)) == NULL) goto FAIL;
+	fq->seq1 = kseq_init(fq->fp1);
+	if(fq->fp2) fq->seq2 = kseq_init(fq->fp2);
+	fq->resync = (resync > 0) ? resync : 0;
+	if(trim != NULL) fq->trim = *trim;
+	fq->l_adapter = (fq->trim.adapter) ? strlen(fq->trim.adapter) : 0;
+	if(fq->seq2 && fq->resync){
+		fq->ahead[0] = mycalloc(fq->resync + 1, fq_rec_t);
+		fq->ahead[1] = mycalloc(fq->resync + 1, fq_rec_t);
+	}
+	return fq;
+	FAIL:
+		if(fq->fp1) gzclose(fq->fp1);
+		free(fq);
+		return NULL;
+}
+
+static inline int fq_nt4(int c){
+	switch(c){
+		case 'A': case 'a': return 0;
+		case 'C': case 'c': return 1;
+		case 'G': case 'g': return 2;
+		case 'T': case 't': return 3;
+		default: return 4;
+	}
+}
+
+/* trinucleotide entropy of s scaled to [0, 1], 1 for less than two trinucleotides */
+static inline double fq_entropy(const char *s, int l){
+	int cnt[64], i, c, n = 0, w = 0, k = 0;
+	double h = 0, p;
+	memset(cnt, 0, sizeof(cnt));
+	for(i=0; i<l; i++){
+		if((c = fq_nt4(s[i])) > 3){k = 0; continue;}
+		w = ((w << 2) | c) & 63;
+		if(++k >= 3){cnt[w]++; n++;}
+	}
+	if(n < 2) return 1.0;
+	for(i=0; i<64; i++) if(cnt[i]){p = (double)cnt[i] / n; h -= p * log2(p);}
+	return h / log2((n < 64) ? n : 64);
+}
+
+/* 
+ * quality tail, adapter and homopolymer tail trimming of the read in ks
+ * then masking if its entropy is low, all in place.
+ */
+static inline void fq_clean(fq_pair_t *fq, kseq_t *ks){
+	char *s = ks->seq.s, *a = fq->trim.adapter;
+	int l = ks->seq.l, i, j, n, mm, sum, max, max_l;
+	if(fq->trim.min_qual > 0 && ks->qual.l == ks->seq.l){
+		for(i=l-1, sum=max=0, max_l=l; i>=1; i--){
+			sum += fq->trim.min_qual - (ks->qual.s[i] - 33);
+			if(sum < 0) break;
+			if(sum > max){max = sum; max_l = i;}
+		}
+		l = max_l;
+	}
+	if(fq->l_adapter > 0){
+		for(i=0; i+FQ_MIN_OVERLAP<=l; i++){
+			n = (l - i < fq->l_adapter) ? l - i : fq->l_adapter;
+			for(j=mm=0; j<n && mm<=n/10; j++) mm += (s[i+j] != a[j]);
+			if(mm <= n/10){l = i; break;}
+		}
+	}
+	if(fq->trim.min_entropy > 0){
+		for(i=l-1; i>0 && s[i-1] == s[l-1]; i--);
+		if(l > 0 && l - i >= FQ_POLY_MIN) l = i;
+		if(fq_entropy(s, l) < fq->trim.min_entropy){l = 0; fq->n_masked++;}
+	}
+	fq->n_trimmed += ks->seq.l - l;
+	s[l] = '\0';
+	ks->seq.l = l;
+}
+
+/* kseq_read followed by fq_clean */
+static inline int fq_kread(fq_pair_t *fq, kseq_t *ks){
+	int l;
+	if((l = kseq_read(ks)) >= 0 && (fq->trim.adapter || fq->trim.min_qual > 0 || fq->trim.min_entropy > 0)) fq_clean(fq, ks);
+	return l;
+}
+
+/* append a read of side s to its ring, the one in its kseq unless next, 0 on success */
+static inline int fq_push(fq_pair_t *fq, int s, int next){
+	kseq_t *ks = (s == 0) ? fq->seq1 : fq->seq2;
+	fq_rec_t *r;
+	if(fq->n_ahead[s] > fq->resync || (next && fq_kread(fq, ks) < 0)) return -1;
+	r = FQ_AHEAD(fq, s, fq->n_ahead[s]++);
+	r->name.l = r->seq.l = 0;
+	kputsn(ks->name.s, ks->name.l, &r->name);
+	kputsn(ks->seq.s, ks->seq.l, &r->seq);
+	return 0;
+}
+
+/* drop the first n reads of the ring of side s, return the next one */
+static inline fq_rec_t *fq_pop(fq_pair_t *fq, int s, int n){
+	fq_rec_t *r;
+	fq->n_unpaired += n;
+	fq->head[s] = (fq->head[s] + n) % (fq->resync + 1);
+	fq->n_ahead[s] -= n;
+	r = FQ_AHEAD(fq, s, 0);
+	fq->head[s] = (fq->head[s] + 1) % (fq->resync + 1);
+	fq->n_ahead[s]--;
+	return r;
+}
+
+/*
+ * the first reads of the rings aren't mates, read ahead on both sides
+ * until a read of one matches a read of the other and drop the reads 
+ * before them. -1 if one side ended and the rest of the other is
+ * dropped, -2 if no mate is found within fq->resync reads.
+ */
+static inline int fq_resync(fq_pair_t *fq){
+	int i, j, more, full;
+	fq_rec_t *a, *b;
+	for(i=0; i<fq->n_ahead[0]; i++)
+		for(j=0; j<fq->n_ahead[1]; j++)
+			if(fq_name_eq(FQ_AHEAD(fq, 0, i)->name.s, FQ_AHEAD(fq, 1, j)->name.s)) goto FOUND;
+	do{
+		more = 0;
+		if(fq_push(fq, 0, 1) == 0){
+			more = 1; i = fq->n_ahead[0] - 1;
+			for(j=0; j<fq->n_ahead[1]; j++) if(fq_name_eq(FQ_AHEAD(fq, 0, i)->name.s, FQ_AHEAD(fq, 1, j)->name.s)) goto FOUND;
+		}
+		if(fq_push(fq, 1, 1) == 0){
+			more = 1; j = fq->n_ahead[1] - 1;
+			for(i=0; i<fq->n_ahead[0]; i++) if(fq_name_eq(FQ_AHEAD(fq, 0, i)->name.s, FQ_AHEAD(fq, 1, j)->name.s)) goto FOUND;
+		}
+	}while(more);
+	full = (fq->n_ahead[0] > fq->resync || fq->n_ahead[1] > fq->resync);
+	fq->r_name  = (fq->n_ahead[0]) ? FQ_AHEAD(fq, 0, 0)->name.s : "(end of R1)";
+	fq->r_name2 = (fq->n_ahead[1]) ? FQ_AHEAD(fq, 1, 0)->name.s : "(end of R2)";
+	if(full && fq->n_ahead[0] && fq->n_ahead[1]) return -2;
+	/* one side ended, whatever is left of the other has no mate */
+	fq->n_unpaired += fq->n_ahead[0] + fq->n_ahead[1];
+	fq->n_ahead[0] = fq->n_ahead[1] = 0;
+	while(kseq_read(fq->seq1) >= 0) fq->n_unpaired++;
+	while(kseq_read(fq->seq2) >= 0) fq->n_unpaired++;
+	return -1;
+	FOUND:
+		a = fq_pop(fq, 0, i);
+		b = fq_pop(fq, 1, j);
+		fq->r_name = a->name.s; fq->r_name2 = b->name.s;
+		fq->r1 = a->seq.s; fq->l1 = a->seq.l;
+		fq->r2 = b->seq.s; fq->l2 = b->seq.l;
+		fq->n_pairs++;
+		return 0;
+}
+
+/* pairs of two files, reads are copied to the rings only once they are out of step */
+static inline int fq_read2(fq_pair_t *fq){
+	int l1, l2;
+	if(fq->n_ahead[0] == 0 && fq->n_ahead[1] == 0){
+		l1 = fq_kread(fq, fq->seq1);
+		l2 = fq_kread(fq, fq->seq2);
+		if(l1 < 0 && l2 < 0) return -1;
+		fq->r_name  = (l1 >= 0) ? fq->seq1->name.s : "(end of R1)";
+		fq->r_name2 = (l2 >= 0) ? fq->seq2->name.s : "(end of R2)";
+		if(l1 >= 0 && l2 >= 0 && fq_name_eq(fq->r_name, fq->r_name2)){
+			fq->r1 = fq->seq1->seq.s; fq->l1 = fq->seq1->seq.l;
+			fq->r2 = fq->seq2->seq.s; fq->l2 = fq->seq2->seq.l;
+			fq->n_pairs++;
+			return 0;
+		}
+		if(fq->resync == 0) return -2;
+		if(l1 >= 0) fq_push(fq, 0, 0);
+		if(l2 >= 0) fq_push(fq, 1, 0);
+	}else{
+		if(fq->n_ahead[0] == 0) fq_push(fq, 0, 1);
+		if(fq->n_ahead[1] == 0) fq_push(fq, 1, 1);
+	}
+	return fq_resync(fq);
+}
+
+/* pairs of one interleaved file, a read is dropped if the next one isn't its mate */
+static inline int fq_read1(fq_pair_t *fq){
+	int dropped = 0;
+	if(fq_kread(fq, fq->seq1) < 0) return -1;
+	for(;;){
+		fq->name.l = fq->read1.l = 0;
+		kputsn(fq->seq1->name.s, fq->seq1->name.l, &fq->name);
+		kputsn(fq->seq1->seq.s, fq->seq1->seq.l, &fq->read1);
+		fq->r_name = fq->name.s;
+		if(fq_kread(fq, fq->seq1) < 0){
+			fq->r_name2 = "(end of file)";
+			if(fq->resync == 0) return -2;
+			fq->n_unpaired++;
+			return -1;
+		}
+		fq->r_name2 = fq->seq1->name.s;
+		if(fq_name_eq(fq->r_name, fq->r_name2)) break;
+		if(dropped++ >= fq->resync) return -2;
+		fq->n_unpaired++;
+	}
+	fq->r1 = fq->read1.s; fq->l1 = fq->read1.l;
+	fq->r2 = fq->seq1->seq.s; fq->l2 = fq->seq1->seq.l;
+	fq->n_pairs++;
+	return 0;
+}
+
+/* 
+ * read the next pair, return 0 on success, -1 at the end of the input
+ * and -2 if r_name and r_name2 are out of step and can't be resynced.
+ */
+static inline int fq_read(fq_pair_t *fq){
+	return (fq->seq2 != NULL) ? fq_read2(fq) : fq_read1(fq);
+}
+
+/* 128-bit hash of the bases of the current pair, FNV-1a and a multiply-xorshift */
+static inline void fq_hash(const fq_pair_t *fq, uint64_t key[2]){
+	uint64_t h0 = 0xCBF29CE484222325ULL, h1 = 0x9E3779B97F4A7C15ULL;
+	const unsigned char *c;
+	int i;
+	for(i=0; i<2; i++){
+		for(c=(const unsigned char*)((i) ? fq->r2 : fq->r1); *c; c++){
+			h0 = (h0 ^ *c) * 0x100000001B3ULL;
+			h1 = (h1 ^ *c) * 0xBF58476D1CE4E5B9ULL; h1 ^= h1 >> 31;
+		}
+		h0 = (h0 ^ '_') * 0x100000001B3ULL;
+		h1 = (h1 ^ '_') * 0xBF58476D1CE4E5B9ULL; h1 ^= h1 >> 31;
+	}
+	key[0] = h0; key[1] = h1;
+}
+
+/* uncompressed bytes read so far */
+static inline uint64_t fq_tell(const fq_pair_t *fq){
+	return gztell(fq->fp1) + ((fq->fp2) ? gztell(fq->fp2) : 0);
+}
+
+static inline void fq_close(fq_pair_t *fq){
+	if(fq == NULL) return;
+	int i, s;
+	kseq_destroy(fq->seq1);
+	if(fq->seq2) kseq_destroy(fq->seq2);
+	gzclose(fq->fp1);
+	if(fq->fp2) gzclose(fq->fp2);
+	for(s=0; s<2; s++){
+		if(fq->ahead[s] == NULL) continue;
+		for(i=0; i<=fq->resync; i++){free(fq->ahead[s][i].name.s); free(fq->ahead[s][i].seq.s);}
+		free(fq->ahead[s]);
+	}
+	free(fq->name.s);
+	free(fq->read1.s);
+	free(fq);
+}
+
+/* a new temporary file in $TMPDIR (/tmp if unset) for fq_spill, its path goes to *fname */
+static inline FILE *fq_spill_open(char **fname){
+	const char *dir = getenv("TMPDIR");
+	int fd;
+	FILE *fp;
+	*fname = mycalloc(strlen((dir && *dir) ? dir : "/tmp") + 32, char);
+	sprintf(*fname, "%s/tafuco.spill.XXXXXX", (dir && *dir) ? dir : "/tmp");
+	if((fd = mkstemp(*fname)) < 0 || (fp = fdopen(fd, "w")) == NULL){
+		if(fd >= 0){close(fd); unlink(*fname);}
+		free(*fname); *fname = NULL;
+		return NULL;
+	}
+	return fp;
+}
+
+/* append the current pair to fp as interleaved fasta, fq_open(spill, NULL, 0, NULL) reads it back */
+static inline int fq_spill(FILE *fp, const fq_pair_t *fq){
+	return (fprintf(fp, ">%s\n%s\n>%s\n%s\n", fq->r_name, fq->r1, fq->r_name, fq->r2) < 0) ? -1 : 0;
+}
+
+#endif
@@ -0,0 +1,239 @@
+/*--------------------------------------------------------------------*/
+/* gtf.h                                                              */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* In-place GTF tokenizer and gene indexed GTF reader.                */
+/*--------------------------------------------------------------------*/
+/* gtf_parse splits the first 8 columns of a line in place and never  */
+/* allocates, attributes are only looked up on demand by gtf_attr,    */
+/* so rows of other features or genes cost one pass over 8 columns.   */
+/*                                                                    */
+/* gtf_index_build writes genes.gtf.gidx, one line per run of         */
+/* consecutive rows of a gene: gene_name, begin and end file offset.  */
+/* When a fresh .gidx exists, gtf_reader only reads the runs of the   */
+/* candidate genes, in file order, so rows come out exactly as in a   */
+/* full scan of genes.gtf.                                            */
+/*--------------------------------------------------------------------*/
+
+#ifndef _GTF_H
+#define _GTF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include "utils.h"
+
+#define GTF_MIN_FIELDS      15   /* rows with fewer whitespace separated fields are skipped */
+#define GTF_MAX_NAME        1024 /* longest attribute value kept */
+
+/* one GTF row, every pointer points into the line */
+typedef struct {
+	char *chrom;
+	char *feature;
+	char *start_s;          /* text of column 4 */
+	char *end_s;            /* text of column 5 */
+	char *strand;
+	char *attr;             /* columns 9 onwards */
+	int start;
+	int end;
+	char *col[8];
+	char sep[8];            /* separators overwritten by gtf_parse */
+} gtf_rec_t;
+
+/* reader over the rows of a GTF */
+typedef struct {
+	FILE *fp;
+	int64_t *runs;          /* [begin, end) file offsets to read, NULL reads the whole file */
+	int n_runs;
+	int i;                  /* current run */
+	int64_t pos;            /* file offset of the next line */
+	char *line;
+	size_t m_line;
+} gtf_reader_t;
+
+/* undo gtf_parse on the first n columns */
+static inline void
+gtf_restore(gtf_rec_t *r, int n){
+	int i;
+	for(i=0; i<n && i<8; i++) if(r->sep[i]) r->col[i][strlen(r->col[i])] = r->sep[i];
+}
+
+/*
+ * split the first 8 columns of line in place, return 0 if line has at
+ * least GTF_MIN_FIELDS whitespace separated fields.
+ */
+static inline int
+gtf_parse(char *line, gtf_rec_t *r){
+	char **col = r->col, *p = line;
+	int n = 0;
+	memset(r->sep, 0, sizeof(r->sep));
+	while(n < 8){
+		while(isspace((unsigned char)*p)) p++;
+		if(*p == '\0'){gtf_restore(r, n); return -1;}
+		col[n++] = p;
+		while(*p && !isspace((unsigned char)*p)) p++;
+		if(*p == '\0') break;
+		r->sep[n-1] = *p;
+		*p++ = '\0';
+	}
+	if(n < 8){gtf_restore(r, n); return -1;}
+	r->attr = p;
+	/* fields of the attribute column */
+	while(n < GTF_MIN_FIELDS){
+		while(isspace((unsigned char)*p)) p++;
+		if(*p == '\0'){gtf_restore(r, 8); return -1;}
+		n++;
+		while(*p && !isspace((unsigned char)*p)) p++;
+	}
+	r->chrom   = col[0];
+	r->feature = col[2];
+	r->start_s = col[3];
+	r->end_s   = col[4];
+	r->strand  = col[6];
+	r->start   = atoi(col[3]);
+	r->end     = atoi(col[4]);
+	return 0;
+}
+
+/*
+ * copy the value of attribute key (key "value";) without quotes to buf,
+ * upper cased if upper is set. return the length of the value, or -1
+ * if the attribute is absent or empty.
+ */
+static inline int
+gtf_attr(const char *attr, const char *key, char *buf, int size, int upper){
+	const char *p = attr, *tok, *v, *e;
+	int l_key = strlen(key), l;
+	while(*p){
+		while(isspace((unsigned char)*p)) p++;
+		tok = p;
+		while(*p && !isspace((unsigned char)*p)) p++;
+		if(p - tok != l_key || strncmp(tok, key, l_key) != 0) continue;
+		/* the value is the next field */
+		while(isspace((unsigned char)*p)) p++;
+		tok = p;
+		while(*p && !isspace((unsigned char)*p)) p++;
+		if(p - tok <= 3) return -1;
+		for(v=tok; v<p && *v=='"'; v++);
+		for(l=0; v+l<p && v[l]!='"'; l++);
+		for(e=v+l; e<p && *e=='"'; e++);
+		if(l == 0 || e == p || l >= size) return -1; /* the closing quote must be followed by ; */
+		for(l=0; v[l]!='"'; l++) buf[l] = (upper) ? toupper((unsigned char)v[l]) : v[l];
+		buf[l] = '\0';
+		return l;
+	}
+	return -1;
+}
+
+/* 1 if idx exists and is not older than fname */
+static inline int
+gtf_index_fresh(const char *fname, const char *idx){
+	struct stat st_gtf, st_idx;
+	if(stat(fname, &st_gtf) != 0 || stat(idx, &st_idx) != 0) return 0;
+	return st_idx.st_mtime >= st_gtf.st_mtime;
+}
+
+/* write fname.gidx, return the number of runs, -1 on failure */
+static inline int
+gtf_index_build(const char *fname){
+	FILE *fp, *fo;
+	char *line = NULL, *idx;
+	char gname[GTF_MAX_NAME], prev[GTF_MAX_NAME];
+	size_t m_line = 0;
+	ssize_t n;
+	int64_t pos = 0, beg = 0;
+	int ret = 0;
+	gtf_rec_t r;
+	if((fp = fopen(fname, "r")) == NULL) return -1;
+	idx = join(2, (char*)fname, ".gidx");
+	if((fo = fopen(idx, "w")) == NULL){fclose(fp); free(idx); return -1;}
+	prev[0] = '\0';
+	while((n = getline(&line, &m_line, fp)) != -1){
+		if(gtf_parse(line, &r) != 0 || gtf_attr(r.attr, "gene_name", gname, GTF_MAX_NAME, 1) < 0) gname[0] = '\0';
+		if(strcmp(gname, prev) != 0){
+			if(prev[0]){fprintf(fo, "%s\t%lld\t%lld\n", prev, (long long)beg, (long long)pos); ret++;}
+			strcpy(prev, gname);
+			beg = pos;
+		}
+		pos += n;
+	}
+	if(prev[0]){fprintf(fo, "%s\t%lld\t%lld\n", prev, (long long)beg, (long long)pos); ret++;}
+	if(line) free(line);
+	fclose(fo);
+	fclose(fp);
+	free(idx);
+	return ret;
+}
+
+static inline int
+gtf_run_cmp(const void *a, const void *b){
+	int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * open a GTF, if genes is not NULL and fname.gidx is fresh only rows of
+ * genes (upper cased gene names) are read.
+ */
+static inline gtf_reader_t *
+gtf_reader_open(const char *fname, str_ctr *genes){
+	gtf_reader_t *r;
+	FILE *fi;
+	char *idx, *line = NULL, gname[GTF_MAX_NAME];
+	size_t m_line = 0;
+	long long beg, end;
+	int i;
+	r = mycalloc(1, gtf_reader_t);
+	if((r->fp = fopen(fname, "r")) == NULL){free(r); return NULL;}
+	idx = join(2, (char*)fname, ".gidx");
+	if(genes != NULL && gtf_index_fresh(fname, idx) && (fi = fopen(idx, "r")) != NULL){
+		r->runs = mycalloc(2, int64_t);
+		while(getline(&line, &m_line, fi) != -1){
+			if(sscanf(line, "%1023s%lld%lld", gname, &beg, &end) != 3) continue;
+			for(i=0; gname[i]; i++) gname[i] = toupper((unsigned char)gname[i]);
+			if(find_str_ctr(genes, gname) == NULL) continue;
+			r->runs = realloc(r->runs, 2 * (r->n_runs + 1) * sizeof(int64_t));
+			r->runs[2*r->n_runs] = beg;
+			r->runs[2*r->n_runs+1] = end;
+			r->n_runs++;
+		}
+		if(line) free(line);
+		fclose(fi);
+		/* runs never overlap, sorting by begin keeps the file order */
+		qsort(r->runs, r->n_runs, 2 * sizeof(int64_t), gtf_run_cmp);
+		r->pos = -1;
+	}
+	free(idx);
+	return r;
+}
+
+/* next line, NULL at the end */
+static inline char *
+gtf_reader_next(gtf_reader_t *r){
+	ssize_t n;
+	if(r->runs == NULL) return (getline(&r->line, &r->m_line, r->fp) != -1) ? r->line : NULL;
+	while(r->i < r->n_runs){
+		if(r->pos < r->runs[2*r->i]){
+			r->pos = r->runs[2*r->i];
+			if(fseeko(r->fp, r->pos, SEEK_SET) != 0) return NULL;
+		}
+		if(r->pos >= r->runs[2*r->i+1] || (n = getline(&r->line, &r->m_line, r->fp)) == -1){r->i++; continue;}
+		r->pos += n;
+		return r->line;
+	}
+	return NULL;
+}
+
+static inline void
+gtf_reader_close(gtf_reader_t *r){
+	if(r == NULL) return;
+	if(r->fp)   fclose(r->fp);
+	if(r->runs) free(r->runs);
+	if(r->line) free(r->line);
+	free(r);
+}
+
+#endif
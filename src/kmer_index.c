@@ -0,0 +1,367 @@
+/*--------------------------------------------------------------------*/
+/* kmer_index.c                                                       */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Parallel construction of the canonical kmer index.                 */
+/*--------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include "kmer_index.h"
+
+#define KIDX_RADIX_BITS     8
+#define KIDX_RADIX_SIZE     (1 << KIDX_RADIX_BITS)
+
+/* shared state of the tuple emitting threads */
+typedef struct {
+	fasta_t **seqs;         /* sequence id -> fasta_t */
+	int n;
+	int k;
+	int n_threads;
+	int tid;
+	size_t *offset;         /* first tuple of every sequence */
+	size_t *count;          /* number of tuples written by every sequence */
+	uint64_t *key;
+	uint32_t *val;          /* NULL if postings are packed into key */
+	int pbits;              /* number of bits of a packed posting */
+} kidx_emit_t;
+
+/* one chunk of a parallel LSD radix sort pass */
+typedef struct {
+	uint64_t *key_src, *key_dst;
+	uint32_t *val_src, *val_dst;
+	size_t beg, end;
+	int shift;
+	size_t cnt[KIDX_RADIX_SIZE];
+} kidx_radix_t;
+
+static void *kidx_emit_worker(void *data){
+	kidx_emit_t *w = (kidx_emit_t*)data;
+	kmer_itr_t itr;
+	uint64_t kmer;
+	int id, pos, strand;
+	size_t i;
+	for(id=w->tid; id<w->n; id+=w->n_threads){
+		if(w->count[id] == 0) continue; /* shorter than k */
+		i = w->offset[id];
+		kmer_itr_init(&itr, w->seqs[id]->seq, w->k);
+		while(kmer_itr_next(&itr, &pos, &kmer, &strand)){
+			if(w->val == NULL){
+				w->key[i++] = (kmer << w->pbits) | KM_POST(id, strand);
+			}else{
+				w->key[i] = kmer;
+				w->val[i++] = KM_POST(id, strand);
+			}
+		}
+		w->count[id] = i - w->offset[id];
+	}
+	return NULL;
+}
+
+static void *kidx_radix_count(void *data){
+	kidx_radix_t *r = (kidx_radix_t*)data;
+	register size_t i;
+	memset(r->cnt, 0, sizeof(r->cnt));
+	for(i=r->beg; i<r->end; i++) r->cnt[(r->key_src[i] >> r->shift) & (KIDX_RADIX_SIZE-1)]++;
+	return NULL;
+}
+
+static void *kidx_radix_scatter(void *data){
+	kidx_radix_t *r = (kidx_radix_t*)data;
+	register size_t i, j;
+	for(i=r->beg; i<r->end; i++){
+		j = r->cnt[(r->key_src[i] >> r->shift) & (KIDX_RADIX_SIZE-1)]++;
+		r->key_dst[j] = r->key_src[i];
+		if(r->val_src) r->val_dst[j] = r->val_src[i];
+	}
+	return NULL;
+}
+
+static void kidx_run(void *(*func)(void*), void *data, size_t size, int n_threads){
+	pthread_t *tid;
+	int t;
+	if(n_threads == 1){
+		func(data);
+		return;
+	}
+	tid = mycalloc(n_threads, pthread_t);
+	for(t=0; t<n_threads; t++)
+		if(pthread_create(&tid[t], NULL, func, (char*)data + t*size) != 0) die("[%s] fail to create thread", __func__);
+	for(t=0; t<n_threads; t++) pthread_join(tid[t], NULL);
+	free(tid);
+}
+
+/*
+ * stable LSD radix sort of key[0..n) (and val if not NULL) on bits
+ * [lo, hi) of key, tmp buffers must be as large as key and val.
+ * return 1 if the sorted data ends up in the tmp buffers.
+ */
+static int
+kidx_radix_sort(uint64_t *key, uint32_t *val, uint64_t *key_tmp, uint32_t *val_tmp, size_t n, int lo, int hi, int n_threads){
+	kidx_radix_t *r = mycalloc(n_threads, kidx_radix_t);
+	uint64_t *ks = key, *kd = key_tmp, *kx;
+	uint32_t *vs = val, *vd = val_tmp, *vx;
+	size_t sum, c;
+	int shift, b, t, swapped = 0;
+	for(shift=lo; shift<hi; shift+=KIDX_RADIX_BITS){
+		for(t=0; t<n_threads; t++){
+			r[t].key_src = ks; r[t].key_dst = kd;
+			r[t].val_src = vs; r[t].val_dst = vd;
+			r[t].beg = n * t / n_threads;
+			r[t].end = n * (t+1) / n_threads;
+			r[t].shift = shift;
+		}
+		kidx_run(kidx_radix_count, r, sizeof(kidx_radix_t), n_threads);
+		/* bucket b of thread t starts after all smaller buckets and bucket b of threads before t */
+		for(sum=0, b=0; b<KIDX_RADIX_SIZE; b++){
+			for(t=0; t<n_threads; t++){
+				c = r[t].cnt[b];
+				r[t].cnt[b] = sum;
+				sum += c;
+			}
+		}
+		kidx_run(kidx_radix_scatter, r, sizeof(kidx_radix_t), n_threads);
+		kx = ks; ks = kd; kd = kx;
+		vx = vs; vs = vd; vd = vx;
+		swapped ^= 1;
+	}
+	free(r);
+	return swapped;
+}
+
+/* bits needed to store postings of n sequences */
+static int kidx_post_bits(int n){
+	int bits = 1;
+	while(((uint64_t)1 << bits) < (uint64_t)n * 2) bits++;
+	return bits;
+}
+
+static size_t kidx_tuple_num(fasta_t *tb, int k, int *n){
+	fasta_t *fa_cur;
+	size_t l, ret = 0;
+	*n = 0;
+	for(fa_cur=tb; fa_cur!=NULL; fa_cur=fa_cur->hh.next){
+		(*n)++;
+		if(fa_cur->seq == NULL || (l = strlen(fa_cur->seq)) < k) continue;
+		ret += l - k + 1;
+	}
+	return ret;
+}
+
+/*
+ * allocate the sorted backend for idx->size kmers, about 4 kmers
+ * share a bucket so that the bucket table takes ~1 byte per kmer.
+ */
+static void kidx_sorted_init(kidx_t *idx, size_t n_over){
+	int bits = 0;
+	while(((size_t)1 << (bits+1)) <= idx->size) bits++;
+	idx->pbits = (bits > 2) ? bits - 2 : 0;
+	if(idx->pbits > 2*idx->k) idx->pbits = 2*idx->k;
+	if(idx->pbits > 30) idx->pbits = 30;
+	idx->sbits = 2*idx->k - idx->pbits;
+	idx->swidth = (idx->sbits <= 8) ? 1 : (idx->sbits <= 16) ? 2 : (idx->sbits <= 32) ? 4 : 8;
+	idx->bucket = mycalloc(((size_t)1 << idx->pbits) + 1, uint32_t);
+	idx->suffix = _mycalloc(idx->size, idx->swidth);
+	idx->entry = mycalloc(idx->size, uint32_t);
+	idx->post = mycalloc(n_over + 1, uint32_t);
+	idx->n_over = 0;
+	idx->n_bucket = 0;
+	if(n_over >= KIDX_MULTI) die("[%s] too many postings for the sorted index", __func__);
+}
+
+/* add the j-th kmer in sorted order and its postings */
+static void kidx_add(kidx_t *idx, size_t j, uint64_t kmer, uint32_t *post, int count){
+	kmer_t *s;
+	uint64_t prefix, suffix;
+	if(idx->type == KIDX_SORTED){
+		prefix = (idx->sbits == 64) ? 0 : kmer >> idx->sbits;
+		suffix = (idx->sbits == 64) ? kmer : kmer & (((uint64_t)1 << idx->sbits) - 1);
+		while(idx->n_bucket <= prefix) idx->bucket[idx->n_bucket++] = j;
+		switch(idx->swidth){
+			case 1: ((uint8_t*)idx->suffix)[j]  = suffix; break;
+			case 2: ((uint16_t*)idx->suffix)[j] = suffix; break;
+			case 4: ((uint32_t*)idx->suffix)[j] = suffix; break;
+			default: ((uint64_t*)idx->suffix)[j] = suffix; break;
+		}
+		if(count == 1){
+			idx->entry[j] = post[0];
+		}else{
+			idx->entry[j] = KIDX_MULTI | idx->n_over;
+			idx->post[idx->n_over++] = count;
+			memcpy(&idx->post[idx->n_over], post, count * sizeof(uint32_t));
+			idx->n_over += count;
+		}
+		return;
+	}
+	s = &idx->kmers[j];
+	s->kmer = kmer;
+	s->count = count;
+	s->post = (j == 0) ? idx->post : idx->kmers[j-1].post + idx->kmers[j-1].count;
+	memcpy(s->post, post, count * sizeof(uint32_t));
+	HASH_ADD(hh, idx->hash, kmer, sizeof(uint64_t), s);
+}
+
+static void kidx_sorted_close(kidx_t *idx){
+	while(idx->n_bucket <= ((size_t)1 << idx->pbits)) idx->bucket[idx->n_bucket++] = idx->size;
+}
+
+size_t kidx_mem(const kidx_t *idx){
+	if(idx == NULL) return 0;
+	if(idx->type == KIDX_SORTED)
+		return ((((size_t)1 << idx->pbits) + 1) + idx->size + idx->n_over) * sizeof(uint32_t) + idx->size * idx->swidth;
+	return idx->size * sizeof(kmer_t) + idx->n_post * sizeof(uint32_t) 
+	     + ((idx->hash) ? idx->hash->hh.tbl->num_buckets * sizeof(UT_hash_bucket) + sizeof(UT_hash_table) : 0);
+}
+
+size_t kidx_build_mem(fasta_t *tb, int k){
+	int n;
+	size_t num = kidx_tuple_num(tb, k, &n);
+	size_t tuple = (2*k + kidx_post_bits(n) <= 64) ? sizeof(uint64_t) : sizeof(uint64_t) + sizeof(uint32_t);
+	return 2 * num * tuple;
+}
+
+kidx_t *kidx_build(fasta_t *tb, int k, int n_threads, int type){
+	if(tb == NULL || k <= 0 || k > KM_MAX_LEN) return NULL;
+	kidx_t *idx;
+	kidx_emit_t *w;
+	fasta_t *fa_cur, **seqs;
+	uint64_t *key, *key_tmp, kmer, prev;
+	uint32_t *val, *val_tmp, *cur, post, pmask;
+	size_t num, i, j, l, size, n_post, n_over;
+	int n, id, t, pbits, last_id, mask, count;
+
+	if((num = kidx_tuple_num(tb, k, &n)) == 0) return NULL;
+	if(n_threads < 1) n_threads = 1;
+	if(n_threads > n) n_threads = n;
+	pbits = kidx_post_bits(n);
+	if(2*k + pbits > 64) pbits = 0; /* kmer and posting are kept in two arrays */
+	pmask = (pbits == 0) ? 0 : (uint32_t)(((uint64_t)1 << pbits) - 1);
+
+	idx = mycalloc(1, kidx_t);
+	idx->k = k;
+	idx->type = type;
+	idx->n = n;
+	idx->names = mycalloc(n, char*);
+	seqs = mycalloc(n, fasta_t*);
+	for(id=0, fa_cur=tb; fa_cur!=NULL; fa_cur=fa_cur->hh.next, id++){
+		seqs[id] = fa_cur;
+		idx->names[id] = fa_cur->name;
+	}
+
+	/* every sequence writes at most l-k+1 tuples to its own slice */
+	w = mycalloc(n_threads, kidx_emit_t);
+	w[0].offset = mycalloc(n, size_t);
+	w[0].count = mycalloc(n, size_t);
+	for(i=0, id=0; id<n; id++){
+		w[0].offset[id] = i;
+		if(seqs[id]->seq == NULL || (l = strlen(seqs[id]->seq)) < k) continue;
+		w[0].count[id] = l - k + 1;
+		i += l - k + 1;
+	}
+	key = mycalloc(num, uint64_t);
+	key_tmp = mycalloc(num, uint64_t);
+	val = val_tmp = NULL;
+	if(pbits == 0){
+		val = mycalloc(num, uint32_t);
+		val_tmp = mycalloc(num, uint32_t);
+	}
+	for(t=0; t<n_threads; t++){
+		w[t] = w[0];
+		w[t].seqs = seqs; w[t].n = n; w[t].k = k;
+		w[t].n_threads = n_threads; w[t].tid = t;
+		w[t].key = key; w[t].val = val; w[t].pbits = pbits;
+	}
+	kidx_run(kidx_emit_worker, w, sizeof(kidx_emit_t), n_threads);
+
+	/* close the gaps left by kmers containing N, keeps the sequence order */
+	for(i=0, id=0; id<n; id++){
+		if(w[0].offset[id] != i){
+			memmove(&key[i], &key[w[0].offset[id]], w[0].count[id] * sizeof(uint64_t));
+			if(val) memmove(&val[i], &val[w[0].offset[id]], w[0].count[id] * sizeof(uint32_t));
+		}
+		i += w[0].count[id];
+	}
+	num = i;
+
+	/* sort by kmer only, tuples of one kmer stay ordered by sequence id */
+	if(kidx_radix_sort(key, val, key_tmp, val_tmp, num, pbits, pbits + 2*k, n_threads)){
+		free(key); key = key_tmp;
+		if(val){free(val); val = val_tmp;}
+	}else{
+		free(key_tmp);
+		if(val_tmp) free(val_tmp);
+	}
+
+	/* count distinct kmers and unique postings */
+	size = n_post = n_over = 0;
+	prev = 0;
+	count = 0;
+	last_id = -1;
+	mask = 0;
+	for(i=0; i<num; i++){
+		kmer = (val) ? key[i] : key[i] >> pbits;
+		post = (val) ? val[i] : (uint32_t)(key[i] & pmask);
+		if(i == 0 || kmer != prev){
+			if(count > 1) n_over += count + 1;
+			size++; count = 0; last_id = -1; prev = kmer;
+		}
+		if(KM_POST_ID(post) != last_id){last_id = KM_POST_ID(post); mask = 0;}
+		if(mask & (1 << KM_POST_STRAND(post))) continue;
+		mask |= 1 << KM_POST_STRAND(post);
+		n_post++;
+		count++;
+	}
+	if(count > 1) n_over += count + 1;
+
+	/* fill the table */
+	idx->size = size;
+	idx->n_post = n_post;
+	if(type == KIDX_SORTED){
+		kidx_sorted_init(idx, n_over);
+	}else{
+		idx->kmers = mycalloc(size, kmer_t);
+		idx->post = mycalloc(n_post, uint32_t);
+	}
+	cur = mycalloc(2*n, uint32_t);
+	count = 0;
+	for(i=0, j=0; i<num; i++){
+		kmer = (val) ? key[i] : key[i] >> pbits;
+		post = (val) ? val[i] : (uint32_t)(key[i] & pmask);
+		if(i > 0 && kmer != prev){
+			kidx_add(idx, j++, prev, cur, count);
+			count = 0;
+		}
+		if(count == 0 || kmer != prev){prev = kmer; last_id = -1;}
+		if(KM_POST_ID(post) != last_id){last_id = KM_POST_ID(post); mask = 0;}
+		if(mask & (1 << KM_POST_STRAND(post))) continue;
+		mask |= 1 << KM_POST_STRAND(post);
+		cur[count++] = post;
+		/* keep both strands of one sequence in order */
+		if(count > 1 && cur[count-1] < cur[count-2]){
+			cur[count-1] = cur[count-2];
+			cur[count-2] = post;
+		}
+	}
+	kidx_add(idx, j++, prev, cur, count);
+	if(type == KIDX_SORTED) kidx_sorted_close(idx);
+	free(cur);
+
+	free(key);
+	if(val) free(val);
+	free(w[0].offset);
+	free(w[0].count);
+	free(w);
+	free(seqs);
+	return idx;
+}
+
+void kidx_destroy(kidx_t *idx){
+	if(idx == NULL) return;
+	if(idx->hash)    kmer_destroy(&idx->hash);
+	if(idx->kmers)   free(idx->kmers);
+	if(idx->post)    free(idx->post);
+	if(idx->bucket)  free(idx->bucket);
+	if(idx->suffix)  free(idx->suffix);
+	if(idx->entry)   free(idx->entry);
+	if(idx->names)   free(idx->names);
+	free(idx);
+}
@@ -0,0 +1,142 @@
+/*--------------------------------------------------------------------*/
+/* kmer_index.h                                                       */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Canonical kmer index of exon sequences.                            */
+/*--------------------------------------------------------------------*/
+/* kidx_build emits one (kmer, exon id, strand) tuple per kmer        */
+/* position, exons are processed in parallel and every exon writes    */
+/* to its own slice of a preallocated buffer. The tuples are radix    */
+/* sorted by kmer and the final table is filled in one linear pass    */
+/* that also removes duplicate postings. Peak memory during the build */
+/* is twice the tuple buffer, see kidx_build_mem.                     */
+/*                                                                    */
+/* Two backends share the lookup API kidx_get/kidx_uniq_hit:          */
+/* KIDX_HASH   - uthash of kmer_t, ~98 bytes per distinct kmer.       */
+/* KIDX_SORTED - kmers are split into a prefix of pbits and a suffix. */
+/*               bucket[prefix] points to the sorted suffixes of that */
+/*               prefix, with ~4 kmers per bucket this costs ~1 byte  */
+/*               per kmer, a 16 bit suffix and a 32 bit posting make  */
+/*               it ~7 bytes per kmer for k<=17 on big panels.        */
+/*--------------------------------------------------------------------*/
+
+#ifndef _KMER_INDEX_H
+#define _KMER_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "kmer_uthash.h"
+#include "fasta_uthash.h"
+#include "utils.h"
+
+/* index backends, selected when the index is built */
+#define KIDX_HASH           0    /* uthash table of kmer_t */
+#define KIDX_SORTED         1    /* sorted kmer suffixes under a bucketed prefix table */
+
+/* an entry of the sorted backend pointing to more than one posting */
+#define KIDX_MULTI          0x80000000U
+
+typedef struct {
+	int k;
+	int type;               /* KIDX_HASH or KIDX_SORTED */
+	int n;                  /* number of indexed sequences */
+	char **names;           /* sequence id -> name, points into the fasta_t table */
+	size_t size;            /* number of distinct kmers */
+	size_t n_post;          /* number of unique postings */
+	/* KIDX_HASH */
+	kmer_t *hash;           /* uthash table over kmers */
+	kmer_t *kmers;          /* all kmer_t in one block */
+	uint32_t *post;         /* all postings in one block, also the overflow of KIDX_SORTED */
+	/* KIDX_SORTED */
+	int pbits;              /* kmer prefix bits addressed by bucket */
+	int sbits;              /* kmer suffix bits = 2k - pbits */
+	int swidth;             /* bytes of a stored suffix: 1, 2, 4 or 8 */
+	uint32_t *bucket;       /* 2^pbits+1 offsets into suffix */
+	void *suffix;           /* size sorted suffixes */
+	uint32_t *entry;        /* size postings, or KIDX_MULTI | offset of [count, postings] in post */
+	size_t n_over;          /* words used in post */
+	size_t n_bucket;        /* buckets filled so far, only used while building */
+} kidx_t;
+
+/*
+ * index every sequence in tb by canonical kmers of length k using
+ * n_threads threads and the given backend, return NULL if nothing 
+ * can be indexed.
+ */
+kidx_t *kidx_build(fasta_t *tb, int k, int n_threads, int type);
+
+/* number of bytes kidx_build will allocate for its tuple buffers */
+size_t kidx_build_mem(fasta_t *tb, int k);
+
+/* number of bytes used by the final index */
+size_t kidx_mem(const kidx_t *idx);
+
+void kidx_destroy(kidx_t *idx);
+
+/* branch-free lower bound of x in a[0..n), n > 0 */
+#define KIDX_LOWER_BOUND(type, a, n, x, ret) do {               \
+		const type *_b = (const type*)(a);                       \
+		size_t _n = (n), _h;                                     \
+		while(_n > 1){                                           \
+			_h = _n >> 1;                                        \
+			_b = (_b[_h] <= (type)(x)) ? _b + _h : _b;           \
+			_n -= _h;                                            \
+		}                                                        \
+		(ret) = (_b[0] == (type)(x)) ? _b - (const type*)(a) : -1; \
+	} while(0)
+
+/* position of a canonical kmer in the sorted backend, -1 if absent */
+static inline long
+kidx_sorted_find(const kidx_t *idx, uint64_t kmer){
+	uint64_t prefix = (idx->sbits == 64) ? 0 : kmer >> idx->sbits;
+	uint64_t suffix = (idx->sbits == 64) ? kmer : kmer & (((uint64_t)1 << idx->sbits) - 1);
+	size_t lo = idx->bucket[prefix];
+	size_t n = idx->bucket[prefix+1] - lo;
+	long i = -1;
+	if(n == 0) return -1;
+	switch(idx->swidth){
+		case 1: KIDX_LOWER_BOUND(uint8_t,  (uint8_t*)idx->suffix + lo,  n, suffix, i); break;
+		case 2: KIDX_LOWER_BOUND(uint16_t, (uint16_t*)idx->suffix + lo, n, suffix, i); break;
+		case 4: KIDX_LOWER_BOUND(uint32_t, (uint32_t*)idx->suffix + lo, n, suffix, i); break;
+		default: KIDX_LOWER_BOUND(uint64_t, (uint64_t*)idx->suffix + lo, n, suffix, i); break;
+	}
+	return (i < 0) ? -1 : (long)lo + i;
+}
+
+/*
+ * postings of a canonical kmer, return the number of postings
+ */
+static inline int
+kidx_get(const kidx_t *idx, uint64_t kmer, const uint32_t **post){
+	kmer_t *s;
+	long i;
+	*post = NULL;
+	if(idx->type == KIDX_SORTED){
+		if((i = kidx_sorted_find(idx, kmer)) < 0) return 0;
+		if(idx->entry[i] & KIDX_MULTI){
+			*post = &idx->post[(idx->entry[i] & ~KIDX_MULTI) + 1];
+			return idx->post[idx->entry[i] & ~KIDX_MULTI];
+		}
+		*post = &idx->entry[i];
+		return 1;
+	}
+	if((s = find_kmer(idx->hash, kmer)) == NULL) return 0;
+	*post = s->post;
+	return s->count;
+}
+
+/*
+ * id of the only sequence that contains the kmer on the given strand,
+ * -1 if the kmer is absent or not unique.
+ */
+static inline int
+kidx_uniq_hit(const kidx_t *idx, uint64_t kmer, int strand){
+	const uint32_t *post;
+	int count;
+	if((count = kidx_get(idx, kmer, &post)) == 0) return -1;
+	return kmer_uniq_hit(post, count, strand);
+}
+
+#endif
@@ -5,7 +5,8 @@
 #include <stdio.h>   /* gets */
 #include <stdlib.h>  /* atoi, malloc */
 #include <string.h>  /* strcpy */
-#include <zlib.h> 
+#include <stdint.h>
+#include <zlib.h>
 #include <assert.h>
 #include "kseq.h"
 #include "kstring.h"
@@ -13,141 +14,161 @@
 #include "utils.h"
 
 #define KM_ERR_NONE					0
+#define KM_MAX_LEN                  32   /* a 2-bit packed kmer must fit in 64 bits */
+
+/*
+ * kmers are stored in canonical form, min(forward, reverse complement)
+ * of the 2-bit packed sequence, so that a read can be looked up in either
+ * orientation without materializing its reverse complement. every posting
+ * packs the id of the sequence that contains the kmer and its strand:
+ * strand 0 - the sequence contains the canonical kmer
+ * strand 1 - the sequence contains the reverse complement of the canonical kmer
+ * kmer_t and postings are allocated in blocks by kidx_build (kmer_index.h).
+ */
+#define KM_POST(id, strand)         (((uint32_t)(id) << 1) | (strand))
+#define KM_POST_ID(p)               ((int)((p) >> 1))
+#define KM_POST_STRAND(p)           ((int)((p) & 1))
 
 typedef struct{
-    char* kmer;                /* key */
+    uint64_t kmer;             /* key */
 	int count;
-	char **seq_names;    
+	uint32_t *post;            /* count postings sorted by KM_POST */
     UT_hash_handle hh;         /* makes this structure hashable */
 } kmer_t;
 
+/* iterator over all valid kmers of a sequence, kmers containing N are skipped */
+typedef struct{
+	const char *s;
+	int k;
+	int i;                     /* next base to be read */
+	int len;                   /* number of valid bases in the current window */
+	uint64_t fwd, rev, mask;
+} kmer_itr_t;
+
+static const unsigned char kmer_nt4[256] = {
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 0, 4, 1,  4, 4, 4, 2,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
+	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4
+};
 
-static inline kmer_t *find_kmer(kmer_t*, char*);
-static inline void kmer_uniq(kmer_t**);
-static void kmer_add(kmer_t**, char*, char*);
-static inline void kmer_write(kmer_t*, char*);
+static inline kmer_t *find_kmer(kmer_t*, uint64_t);
+static inline void kmer_write(kmer_t*, char**, char*);
 static inline int kmer_destroy(kmer_t**);
-static inline void kmer_display(kmer_t*);
-
-static inline kmer_t 
-*kmer_init(){
-	kmer_t *res = mycalloc(1, kmer_t);
-	res->kmer = NULL;
-	res->count = 0;
-	res->seq_names = NULL;
-	return res;
+static inline void kmer_display(kmer_t*, char**);
+
+static inline void
+kmer_itr_init(kmer_itr_t *itr, const char *s, int k){
+	itr->s = s;
+	itr->k = k;
+	itr->i = itr->len = 0;
+	itr->fwd = itr->rev = 0;
+	itr->mask = (k < 32) ? ((1ULL << (2*k)) - 1) : ~0ULL;
 }
 
-// destory 
+/*
+ * advance to the next valid kmer of the sequence
+ * pos     - start position of the kmer on the sequence
+ * code    - canonical kmer
+ * strand  - 0 if the sequence carries the canonical kmer, 1 if its reverse complement
+ * return 1 if a kmer is found and 0 at the end of sequence.
+ */
+static inline int
+kmer_itr_next(kmer_itr_t *itr, int *pos, uint64_t *code, int *strand){
+	register int c;
+	int shift = 2 * (itr->k - 1);
+	while((c = (unsigned char)itr->s[itr->i]) != '\0'){
+		itr->i++;
+		if((c = kmer_nt4[c]) > 3){itr->len = 0; continue;}
+		itr->fwd = ((itr->fwd << 2) | c) & itr->mask;
+		itr->rev = (itr->rev >> 2) | ((uint64_t)(3 - c) << shift);
+		if(++itr->len < itr->k) continue;
+		*pos = itr->i - itr->k;
+		*strand = (itr->fwd > itr->rev);
+		*code = (*strand) ? itr->rev : itr->fwd;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * id of the only sequence that contains the kmer on the given strand,
+ * -1 if none or more than one sequence.
+ */
+static inline int
+kmer_uniq_hit(const uint32_t *post, int count, int strand){
+	register int i;
+	int ret = -1;
+	for(i=0; i < count; i++){
+		if(KM_POST_STRAND(post[i]) != strand) continue;
+		if(ret >= 0) return -1;
+		ret = KM_POST_ID(post[i]);
+	}
+	return ret;
+}
+
+/* 
+ * only empties the hash table, the kmers and their postings are owned 
+ * by the kidx_t object that created them.
+ */
 static inline int 
 kmer_destroy(kmer_t **tb) {
 	if(*tb == NULL) die("kmer_uthash_destroy: parameter error\n");	
-	/*free the kmer_hash table*/
-	kmer_t *cur, *tmp;
-	HASH_ITER(hh, *tb, cur, tmp) {
-		if(cur == NULL) die("kmer_uthash_destroy: HASH_ITER fails\n");
-		HASH_DEL(*tb, cur);  /* delete it (users advances to next) */
-      	free(cur);            /* free it */
-    }
+	HASH_CLEAR(hh, *tb);
 	return KM_ERR_NONE;
 }
 
 static inline kmer_t
-*find_kmer(kmer_t *tb, char* quary_kmer) {
-    if(quary_kmer == NULL) die("[%s] parameter error", __func__);
+*find_kmer(kmer_t *tb, uint64_t quary_kmer) {
 	kmer_t *s = NULL;
-	HASH_FIND_STR(tb, quary_kmer, s);  /* s: output pointer */
+	HASH_FIND(hh, tb, &quary_kmer, sizeof(uint64_t), s);  /* s: output pointer */
     return s;
 }
 
 static inline void
-kmer_display(kmer_t *kmer_ht) {	
-	if(kmer_ht == NULL) die("kmer_uthash_display: input error\n");
+kmer_display(kmer_t *kmer_ht, char **names) {	
+	if(kmer_ht == NULL || names == NULL) die("kmer_uthash_display: input error\n");
    	register kmer_t *kmer_cur;
 	register int i;
 	
 	for(kmer_cur=kmer_ht; kmer_cur!=NULL; kmer_cur=kmer_cur->hh.next){
-		printf("kmer=%s\tcount=%d\n", kmer_cur->kmer, kmer_cur->count);
+		printf("kmer=%016llx\tcount=%d\n", (unsigned long long)kmer_cur->kmer, kmer_cur->count);
 		for(i=0; i < kmer_cur->count; i++){
-			printf("%s\t", kmer_cur->seq_names[i]);
+			printf("%s%c\t", names[KM_POST_ID(kmer_cur->post[i])], KM_POST_STRAND(kmer_cur->post[i]) ? '-' : '+');
 		}		
 		printf("\n");
 	}
 }
 
-/* add one kmer and its exon name to kmer_uthash table */
-static void kmer_add(kmer_t **table, char* kmer, char* name) {
-	// check input param
-	if(kmer==NULL || name==NULL) die("[%s]: input error", __func__);
-
-	register kmer_t *s;
-	register int i;
-	/* check if kmer exists in table*/
-	if((s = find_kmer(*table, kmer))==NULL){
-		s = kmer_init();
-		s->kmer = strdup(kmer);
-		s->count = 1;                /* first pos in the list */
-		s->seq_names = mycalloc(s->count, char*);
-		s->seq_names[0] = strdup(name); /* first and only 1 element*/
-		HASH_ADD_STR(*table, kmer, s); // add to hash table
-	}else{
-		char **tmp;
-		s->count++;
-		/* copy s->pos */
-		tmp = mycalloc(s->count, char*);
-		for(i = 0; i < s->count-1; i++){
-			tmp[i] = strdup(s->seq_names[i]);
-		}
-		tmp[i] = strdup(name);
-		free(s->seq_names);
-		s->seq_names = tmp;
-	}
-}
-
-/*
- * delete duplicate seq_names in kmer->seq_names
- */
-static inline void 
-kmer_uniq(kmer_t **kmer_ht){
-	if(*kmer_ht == NULL) die("[%s] input can't be NULL", __func__);
-	register kmer_t *kmer_cur = NULL;
-	char **names = NULL;
-	bool repeat;
-	register int i, j, count;
-	for(kmer_cur=*kmer_ht; kmer_cur!=NULL; kmer_cur=kmer_cur->hh.next){
-		names = mycalloc(kmer_cur->count, char*);
-		count = 0;
-		for(i=0; i<kmer_cur->count; i++){ /* iterate every evidence */
-			repeat = false;
-			for(j=0; j<count; j++){if(strcmp(kmer_cur->seq_names[i], names[j])==0){repeat = true;}}
-			if(repeat==false){ // no duplicates
-				names[count++] = strdup(kmer_cur->seq_names[i]);
-			}
-		}
-		/* free old */
-		if(kmer_cur->seq_names){for(i=0; i<kmer_cur->count; i++) free(kmer_cur->seq_names[i]); free(kmer_cur->seq_names);};
-		kmer_cur->seq_names = names;
-		kmer_cur->count = count;
-	}
-}
-
 ///* Write down kmer_uthash */
 static inline void 
-kmer_write(kmer_t *htable, char *fname){
-	if(htable == NULL || fname == NULL) die("kmer_uthash_write: input error");
+kmer_write(kmer_t *htable, char **names, char *fname){
+	if(htable == NULL || names == NULL || fname == NULL) die("kmer_uthash_write: input error");
 	/* write htable to disk*/
 	FILE *ofp = fopen(fname, "w");
 	if (ofp == NULL) die("Can't open output file %s!\n", fname);
 	kmer_t *s, *tmp;
 	HASH_ITER(hh, htable, s, tmp) {
 		if(s == NULL) die("Fail to write down %s!\n", fname);
-		fprintf(ofp, ">%s\t%d\n", s->kmer, s->count);		
+		fprintf(ofp, ">%016llx\t%d\n", (unsigned long long)s->kmer, s->count);		
 		int i;
 		for(i=0; i < s->count; i++){
 			if(i==0){
-				fprintf(ofp, "%s", s->seq_names[i]);																
+				fprintf(ofp, "%s%c", names[KM_POST_ID(s->post[i])], KM_POST_STRAND(s->post[i]) ? '-' : '+');
 			}else{
-				fprintf(ofp, "|%s", s->seq_names[i]);
+				fprintf(ofp, "|%s%c", names[KM_POST_ID(s->post[i])], KM_POST_STRAND(s->post[i]) ? '-' : '+');
 			}
 		}
 		fprintf(ofp, "\n");
@@ -3,6 +3,8 @@
 #include "kstring.h"
 #include "name2fasta.h" 
 #include "predict.h"
+#include "reference.h"
+#include "null_model.h"
 
 #ifndef PACKAGE_VERSION
 #define PACKAGE_VERSION "09.05-r15"
@@ -11,6 +13,14 @@
 int name2fasta(int argc, char *argv[]);
 int predict(int argc, char *argv[]);
 int rapid(int argc, char *argv[]);
+int refpack(int argc, char *argv[]);
+int nullpack(int argc, char *argv[]);
+int nullsim(int argc, char *argv[]);
+int simulate(int argc, char *argv[]);
+int serve(int argc, char *argv[]);
+int submit(int argc, char *argv[]);
+int scan(int argc, char *argv[]);
+int merge(int argc, char *argv[]);
 
 static int usage()
 {
@@ -22,6 +32,14 @@ static int usage()
 	fprintf(stderr, "Command: rapid          predict gene fusions in rapid mode\n");
 	fprintf(stderr, "         predict        predict gene fusions in predict mode\n");
 	fprintf(stderr, "         name2fasta     extract DNA sequences of targeted genes\n");
+	fprintf(stderr, "         refpack        pack a reference genome for fast extraction\n");
+	fprintf(stderr, "         nullpack       compile a null model for fast p-values\n");
+	fprintf(stderr, "         nullsim        simulate the null model of rapid mode\n");
+	fprintf(stderr, "         simulate       simulate reads of gene fusions\n");
+	fprintf(stderr, "         serve          keep rapid mode in memory and call fusions of submitted samples\n");
+	fprintf(stderr, "         submit         send a sample to tafuco serve\n");
+	fprintf(stderr, "         scan           write the partial graph of a shard of a sample\n");
+	fprintf(stderr, "         merge          predict gene fusions from the shards of a sample\n");
 	fprintf(stderr, "\n");
 	return 1;
 }
@@ -37,6 +55,14 @@ int main(int argc, char *argv[])
 	else if (strcmp(argv[1], "rapid") == 0) ret = rapid(argc-1, argv+1);
 	else if (strcmp(argv[1], "predict") == 0) ret = predict(argc-1, argv+1);
 	else if (strcmp(argv[1], "name2fasta") == 0) ret = name2fasta(argc-1, argv+1);
+	else if (strcmp(argv[1], "refpack") == 0) ret = refpack(argc-1, argv+1);
+	else if (strcmp(argv[1], "nullpack") == 0) ret = nullpack(argc-1, argv+1);
+	else if (strcmp(argv[1], "nullsim") == 0) ret = nullsim(argc-1, argv+1);
+	else if (strcmp(argv[1], "simulate") == 0) ret = simulate(argc-1, argv+1);
+	else if (strcmp(argv[1], "serve") == 0) ret = serve(argc-1, argv+1);
+	else if (strcmp(argv[1], "submit") == 0) ret = submit(argc-1, argv+1);
+	else if (strcmp(argv[1], "scan") == 0) ret = scan(argc-1, argv+1);
+	else if (strcmp(argv[1], "merge") == 0) ret = merge(argc-1, argv+1);
 	else {
 		fprintf(stderr, "[main] unrecognized command '%s'\n", argv[1]);
 		return 1;
@@ -1,23 +1,72 @@
 #include "name2fasta.h"
 
 /*
- * "CTCF"; -> CTCF
+ * read gene candidates, one name per line, names are upper cased.
  */
-static char *name_trim(char *s, char delim){
-	if(s==NULL || strlen(s) <= 3) return NULL;
-	int num, i;
-	char**fields_tmp = NULL;
-	char* gname;
-	fields_tmp = strsplit(s, delim, &num);	
-	if(num<2){
-		return NULL;
+static str_ctr *read_gene_names(char *fname){
+	str_ctr *ret = NULL;
+	char *line = NULL, *p, *q;
+	size_t len = 0;
+	FILE *fp = fopen(fname, "r");
+	if(fp==NULL) die("[%s] can't open %s", __func__, fname); 
+	while (getline(&line, &len, fp) != -1) {
+		for(p=line; isspace((unsigned char)*p); p++);
+		if(*p == '\0') continue;
+		for(q=p; *q && !isspace((unsigned char)*q); q++) *q = toupper((unsigned char)*q);
+		*q = '\0';
+		str_ctr_add(&ret, p);
 	}
-	gname = strdup(fields_tmp[0]);
-	for(i=0; i<num; i++){
-	if(fields_tmp[i]) free(fields_tmp[i]);		
-	} 
-	free(fields_tmp);
-	return gname;
+	if(line) free(line);
+	fclose(fp);
+	return ret;
+}
+
+/* a GTF row of a gene candidate */
+typedef struct {
+	char *line;
+	int end;
+} gtf_row_t;
+
+/* order of LC_ALL=C sort -k5,5n: end position, then the whole line */
+static int gtf_row_cmp(const void *a, const void *b){
+	const gtf_row_t *x = (const gtf_row_t*)a, *y = (const gtf_row_t*)b;
+	if(x->end != y->end) return (x->end > y->end) - (x->end < y->end);
+	return strcmp(x->line, y->line);
+}
+
+/*
+ * collect rows of feature genr of gene candidates that carry gene_id,
+ * gene_name, transcript_id and tss_id. rows are returned in the order 
+ * of a GTF sorted by its 5th column, exons are numbered in this order 
+ * so that genes.gtf doesn't have to be sorted beforehand.
+ */
+static gtf_row_t *gtf_rows(char *fname_db, str_ctr *genes, char *genr, int *n){
+	gtf_row_t *rows = NULL;
+	gtf_reader_t *gtf;
+	gtf_rec_t r;
+	char *line, buf[GTF_MAX_NAME];
+	int m = 0, l;
+	*n = 0;
+	if((gtf = gtf_reader_open(fname_db, genes))==NULL) die("[%s] can't open %s", __func__, fname_db);
+	while ((line = gtf_reader_next(gtf)) != NULL) {
+		/* attributes are only parsed for rows of the feature and gene candidates */
+		if(gtf_parse(line, &r) != 0) continue;
+		if(strcmp(r.feature, genr)!=0 || (r.end - r.start) <= 0) continue;
+		if(gtf_attr(r.attr, "gene_name", buf, GTF_MAX_NAME, 1) < 0) continue;
+		if(find_str_ctr(genes, buf)==NULL) continue;
+		if(gtf_attr(r.attr, "gene_id", buf, GTF_MAX_NAME, 1) < 0) continue;
+		if(gtf_attr(r.attr, "transcript_id", buf, GTF_MAX_NAME, 0) < 0) continue;
+		if(gtf_attr(r.attr, "tss_id", buf, GTF_MAX_NAME, 0) < 0) continue;
+		gtf_restore(&r, 8);
+		if(*n == m){m = (m) ? m << 1 : 1024; rows = realloc(rows, m * sizeof(gtf_row_t));}
+		if((l = strlen(line)) > 0 && line[l-1] == '\n') line[--l] = '\0';
+		rows[*n].line = strdup(line);
+		rows[*n].end = r.end;
+		(*n)++;
+	}
+	gtf_reader_close(gtf);
+	qsort(rows, *n, sizeof(gtf_row_t), gtf_row_cmp);
+	return rows;
 }
 
 /*
@@ -29,246 +78,140 @@ static char *name_trim(char *s, char delim){
  *-------
  * fname     - name of file that contains genes' name e.g. genes.name.txt
  * fname_db  - name of the file that contains all genes' annotation e.g. data/hg.bed
- * HG19_HT   - fasta_uthash object that contains reference genome loaded by fasta_uthash_load
+ * ref       - reference genome opened by ref_open
 
  * Output: 
  *-------
  * fasta_uthash object that contains extracted sequences.
  */
-fasta_t *extract_exon_seq(char* fname, char *fname_db, fasta_t *HG19_HT, char *genr){
-	if(fname==NULL || fname_db==NULL || HG19_HT==NULL) return NULL;
-	fasta_t *s_fasta, *cur_fasta, *ret_fasta = NULL;
+fasta_t *extract_exon_seq(char* fname, char *fname_db, ref_t *ref, char *genr){
+	if(fname==NULL || fname_db==NULL || ref==NULL) return NULL;
+	fasta_t *s_fasta, *ret_fasta = NULL;
 	str_ctr *s_ctr, *ctr = NULL, *gene_name_ctr = NULL;
-	char  *line = NULL;
-	size_t len = 0;
-	int l;
-	ssize_t read;
-	char  **fields = NULL;
-	
-	int i, j, num;
-	register char *category=NULL;
-	register char *chrom = NULL;
-	register char *strand = NULL;
-	register char *name = NULL;	
-	register char *gene_id = NULL;	
-	register char *gene_name = NULL;	
-	register char *transcript_id = NULL;	
-	register char *tss_id = NULL;		
-	register int start, end;
-	fasta_t *s;
-	char *seq;
-	char idx[50];
+	str_ctr *ctr_s, *ctr_tmp;
+	char *name, *seq;
+	char gene_id[GTF_MAX_NAME], gene_name[GTF_MAX_NAME], transcript_id[GTF_MAX_NAME], tss_id[GTF_MAX_NAME];
+	int i, l, n;
+	gtf_rec_t r;
+	gtf_row_t *rows;
 	
-	FILE * fp0 = fopen (fname, "r");
-	if(fp0==NULL) die("[%s] can't open %s", __func__, fname); 
-	while ((read = getline(&line, &len, fp0)) != -1) {
-		if((fields = strsplit(line, 0, &num))==NULL) continue; // get rid of \n 
-		str_ctr_add(&gene_name_ctr, strToUpper(fields[0]));		
-		for(i=0; i<num; i++) free(fields[i]);
+	gene_name_ctr = read_gene_names(fname);
+	rows = gtf_rows(fname_db, gene_name_ctr, genr, &n);
+	/* a gzip'd reference is streamed once for all rows */
+	for(i=0; i<n; i++){
+		gtf_parse(rows[i].line, &r);
+		ref_want(ref, r.chrom, r.start, r.end);
+		gtf_restore(&r, 8);
 	}
-	fclose(fp0);
-	
-	FILE *fp = fopen(fname_db, "r");
-	if(fp==NULL) die("[%s] can't open %s", __func__, fname_db);
-	str_ctr *ctr_s, *ctr_tmp;
-	while ((read = getline(&line, &len, fp)) != -1) {
-		fields=NULL;
-		name=category=chrom=strand=gene_id=gene_name=transcript_id=tss_id=NULL;
-		if(strlen(line)<15) goto CONTINUE;
-		// get information of exons
-		if((fields = strsplit(line, 0, &num))==NULL) goto CONTINUE;
-		if(num<15) goto CONTINUE;
+	if(ref_load(ref) != 0) die("[%s] can't read %s", __func__, ref->fname);
+	for(i=0; i<n; i++){
+		gtf_parse(rows[i].line, &r);
+		gtf_attr(r.attr, "gene_name", gene_name, GTF_MAX_NAME, 1);
+		gtf_attr(r.attr, "gene_id", gene_id, GTF_MAX_NAME, 1);
+		gtf_attr(r.attr, "transcript_id", transcript_id, GTF_MAX_NAME, 0);
+		gtf_attr(r.attr, "tss_id", tss_id, GTF_MAX_NAME, 0);
+		ctr_s = find_str_ctr(gene_name_ctr, gene_name);
 		
-		if((chrom = fields[0])   ==NULL) goto CONTINUE;
-		if((category = fields[2])==NULL) goto CONTINUE;
-		if((strand = fields[6])  ==NULL) goto CONTINUE;		
-		for(i=0; i<num; i++){
-			if(strcmp(fields[i], "gene_id")==0)             gene_id=strToUpper(name_trim(fields[i+1], '"'));
-			if(strcmp(fields[i], "gene_name")==0)         gene_name=strToUpper(name_trim(fields[i+1], '"'));			
-			if(strcmp(fields[i], "transcript_id")==0) transcript_id=name_trim(fields[i+1], '"');			
-			if(strcmp(fields[i], "tss_id")==0)               tss_id=name_trim(fields[i+1], '"');			
-		}
-		
-		if(gene_id==NULL || gene_name==NULL || transcript_id==NULL || tss_id==NULL) goto CONTINUE;
-		start = atoi(fields[3]);
-		end   = atoi(fields[4]);
-		
-		if(strcmp(category, genr)==0 && ((ctr_s=find_str_ctr(gene_name_ctr, gene_name))!=NULL) && ((end - start)>0)){
-			if((s = find_fasta(HG19_HT, chrom))==NULL) goto CONTINUE;
-			l =  end - start;
-			name = join(7, chrom, ".", fields[3], ".", fields[4], ".", gene_name);
-			if((s_fasta = find_fasta(ret_fasta, name)) == NULL){
-				ctr_s->SIZE++;
-				str_ctr_add(&ctr, gene_name);
-				s_ctr = find_ctr(ctr, gene_name);
-				s_fasta = fasta_init();
-				s_fasta->name = strdup(name);
-				s_fasta->idx = s_ctr->SIZE;
-				s_fasta->chrom = strdup(chrom);
-				s_fasta->gene_name = strdup(gene_name);
-				s_fasta->gene_id = strdup(gene_id);
+		name = join(7, r.chrom, ".", r.start_s, ".", r.end_s, ".", gene_name);
+		if((s_fasta = find_fasta(ret_fasta, name)) == NULL){
+			if((seq = ref_fetch(ref, r.chrom, r.start, r.end, &l))==NULL){free(name); continue;}
+			ctr_s->SIZE++;
+			str_ctr_add(&ctr, gene_name);
+			s_ctr = find_ctr(ctr, gene_name);
+			s_fasta = fasta_init();
+			s_fasta->name = name;
+			s_fasta->idx = s_ctr->SIZE;
+			s_fasta->chrom = strdup(r.chrom);
+			s_fasta->gene_name = strdup(gene_name);
+			s_fasta->gene_id = strdup(gene_id);
 
-				s_fasta->transcript_id = mycalloc(1, char*);
-				s_fasta->tss_id = mycalloc(1, char*);
+			s_fasta->transcript_id = mycalloc(1, char*);
+			s_fasta->tss_id = mycalloc(1, char*);
 
-				s_fasta->transcript_id[0] =strdup(transcript_id);
-				s_fasta->tss_id[0] = strdup(tss_id);
-				
-				s_fasta->transcript_num = 1;
-				s_fasta->tss_num = 1;
-				
-				s_fasta->strand = strdup(strand);
-				s_fasta->start = start;
-				s_fasta->end = end;
-				s_fasta->seq = mycalloc(l+1, char);
-				memset(s_fasta->seq, '\0',l+1);	
-				memcpy(s_fasta->seq, &s->seq[start], l);
-				if(strcmp(strand, "-") == 0) s_fasta->seq = rev_com(s_fasta->seq);	
-				s_fasta->l = l;
-				HASH_ADD_STR(ret_fasta, name, s_fasta);
-			}else{
-				s_fasta->transcript_num++;
-				s_fasta->tss_num++;
-				s_fasta->transcript_id = realloc(s_fasta->transcript_id, s_fasta->transcript_num * sizeof(*s_fasta->transcript_id));
-				s_fasta->tss_id = realloc(s_fasta->tss_id, s_fasta->tss_num * sizeof(*s_fasta->tss_id));
-				s_fasta->transcript_id[s_fasta->transcript_num-1] = strdup(transcript_id);
-				s_fasta->tss_id[s_fasta->tss_num-1] = strdup(tss_id);
-			}
+			s_fasta->transcript_id[0] =strdup(transcript_id);
+			s_fasta->tss_id[0] = strdup(tss_id);
+			
+			s_fasta->transcript_num = 1;
+			s_fasta->tss_num = 1;
+			
+			s_fasta->strand = strdup(r.strand);
+			s_fasta->start = r.start;
+			s_fasta->end = r.end;
+			s_fasta->seq = seq;
+			if(strcmp(r.strand, "-") == 0){s_fasta->seq = rev_com(seq); free(seq);}
+			s_fasta->l = l;
+			HASH_ADD_STR(ret_fasta, name, s_fasta);
+		}else{
+			free(name);
+			s_fasta->transcript_num++;
+			s_fasta->tss_num++;
+			s_fasta->transcript_id = realloc(s_fasta->transcript_id, s_fasta->transcript_num * sizeof(*s_fasta->transcript_id));
+			s_fasta->tss_id = realloc(s_fasta->tss_id, s_fasta->tss_num * sizeof(*s_fasta->tss_id));
+			s_fasta->transcript_id[s_fasta->transcript_num-1] = strdup(transcript_id);
+			s_fasta->tss_id[s_fasta->tss_num-1] = strdup(tss_id);
 		}
-		/* skip current item */
-		CONTINUE:
-			if(fields){for(i=0; i<num; i++) free(fields[i]); free(fields);}
-			if(gene_name)      free(gene_name);
-			if(gene_id)        free(gene_id);
-			if(transcript_id)  free(transcript_id);
-			if(tss_id)         free(tss_id);
-			if(name)           free(name);
-			continue;
-		/* free all items */
-		if(fields){for(i=0; i<num; i++) free(fields[i]); free(fields);}
-		if(gene_name)      free(gene_name);
-		if(gene_id)        free(gene_id);
-		if(transcript_id)  free(transcript_id);
-		if(tss_id)         free(tss_id);
-		if(name)           free(name);
 	}
-	fclose(fp);
+	for(i=0; i<n; i++) free(rows[i].line);
+	if(rows) free(rows);
 	
 	HASH_ITER(hh, gene_name_ctr, ctr_s, ctr_tmp) {
 		if(ctr_s->SIZE == 1) fprintf(stderr,"%s not found\n", ctr_s->KEY);
 	}
+	if(ctr)            str_ctr_destory(&ctr);
+	if(gene_name_ctr)  str_ctr_destory(&gene_name_ctr);
 	return ret_fasta;
 }
 
 
-static fasta_t *extract_transcript_seq(char* fname, char *fname_db, fasta_t *HG19_HT){
-	if(fname==NULL || fname_db==NULL || HG19_HT==NULL) return NULL;
-	fasta_t *s_fasta, *cur_fasta, *ret_fasta = NULL;
-	str_ctr *s_ctr, *ctr = NULL, *gene_name_ctr = NULL;
-	char  *line = NULL;
-	size_t len = 0;
-	int l;
-	ssize_t read;
-	char  **fields = NULL;
-	
-	int i, j, num;
-	register char *category=NULL;
-	register char *chrom = NULL;
-	register char *strand = NULL;
-	register char *name = NULL;	
-	register char *gene_id = NULL;	
-	register char *gene_name = NULL;	
-	register char *transcript_id = NULL;	
-	register char *tss_id = NULL;		
-	register int start, end;
-	char *str_tmp = NULL;
-	
-	fasta_t *s;
-	char *seq;
-	char idx[50];
+static fasta_t *extract_transcript_seq(char* fname, char *fname_db, ref_t *ref){
+	if(fname==NULL || fname_db==NULL || ref==NULL) return NULL;
+	fasta_t *s_fasta, *ret_fasta = NULL;
+	str_ctr *gene_name_ctr = NULL;
+	str_ctr *ctr_s, *ctr_tmp;
+	char *name, *seq, *str_tmp;
+	char gene_name[GTF_MAX_NAME], transcript_id[GTF_MAX_NAME];
+	int i, l, n;
+	gtf_rec_t r;
+	gtf_row_t *rows;
 	
-	FILE * fp0 = fopen (fname, "r");
-	if(fp0==NULL) die("[%s] can't open %s", __func__, fname); 
-	while ((read = getline(&line, &len, fp0)) != -1) {
-		if((fields = strsplit(line, 0, &num))==NULL) continue; // get rid of \n 
-		str_ctr_add(&gene_name_ctr, strToUpper(fields[0]));		
-		for(i=0; i<num; i++) free(fields[i]);
+	gene_name_ctr = read_gene_names(fname);
+	rows = gtf_rows(fname_db, gene_name_ctr, "exon", &n);
+	/* a gzip'd reference is streamed once for all rows */
+	for(i=0; i<n; i++){
+		gtf_parse(rows[i].line, &r);
+		ref_want(ref, r.chrom, r.start, r.end);
+		gtf_restore(&r, 8);
 	}
-	fclose(fp0);
-	
-	FILE *fp = fopen(fname_db, "r");
-	if(fp==NULL) die("[%s] can't open %s", __func__, fname_db);
-	str_ctr *ctr_s, *ctr_tmp;
-	while ((read = getline(&line, &len, fp)) != -1) {
-		fields=NULL;
-		category=chrom=strand=name=gene_id=gene_name=transcript_id=tss_id=NULL;
-		if(strlen(line)<15) goto CONTINUE;
-		// get information of exons
-		if((fields = strsplit(line, 0, &num))==NULL) goto CONTINUE;
-		if(num<15) goto CONTINUE;
-		
-		if((chrom = fields[0])   ==NULL) goto CONTINUE;
-		if((category = fields[2])==NULL) goto CONTINUE;
-		if((strand = fields[6])  ==NULL) goto CONTINUE;		
-		for(i=0; i<num; i++){
-			if(strcmp(fields[i], "gene_id")==0)             gene_id=strToUpper(name_trim(fields[i+1], '"'));
-			if(strcmp(fields[i], "gene_name")==0)         gene_name=strToUpper(name_trim(fields[i+1], '"'));			
-			if(strcmp(fields[i], "transcript_id")==0) transcript_id=name_trim(fields[i+1], '"');			
-			if(strcmp(fields[i], "tss_id")==0)               tss_id=name_trim(fields[i+1], '"');			
-		}
-		
-		if(gene_id==NULL || gene_name==NULL || transcript_id==NULL || tss_id==NULL) goto CONTINUE;
-		start = atoi(fields[3]);
-		end   = atoi(fields[4]);
-		
-		if(strcmp(category, "exon")==0 && ((ctr_s=find_str_ctr(gene_name_ctr, gene_name))!=NULL) && ((end - start)>0)){
-			ctr_s->SIZE++;
-			str_ctr_add(&ctr, gene_name);
-			if((s = find_fasta(HG19_HT, chrom))==NULL) goto CONTINUE;
-			name = join(3, gene_name, "|", transcript_id);
-			if((l = end - start)<=0) goto CONTINUE;
-			if((s_fasta = find_fasta(ret_fasta, name)) == NULL){
-				s_fasta = fasta_init();
-				s_fasta->name = strdup(name);
-				str_tmp = mycalloc(l+1, char);
-				memset(str_tmp, '\0',l+1);	
-				memcpy(str_tmp, &s->seq[start], l);
-				if(strcmp(strand, "-") == 0) str_tmp = rev_com(str_tmp);	
-				s_fasta->seq = strdup(str_tmp);
-				free(str_tmp);
-				HASH_ADD_STR(ret_fasta, name, s_fasta);				
-			}
-			else{
-				str_tmp = mycalloc(l+1, char);
-				memset(str_tmp, '\0',l+1);	
-				memcpy(str_tmp, &s->seq[start], l);	
-				if(strcmp(strand, "-") == 0)  str_tmp = rev_com(str_tmp);
-				s_fasta->seq = concat(s_fasta->seq, str_tmp);
-				if(str_tmp) free(str_tmp);			
-			}
+	if(ref_load(ref) != 0) die("[%s] can't read %s", __func__, ref->fname);
+	for(i=0; i<n; i++){
+		gtf_parse(rows[i].line, &r);
+		gtf_attr(r.attr, "gene_name", gene_name, GTF_MAX_NAME, 1);
+		gtf_attr(r.attr, "transcript_id", transcript_id, GTF_MAX_NAME, 0);
+		ctr_s = find_str_ctr(gene_name_ctr, gene_name);
+		ctr_s->SIZE++;
+		if((str_tmp = ref_fetch(ref, r.chrom, r.start, r.end, &l))==NULL) continue;
+		if(strcmp(r.strand, "-") == 0){seq = rev_com(str_tmp); free(str_tmp); str_tmp = seq;}
+		name = join(3, gene_name, "|", transcript_id);
+		if((s_fasta = find_fasta(ret_fasta, name)) == NULL){
+			s_fasta = fasta_init();
+			s_fasta->name = name;
+			s_fasta->seq = str_tmp;
+			HASH_ADD_STR(ret_fasta, name, s_fasta);				
+		}else{
+			free(name);
+			seq = s_fasta->seq;
+			s_fasta->seq = concat(seq, str_tmp);
+			if(s_fasta->seq != seq) free(seq);
+			if(s_fasta->seq != str_tmp) free(str_tmp);
 		}
-		/* skip current item */
-		CONTINUE:
-			if(fields){for(i=0; i<num; i++) free(fields[i]); free(fields);}
-			if(gene_name)      free(gene_name);
-			if(gene_id)        free(gene_id);
-			if(transcript_id)  free(transcript_id);
-			if(tss_id)         free(tss_id);
-			if(name)           free(name);
-			continue;
-		/* free all items */
-		if(fields){for(i=0; i<num; i++) free(fields[i]); free(fields);}
-		if(gene_name)      free(gene_name);
-		if(gene_id)        free(gene_id);
-		if(transcript_id)  free(transcript_id);
-		if(tss_id)         free(tss_id);
-		if(name)           free(name);
 	}
-	fclose(fp);
+	for(i=0; i<n; i++) free(rows[i].line);
+	if(rows) free(rows);
 	
 	HASH_ITER(hh, gene_name_ctr, ctr_s, ctr_tmp) {
 		if(ctr_s->SIZE == 1) fprintf(stderr,"%s not found\n", ctr_s->KEY);
 	}
+	if(gene_name_ctr)  str_ctr_destory(&gene_name_ctr);
 	return ret_fasta;
 }
 
@@ -322,7 +265,9 @@ int name2fasta_usage(){
 	fprintf(stderr, "\n");
 			fprintf(stderr, "Usage:   tafuco name2fasta [options] <gname.txt> <genes.gtf> <in.fa> <out.fa> \n\n");
 			fprintf(stderr, "Details: name2fasta is to extract genomic sequence of gene candiates\n\n");
-			fprintf(stderr, "Options: -g               'exon' or 'transcript' or 'CDS' \n\n");
+			fprintf(stderr, "Options: -g               'exon' or 'transcript' or 'CDS' \n");
+			fprintf(stderr, "         -x               index genes.gtf by gene name (genes.gtf.gidx) so that\n");
+			fprintf(stderr, "                          later runs only read rows of gene candidates\n\n");
 			fprintf(stderr, "Inputs:  gname.txt        .txt file contains the names of gene candiates\n");
 			fprintf(stderr, "         genes.gtf        .gft file that contains gene annotations\n");
 			fprintf(stderr, "         in.fa            .fa file contains the whole genome sequence e.g. [hg19.fa]\n");
@@ -331,13 +276,14 @@ int name2fasta_usage(){
 }
 
 int name2fasta(int argc, char *argv[]) {
-	int c, i;
+	int c, i, gtf_index = 0;
 	srand48(11);
 	char *gene_name, *gff_name, *oname, *iname, *genr;
 	gene_name = gff_name = oname = iname = genr = NULL;
-	while ((c = getopt(argc, argv, "g:c")) >= 0) {
+	while ((c = getopt(argc, argv, "g:x")) >= 0) {
 				switch (c) {
 				case 'g': genr = optarg; break;
+				case 'x': gtf_index = 1; break;
 				default: return 1;
 		}
 	}
@@ -357,15 +303,20 @@ int name2fasta(int argc, char *argv[]) {
 		return -1;
 	}
 	
-	fasta_t *GENO_HT = NULL;
+	ref_t *GENO_REF = NULL;
 	fasta_t *EXON_HT = NULL;
 	
+	if(gtf_index){
+		fprintf(stderr, "[%s] indexing %s by gene name ... \n",__func__, gff_name);
+		if(gtf_index_build(gff_name) < 0) die("[%s] can't index %s", __func__, gff_name);
+	}
+	
 	fprintf(stderr, "[%s] loading reference genome sequences ... \n",__func__);
-	if((GENO_HT = fasta_read(iname)) == NULL) die("[%s] can't load reference genome %s", __func__, iname);	
+	if((GENO_REF = ref_open(iname)) == NULL) die("[%s] can't load reference genome %s", __func__, iname);	
 	//
 	if(strcmp(genr, "exon")==0){
 		fprintf(stderr, "[%s] extracting targeted gene sequences ... \n",__func__);
-		if((EXON_HT = extract_exon_seq(gene_name, gff_name, GENO_HT, genr))==NULL) die("[%s] can't extract exon sequences of %s", __func__, gene_name);
+		if((EXON_HT = extract_exon_seq(gene_name, gff_name, GENO_REF, genr))==NULL) die("[%s] can't extract exon sequences of %s", __func__, gene_name);
 	
 		fprintf(stderr, "[%s] writing down sequences ... \n",__func__);
 		if((fasta_write_exon(EXON_HT, oname))!=0) die("[%s] can't write down to %s", __func__, oname);		
@@ -373,7 +324,7 @@ int name2fasta(int argc, char *argv[]) {
 
 	if(strcmp(genr, "transcript")==0){
 		fprintf(stderr, "[%s] extracting targeted gene sequences ... \n",__func__);
-		if((EXON_HT = extract_transcript_seq(gene_name, gff_name, GENO_HT))==NULL) die("[%s] can't extract exon sequences of %s", __func__, gene_name);
+		if((EXON_HT = extract_transcript_seq(gene_name, gff_name, GENO_REF))==NULL) die("[%s] can't extract exon sequences of %s", __func__, gene_name);
 	
 		fprintf(stderr, "[%s] writing down sequences ... \n",__func__);
 		if((fasta_write_transcript(EXON_HT, oname))!=0) die("[%s] can't write down to %s", __func__, oname);		
@@ -381,7 +332,7 @@ int name2fasta(int argc, char *argv[]) {
 
 	if(strcmp(genr, "CDS")==0){
 		fprintf(stderr, "[%s] extracting targeted gene sequences ... \n",__func__);
-		if((EXON_HT = extract_exon_seq(gene_name, gff_name, GENO_HT, genr))==NULL) die("[%s] can't extract exon sequences of %s", __func__, gene_name);
+		if((EXON_HT = extract_exon_seq(gene_name, gff_name, GENO_REF, genr))==NULL) die("[%s] can't extract exon sequences of %s", __func__, gene_name);
 	
 		fprintf(stderr, "[%s] writing down sequences ... \n",__func__);
 		if((fasta_write_exon(EXON_HT, oname))!=0) die("[%s] can't write down to %s", __func__, oname);		
@@ -391,6 +342,6 @@ int name2fasta(int argc, char *argv[]) {
 	fprintf(stderr, "[%s] cleaning up ... \n", __func__);	
     
 	if(EXON_HT)   fasta_destroy(&EXON_HT);
-	if(GENO_HT)   fasta_destroy(&GENO_HT);    
+	if(GENO_REF)  ref_close(GENO_REF);    
 	return 0;
 }
\ No newline at end of file
@@ -16,6 +16,8 @@
 #include "kseq.h"
 #include "kstring.h"
 #include "fasta_uthash.h"
+#include "reference.h"
+#include "gtf.h"
 #include "utils.h"
 
 /*
@@ -28,6 +30,6 @@ int name2fasta_usage();
  */
 int name2fasta(int argc, char *argv[]);
 
-fasta_t *extract_exon_seq(char* fname, char *fname_db, fasta_t *HG19_HT, char *genr);
+fasta_t *extract_exon_seq(char* fname, char *fname_db, ref_t *ref, char *genr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,227 @@
+/*--------------------------------------------------------------------*/
+/* null_model.c                                                       */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Background distribution of fusion scores for p-values.             */
+/*--------------------------------------------------------------------*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "null_model.h"
+
+/* one score of a text null model */
+typedef struct {
+	char *edge;
+	float val;
+} null_rec_t;
+
+static int null_rec_cmp(const void *a, const void *b){
+	const null_rec_t *x = (const null_rec_t*)a, *y = (const null_rec_t*)b;
+	int rc = strcmp(x->edge, y->edge);
+	if(rc != 0) return rc;
+	return (x->val > y->val) - (x->val < y->val);
+}
+
+/* point the tables of null into its image */
+static void null_attach(null_t *null){
+	null->hdr   = (const nullmodel_hdr_t*)null->map;
+	null->pairs = (const nullmodel_pair_t*)(null->map + null->hdr->pair_off);
+	null->vals  = (const float*)(null->map + null->hdr->val_off);
+	null->names = (const char*)(null->map + null->hdr->name_off);
+}
+
+/* compile a text null model of n_rep simulations into an in memory image */
+static int null_text(null_t *null, const char *fname, uint64_t n_rep){
+	null_rec_t *recs = NULL;
+	size_t n = 0, m = 0, i, n_pair = 0, l_names = 0, size;
+	nullmodel_hdr_t *hdr;
+	nullmodel_pair_t *pairs;
+	float *vals;
+	char *names, *line = NULL, *fields[5], *p, *save;
+	size_t len = 0;
+	int num;
+	FILE *fp;
+	if((fp = fopen(fname, "r")) == NULL) return -1;
+	while(getline(&line, &len, fp) != -1){
+		for(num=0, p=strtok_r(line, " \t\r\n", &save); p!=NULL && num<5; p=strtok_r(NULL, " \t\r\n", &save)) fields[num++] = p;
+		if(num != 4) continue;
+		int rc = strcmp(fields[0], fields[1]);
+		if(rc == 0) continue;
+		if(n == m){m = (m) ? m << 1 : 1024; recs = realloc(recs, m * sizeof(null_rec_t));}
+		recs[n].edge = (rc < 0) ? join(3, fields[0], "_", fields[1]) : join(3, fields[1], "_", fields[0]);
+		recs[n].val = atof(fields[3]);
+		n++;
+	}
+	if(line) free(line);
+	fclose(fp);
+	qsort(recs, n, sizeof(null_rec_t), null_rec_cmp);
+	for(i=0; i<n; i++){
+		if(i > 0 && strcmp(recs[i].edge, recs[i-1].edge) == 0) continue;
+		n_pair++;
+		l_names += strlen(recs[i].edge) + 1;
+	}
+	size = sizeof(nullmodel_hdr_t) + n_pair * sizeof(nullmodel_pair_t) + n * sizeof(float) + l_names;
+	null->map = mycalloc(size, uint8_t);
+	null->size = size;
+	hdr = (nullmodel_hdr_t*)null->map;
+	memcpy(hdr->magic, NULLMODEL_MAGIC, 8);
+	hdr->n_pair = n_pair;
+	hdr->n_rep = n_rep;
+	hdr->pair_off = sizeof(nullmodel_hdr_t);
+	hdr->val_off = hdr->pair_off + n_pair * sizeof(nullmodel_pair_t);
+	hdr->name_off = hdr->val_off + n * sizeof(float);
+	hdr->size = size;
+	pairs = (nullmodel_pair_t*)(null->map + hdr->pair_off);
+	vals = (float*)(null->map + hdr->val_off);
+	names = (char*)(null->map + hdr->name_off);
+	for(i=0, n_pair=0, l_names=0; i<n; i++){
+		if(i == 0 || strcmp(recs[i].edge, recs[i-1].edge) != 0){
+			pairs[n_pair].name_off = l_names;
+			pairs[n_pair].val_beg = i;
+			strcpy(names + l_names, recs[i].edge);
+			l_names += strlen(recs[i].edge) + 1;
+			n_pair++;
+		}
+		pairs[n_pair-1].val_num++;
+		vals[i] = recs[i].val;
+	}
+	for(i=0; i<n; i++) free(recs[i].edge);
+	if(recs) free(recs);
+	return 0;
+}
+
+/* n items of size bytes at off lie within an image of map_size bytes */
+static inline int null_span(uint64_t off, uint64_t n, uint64_t size, uint64_t map_size){
+	return off <= map_size && n <= (map_size - off) / size;
+}
+
+/* the tables of an image and every pair lie within it */
+static int null_check(const uint8_t *map, uint64_t size){
+	const nullmodel_hdr_t *hdr = (const nullmodel_hdr_t*)map;
+	const nullmodel_pair_t *pairs = (const nullmodel_pair_t*)(map + hdr->pair_off);
+	uint64_t i, n_val, l_names;
+	if(hdr->n_rep == 0 || hdr->pair_off % 8 || hdr->val_off % 4) return -1;
+	if(!null_span(hdr->pair_off, hdr->n_pair, sizeof(nullmodel_pair_t), size) || hdr->val_off > hdr->name_off || hdr->name_off > size) return -1;
+	n_val = (hdr->name_off - hdr->val_off) / sizeof(float);
+	l_names = size - hdr->name_off;
+	for(i=0; i<hdr->n_pair; i++){
+		if(pairs[i].val_beg > n_val || pairs[i].val_num > n_val - pairs[i].val_beg) return -1;
+		if(pairs[i].name_off >= l_names || memchr(map + hdr->name_off + pairs[i].name_off, 0, l_names - pairs[i].name_off) == NULL) return -1;
+	}
+	return 0;
+}
+
+/* map a file written by nullpack */
+static int null_map(null_t *null, const char *fname){
+	struct stat st;
+	if((null->fd = open(fname, O_RDONLY)) < 0 || fstat(null->fd, &st) != 0) return -1;
+	if(st.st_size < (off_t)sizeof(nullmodel_hdr_t)) return -1;
+	null->size = st.st_size;
+	if((null->map = mmap(NULL, null->size, PROT_READ, MAP_SHARED, null->fd, 0)) == MAP_FAILED){null->map = NULL; return -1;}
+	if(((const nullmodel_hdr_t*)null->map)->size != null->size) die("[%s] %s is truncated", __func__, fname);
+	if(null_check(null->map, null->size) != 0) die("[%s] %s is corrupt", __func__, fname);
+	return 0;
+}
+
+null_t *null_open(const char *fname){
+	if(fname == NULL) return NULL;
+	null_t *null;
+	char magic[8] = {0};
+	FILE *fp;
+	if((fp = fopen(fname, "rb")) == NULL) return NULL;
+	if(fread(magic, 1, 8, fp) != 8) magic[0] = 0;
+	fclose(fp);
+	null = mycalloc(1, null_t);
+	null->fd = -1;
+	if(((memcmp(magic, NULLMODEL_MAGIC, 8) == 0) ? null_map(null, fname) : null_text(null, fname, NULLMODEL_TEXT_REPS)) != 0){
+		null_close(null);
+		return NULL;
+	}
+	null_attach(null);
+	return null;
+}
+
+null_t *null_build(const char *fname, uint64_t n_rep){
+	if(fname == NULL || n_rep == 0) return NULL;
+	null_t *null = mycalloc(1, null_t);
+	null->fd = -1;
+	if(null_text(null, fname, n_rep) != 0){
+		null_close(null);
+		return NULL;
+	}
+	null_attach(null);
+	return null;
+}
+
+int null_write(const null_t *null, const char *out){
+	if(null == NULL || out == NULL) return -1;
+	FILE *fo;
+	if((fo = fopen(out, "wb")) == NULL) return -1;
+	if(fwrite(null->map, 1, null->size, fo) != null->size){fclose(fo); return -1;}
+	fclose(fo);
+	return 0;
+}
+
+uint64_t null_find(const null_t *null, const char *edge, const float **vals){
+	uint64_t lo = 0, hi, mid;
+	int rc;
+	*vals = NULL;
+	if(null == NULL || edge == NULL) return 0;
+	hi = null->hdr->n_pair;
+	while(lo < hi){
+		mid = lo + ((hi - lo) >> 1);
+		if((rc = strcmp(null->names + null->pairs[mid].name_off, edge)) == 0){
+			*vals = null->vals + null->pairs[mid].val_beg;
+			return null->pairs[mid].val_num;
+		}
+		if(rc < 0) lo = mid + 1; else hi = mid;
+	}
+	return 0;
+}
+
+float null_pvalue(const null_t *null, const char *edge, float x){
+	const float *vals;
+	uint64_t n, lo = 0, hi, mid;
+	if(null == NULL) return 1.0 / NULLMODEL_TEXT_REPS;
+	/* lower bound of x, every score from there on is at least x */
+	hi = n = null_find(null, edge, &vals);
+	while(lo < hi){
+		mid = lo + ((hi - lo) >> 1);
+		if(vals[mid] >= x) hi = mid; else lo = mid + 1;
+	}
+	return (float)(n - lo + 1) / null->hdr->n_rep;
+}
+
+void null_close(null_t *null){
+	if(null == NULL) return;
+	if(null->fd >= 0){
+		if(null->map) munmap((void*)null->map, null->size);
+		close(null->fd);
+	}else if(null->map){
+		free((void*)null->map);
+	}
+	free(null);
+}
+
+int nullpack_usage(){
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco nullpack <null.txt> <null.bin>\n\n");
+			fprintf(stderr, "Details: nullpack compiles a null model into a binary file that is memory\n");
+			fprintf(stderr, "         mapped by rapid, it is used in place of data/null.txt as data/null.bin\n\n");
+			fprintf(stderr, "Inputs:  null.txt         scores on simulated data, gene1 gene2 weight score per line\n");
+			fprintf(stderr, "         null.bin         compiled null model\n");
+			return 1;
+}
+
+int nullpack(int argc, char *argv[]) {
+	if (argc < 3) return nullpack_usage();
+	null_t *null;
+	fprintf(stderr, "[%s] compiling %s ... \n", __func__, argv[1]);
+	if((null = null_open(argv[1])) == NULL) die("[%s] can't read %s", __func__, argv[1]);
+	if(null_write(null, argv[2]) != 0) die("[%s] can't write %s", __func__, argv[2]);
+	fprintf(stderr, "[%s] %llu gene pairs, %llu simulations, %.1fKB\n", __func__, (unsigned long long)null->hdr->n_pair, (unsigned long long)null->hdr->n_rep, null->size/1024.0);
+	null_close(null);
+	return 0;
+}
@@ -0,0 +1,91 @@
+/*--------------------------------------------------------------------*/
+/* null_model.h                                                       */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Background distribution of fusion scores for p-values.             */
+/*--------------------------------------------------------------------*/
+/* The null model holds, for every gene pair, the scores of fusions   */
+/* called on simulated normal data. tafuco nullpack compiles the text */
+/* model (data/null.txt, gene1 gene2 weight score per line) into one  */
+/* binary image that is memory mapped at startup, scores of a pair    */
+/* are sorted so that a p-value is a binary search. Layout:           */
+/*   nullmodel_hdr_t                                                  */
+/*   nullmodel_pair_t[n_pair], sorted by name with strcmp             */
+/*   float scores, ascending within a pair                            */
+/*   pair names (gene1_gene2, gene1 < gene2), NUL terminated          */
+/* A text model is compiled into the same image in memory.            */
+/*--------------------------------------------------------------------*/
+
+#ifndef _NULL_MODEL_H
+#define _NULL_MODEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+
+#define NULLMODEL_MAGIC     "TFCNULL1"
+#define NULLMODEL_TEXT_REPS 200  /* simulations behind a text null model */
+
+typedef struct {
+	char magic[8];
+	uint64_t n_pair;
+	uint64_t n_rep;         /* number of simulations, the p-value denominator */
+	uint64_t pair_off;      /* file offset of nullmodel_pair_t[n_pair] */
+	uint64_t val_off;       /* file offset of the scores */
+	uint64_t name_off;      /* file offset of the names */
+	uint64_t size;          /* file size */
+} nullmodel_hdr_t;
+
+typedef struct {
+	uint64_t name_off;      /* offset of the name in the name block */
+	uint64_t val_beg;       /* first score of the pair */
+	uint64_t val_num;       /* number of scores */
+} nullmodel_pair_t;
+
+typedef struct {
+	const uint8_t *map;     /* the whole image */
+	size_t size;
+	int fd;                 /* -1 if the image is in memory */
+	const nullmodel_hdr_t *hdr;
+	const nullmodel_pair_t *pairs;
+	const float *vals;
+	const char *names;
+} null_t;
+
+/*
+ * open a null model, fname is a file written by nullpack or a text
+ * model, return NULL if fname can't be read.
+ */
+null_t *null_open(const char *fname);
+
+/* compile the text model fname of n_rep simulations, NULL on failure */
+null_t *null_build(const char *fname, uint64_t n_rep);
+
+/* write the image of null to out, return 0 on success */
+int null_write(const null_t *null, const char *out);
+
+/* ascending scores of gene pair edge, return the number of scores */
+uint64_t null_find(const null_t *null, const char *edge, const float **vals);
+
+/*
+ * p-value of score x of gene pair edge, the fraction of simulations
+ * scoring at least x counting x itself. 1/NULLMODEL_TEXT_REPS if null
+ * is NULL.
+ */
+float null_pvalue(const null_t *null, const char *edge, float x);
+
+void null_close(null_t *null);
+
+/*
+ * usage info
+ */
+int nullpack_usage();
+
+/*
+ * main function of tafuco nullpack
+ */
+int nullpack(int argc, char *argv[]);
+
+#endif
@@ -5,63 +5,100 @@
 /* Predict gene fusion between targeted genes.                        */
 /*--------------------------------------------------------------------*/
 
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <getopt.h>
 #include "predict.h"
 #include "name2fasta.h"
+#include "simulate.h"
+#include "shard.h"
+#include "checkpoint.h"
 
-static kmer_t *kmer_index(fasta_t *, int);
-static bag_t  *bag_construct(kmer_t *, gene_t **, char*, char*, int, int, int);
-static char *concat_exons(char* _read, fasta_t *fa_ht, kmer_t *kmer_ht, int _k, char *gname1, char* gname2, char** ename1, char** ename2, int *junction, int min_kmer_match);
+static bag_t  *bag_construct(kidx_t *, gene_t **, char*, char*, int, int, int, int, uint64_t, int, const fq_trim_t*, int*, FILE*, dup_t**, stats_t*);
+static bag_t  *bag_scan(kidx_t *, gene_t **, char*, char*, int, int, int, uint64_t, int, const fq_trim_t*, uint64_t*, uint64_t*, FILE*, dup_t**, int, stats_t*);
+static int     bag_order(bag_t **, kidx_t *, int, int, stats_t*);
+static char *concat_exons(const hit_run_t *run, int n_run, fasta_t *fa_ht, kidx_t *kmer_ht, char *gname1, char* gname2, char** ename1, char** ename2, int *junction, int min_kmer_match, exon_cache_t **cache, stats_t *st);
+static void exon_cache_destroy(exon_cache_t **cache);
 static int find_junction_one_edge(bag_t *eg, fasta_t *fasta_u, opt_t *opt, junction_t **ret);
-static int update_junction(junction_t **junc, solution_pair_t **sol_pair, opt_t *opt, char* fuse_name, char* junc_name);
-static int gene_order(char* gname1, char* gname2, char* read1, char* read2, kmer_t *kmer_ht, int k, int min_kmer_match);
+static int update_junction(junction_t **junc, solution_pair_t **sol_pair, opt_t *opt, bag_t *edge, char* junc_name, dup_t *dups, int pass, kidx_t *kmer_ht, const char *spill, stats_t *st);
+static int gene_order(char* gname1, char* gname2, const hit_prof_t *prof, int l1, kidx_t *kmer_ht, int min_kmer_match);
 static junction_t *transcript_construct_no_junc(char* gname1, char *gname2, fasta_t *fasta_ht);
 static junction_t *transcript_construct_junc(junction_t *junc_ht, fasta_t *exon_ht);
-static inline int find_all_genes(str_ctr **hash, kmer_t *KMER_HT, char* _read, int _k);
-static int update_fusion(bag_t **edge, solution_pair_t **res, opt_t *opt);
+static inline int find_all_genes(str_ctr **sense, str_ctr **anti, int *n_sense, int *n_anti, int *uniq, kidx_t *kmer_ht, char* _read, int _k, stats_t *st);
+static hit_prof_t *prof_pair(const int *uniq_a, int l_a, const int *uniq_b, int l_b, int _k);
+static int update_fusion(bag_t **edge, solution_pair_t **res, opt_t *opt, stats_t *st);
+static int fusion_call(pipe_t *p, int done, const uint64_t *hash);
 
-/*
- * Description:
- *------------
- * index input sequences by kmer hash table
+/* long options of predict and merge */
+#define OPT_STATS   256
+#define OPT_SAMPLES 257
+#define OPT_OUTDIR  258
+#define OPT_SOCKET  259
+#define OPT_STATUS  260
+#define OPT_STOP    261
+#define OPT_CKPT    262
+#define OPT_RESYNC  263
+#define OPT_ADAPTER 264
+#define OPT_TRIMQ   265
+#define OPT_ENTROPY 266
+#define OPT_RAWDEPTH 267
+static struct option LONG_OPTS[] = {
+	{"stats", required_argument, NULL, OPT_STATS},
+	{"checkpoint", required_argument, NULL, OPT_CKPT},
+	{"resync", required_argument, NULL, OPT_RESYNC},
+	{"adapter", required_argument, NULL, OPT_ADAPTER},
+	{"trim-qual", required_argument, NULL, OPT_TRIMQ},
+	{"min-entropy", required_argument, NULL, OPT_ENTROPY},
+	{"raw-depth", no_argument, NULL, OPT_RAWDEPTH},
+	{NULL, 0, NULL, 0}
+};
 
- * Input: 
- *-------
- * fa        - fasta_t hash table contains sequences to be indexed
- * k         - length of kmer
+/* long options of rapid */
+static struct option RAPID_LONG_OPTS[] = {
+	{"stats",   required_argument, NULL, OPT_STATS},
+	{"samples", required_argument, NULL, OPT_SAMPLES},
+	{"outdir",  required_argument, NULL, OPT_OUTDIR},
+	{"checkpoint", required_argument, NULL, OPT_CKPT},
+	{"resync",  required_argument, NULL, OPT_RESYNC},
+	{"adapter", required_argument, NULL, OPT_ADAPTER},
+	{"trim-qual", required_argument, NULL, OPT_TRIMQ},
+	{"min-entropy", required_argument, NULL, OPT_ENTROPY},
+	{"raw-depth", no_argument, NULL, OPT_RAWDEPTH},
+	{NULL, 0, NULL, 0}
+};
 
- * Output: 
- *-------
- * kmer_t object that contains kmer and its occurnace positions on input seq.
- */
-static kmer_t 
-*kmer_index(fasta_t *tb, int k){
-	if(tb == NULL || k <= 0 || k > MAX_KMER_LEN) return NULL;
-	register char *kmer;
-	char *name, *seq;	
-	register int i, j;
-	kmer_t *ret = NULL;
-	fasta_t *fa_cur = NULL;
-	for(fa_cur=tb; fa_cur!=NULL; fa_cur=fa_cur->hh.next){
-		name = seq = NULL;
-		seq = strToUpper(fa_cur->seq);
-		name = strdup(fa_cur->name);
-		if(seq == NULL || name == NULL || strlen(seq) <= k) continue;
-		for(i=0; i < strlen(seq)-k+1; i++){
-			kmer = NULL;
-			kmer = mycalloc(k+1, char);
-			memset(kmer, '\0', k+1);
-			strncpy(kmer, seq+i, k);
-			kmer[k] = '\0';
-			kmer_add(&ret, kmer, name); 
-			free(kmer);
-		}
-		if(seq)    free(seq);
-		if(name)   free(name);
-	}
-	kmer_uniq(&ret);
-	return ret;
-}
+/* long options of scan */
+static struct option SCAN_LONG_OPTS[] = {
+	{"resync",  required_argument, NULL, OPT_RESYNC},
+	{"adapter", required_argument, NULL, OPT_ADAPTER},
+	{"trim-qual", required_argument, NULL, OPT_TRIMQ},
+	{"min-entropy", required_argument, NULL, OPT_ENTROPY},
+	{NULL, 0, NULL, 0}
+};
+
+/* long options of serve and submit */
+static struct option SERVE_LONG_OPTS[] = {
+	{"socket", required_argument, NULL, OPT_SOCKET},
+	{"status", no_argument,       NULL, OPT_STATUS},
+	{"stop",   no_argument,       NULL, OPT_STOP},
+	{NULL, 0, NULL, 0}
+};
 
+/* count an alignment of s1 against s2 in st */
+static inline solution_t *stats_align(stats_t *st, solution_t *sol, char *s1, char *s2, double min_align_score){
+	st->align_tried++;
+	st->dp_cells += (uint64_t)strlen(s1) * strlen(s2);
+	if(sol != NULL && sol->prob >= min_align_score) st->align_passed++;
+	return sol;
+}
 
 /*
  * Description:
@@ -70,55 +107,112 @@ static kmer_t
 
  * Input: 
  *-------
- * kmer_ht            - kmer_t object returned by kmer_index
+ * kmer_ht            - kidx_t object returned by kidx_build
  * *gene_ht           - gene_t object that will store a gene is supported by # of reads
- * fq1                - fastq file that contains 5' to 3' read
- * fq2                - fastq file that contains the other end of read 
+ * fq1                - fastq file that contains 5' to 3' read, "-" for stdin
+ * fq2                - fastq file that contains the other end of read, NULL if fq1 is interleaved
  * min_kmer_matches   - min number kmer matches between a gene and read needed 
  * min_edge_weight    - edges in the graph with weight smaller than min_edge_weight will be deleted
  * k                  - length of kmer
+ * max_evidence       - max read pairs kept per edge, 0 keeps all
+ * seed               - seed of the reservoir sampling of kept read pairs
+ * resync             - reads looked ahead for the mate of an unpaired read, 0 dies on it
+ * trim               - adapter, quality and low complexity cleaning of reads before scanning
+ * flip               - set to 1 if most informative pairs have R1 on the positive strand
+ * spill              - if not NULL, pairs hitting any gene are written to it for the rescan
+ * dups               - if not NULL, set to the pairs with exact duplicates
+ * st                 - counters of the sample
  * Output: 
  *-------
  * BAG_uthash object that contains the graph.
  */
 static bag_t
-*bag_construct(kmer_t *kmer_ht, gene_t **gene_ht, char* fq1, char* fq2, int min_kmer_matches, int min_edge_weight, int _k){
-	if(kmer_ht==NULL || fq1==NULL || fq2==NULL || *gene_ht==NULL) return NULL;
+*bag_construct(kidx_t *kmer_ht, gene_t **gene_ht, char* fq1, char* fq2, int min_kmer_matches, int min_edge_weight, int _k, int max_evidence, uint64_t seed, int resync, const fq_trim_t *trim, int *flip, FILE *spill, dup_t **dups, stats_t *st){
+	bag_t *bag;
+	uint64_t pairs_std = 0, pairs_flip = 0;
+	if((bag = bag_scan(kmer_ht, gene_ht, fq1, fq2, min_kmer_matches, _k, max_evidence, seed, resync, trim, &pairs_std, &pairs_flip, spill, dups, 0, st)) == NULL) return NULL;
+	*flip = (pairs_flip > pairs_std);
+	if(pairs_flip > 0 && pairs_std > 0)
+		fprintf(stderr, "[%s] %llu informative pairs with R2 and %llu with R1 on the positive strand\n", __func__, (unsigned long long)pairs_std, (unsigned long long)pairs_flip);
+	if(bag_order(&bag, kmer_ht, _k, min_kmer_matches, st) != 0) return NULL;
+	return bag;
+}
+
+/*
+ * the first half of bag_construct, edges of every pair hitting two or
+ * more genes and the hits of genes. genes of an edge are not ordered,
+ * pairs_std and pairs_flip count informative pairs with R2 and R1 on 
+ * the positive strand. exact duplicates of a pair with hits are not
+ * scanned again and only counted in gene->dups and edge->n_dup. the
+ * pairs seen more than once are left in dup_ht if it is not NULL, every
+ * pair with hits with its gene and edges if all_pairs is set. kept pairs
+ * of edges keep their fq_hash.
+ */
+static bag_t
+*bag_scan(kidx_t *kmer_ht, gene_t **gene_ht, char* fq1, char* fq2, int min_kmer_matches, int _k, int max_evidence, uint64_t seed, int resync, const fq_trim_t *trim, uint64_t *pairs_std, uint64_t *pairs_flip, FILE *spill, dup_t **dup_ht, int all_pairs, stats_t *st){
+	if(kmer_ht==NULL || fq1==NULL || *gene_ht==NULL) return NULL;
 	/* variable declaration */
 	bag_t *bag = NULL;
-	gzFile fp1, fp2;
-	int l1, l2;
-	kseq_t *seq1, *seq2;
-	int i, num;
+	fq_pair_t *fq;
+	int i, num, ret;
 	char *_read1, *_read2, *edge_name;
 	char **hits;
-	str_ctr *s, *gene_counter;
+	str_ctr *s, *gene_counter, *flip_counter;
+	int hits_std, hits_flip, is_flip;
 	gene_t *gene_cur;
+	dup_t *dups = NULL, *d, *d_tmp;
+	uint64_t key[2];
+	int *uniq = NULL, m_uniq = 0;
+	hit_prof_t *prof;
 	/* file check */
-	if((fp1 = gzopen(fq1, "r"))==NULL) die("[%s] fail to read fastq files", __func__);
-	if((fp2 = gzopen(fq2, "r"))==NULL) die("[%s] fail to read fastq files", __func__);	
-	if((seq1 = kseq_init(fp1)) ==NULL)  die("[%s] fail to read fastq files", __func__);
-	if((seq2 = kseq_init(fp2)) ==NULL)  die("[%s] fail to read fastq files", __func__);
+	if((fq = fq_open(fq1, fq2, resync, trim))==NULL) die("[%s] fail to read fastq files", __func__);
 		
 	/* iterate read pair in both fastq files */
-	while ((l1 = kseq_read(seq1)) >= 0 && (l2 = kseq_read(seq2)) >= 0){
+	while ((ret = fq_read(fq)) >= 0){
+		st->pairs_scanned++;
 		_read1 = _read2 = edge_name = NULL;
-		gene_counter = NULL;
+		gene_counter = flip_counter = NULL;
 		hits = NULL;
-		_read1 = rev_com(seq1->seq.s); // reverse complement of read1
-		_read2 =  strdup(seq2->seq.s);
-			
-		if(_read1 == NULL || _read2 == NULL){
-			if(_read1) free(_read1);
-			if(_read2) free(_read2);
+		if(fq->l1 < _k || fq->l2 < _k) continue;
+		/* an exact duplicate of a pair with hits only adds to its counts */
+		fq_hash(fq, key);
+		HASH_FIND(hh, dups, key, sizeof(key), d);
+		if(d != NULL){
+			d->n++;
+			st->pairs_duplicate++;
+			if(d->gene) d->gene->dups++;
+			for(i=0; i<d->n_edge; i++) d->edge[i]->n_dup++;
+			if(d->n_edge > 0){if(d->flip) (*pairs_flip)++; else (*pairs_std)++; st->pairs_multi_gene++;}
+			continue;
 		}
-		if(strlen(_read1) < _k || strlen(_read2) < _k){
-			if(_read1) free(_read1);
-			if(_read2) free(_read2);	
+		/* 
+		 * the index is canonical, so both reads are scanned as they are. 
+		 * gene_counter assumes R2 on the positive strand (R1 antisense),
+		 * flip_counter assumes R1 on the positive strand (R2 antisense).
+		 */
+		hits_std = hits_flip = 0;
+		if(2 * (fq->l1 + fq->l2) > m_uniq){
+			m_uniq = 2 * (fq->l1 + fq->l2);
+			uniq = realloc(uniq, m_uniq * sizeof(int));
 		}
-		
-		find_all_genes(&gene_counter, kmer_ht, _read1, _k);
-		find_all_genes(&gene_counter, kmer_ht, _read2, _k);
+		find_all_genes(&flip_counter, &gene_counter, &hits_flip, &hits_std, uniq, kmer_ht, fq->r1, _k, st);
+		find_all_genes(&gene_counter, &flip_counter, &hits_std, &hits_flip, uniq + 2 * fq->l1, kmer_ht, fq->r2, _k, st);
+		if(hits_std + hits_flip == 0){
+			if(gene_counter) str_ctr_destory(&gene_counter);
+			if(flip_counter) str_ctr_destory(&flip_counter);
+			continue;
+		}
+		if(spill != NULL && fq_spill(spill, fq) != 0) die("[%s] fail to spill read pairs", __func__);
+		is_flip = (hits_flip > hits_std);
+		d = mycalloc(1, dup_t);
+		memcpy(d->key, key, sizeof(key));
+		d->n = 1;
+		d->flip = is_flip;
+		HASH_ADD(hh, dups, key, sizeof(key), d);
+		if(is_flip){
+			s = gene_counter; gene_counter = flip_counter; flip_counter = s;
+		}
+		if(flip_counter) str_ctr_destory(&flip_counter);
 		
 		// count hits of the gene
 		int max_hits = -10;
@@ -134,26 +228,40 @@ static bag_t
 		if(max_hits >= min_kmer_matches*2 && max_gene!=NULL){
 			if((gene_cur=find_gene(*gene_ht, max_gene))!=NULL){
 				gene_cur->hits++;
+				d->gene = gene_cur;
 			}			
 		}
 		
 		if((num = HASH_COUNT(gene_counter))<2){
-			if(_read1)       free(_read1);
-			if(_read2)       free(_read2);
 			if(gene_counter) str_ctr_destory(&gene_counter);
 			continue; 	
 		}
+		/* only informative pairs are turned to the positive strand */
+		if(is_flip){
+			_read1 = rev_com(fq->r2);
+			_read2 = strdup(fq->r1);
+		}else{
+			_read1 = rev_com(fq->r1);
+			_read2 = strdup(fq->r2);
+		}
 		hits = mycalloc(num, char*);
 		
 		///* filter genes that have matches with kmer less than min_kmer_matches */
 		i=0; for(s=gene_counter; s!=NULL; s=s->hh.next){if(s->SIZE >= min_kmer_matches){hits[i++] = strdup(s->KEY);}}
+		if(i >= 2){if(is_flip) (*pairs_flip)++; else (*pairs_std)++; st->pairs_multi_gene++;}
+		/* kmer hits of read1 and read2 as they are kept */
+		prof = (i >= 2) ? ((is_flip) ? prof_pair(uniq + 2 * fq->l1, fq->l2, uniq, fq->l1, _k) : prof_pair(uniq, fq->l1, uniq + 2 * fq->l1, fq->l2, _k)) : NULL;
 
 		int m, n; for(m=0; m < i; m++){for(n=m+1; n < i; n++){
 				int rc = strcmp(hits[m], hits[n]);
 				if(rc<0)  edge_name = concat(concat(hits[m], "_"), hits[n]);
 				if(rc>0)  edge_name = concat(concat(hits[n], "_"), hits[m]);
 				if(rc==0) edge_name = NULL;
-				if(edge_name!=NULL) if(bag_add(&bag, edge_name, seq1->name.s, concat(concat(_read1, "_"), _read2)) != 0) die("BAG_uthash_add fails\n");					
+				if(edge_name!=NULL){
+					if(bag_add(&bag, edge_name, fq->r_name, concat(concat(_read1, "_"), _read2), prof, key, max_evidence, seed) != 0) die("BAG_uthash_add fails\n");
+					d->edge = realloc(d->edge, (d->n_edge + 1) * sizeof(bag_t*));
+					d->edge[d->n_edge++] = find_edge(bag, edge_name);
+				}
 		}}
 		
 		// clean the mess up
@@ -166,24 +274,106 @@ static bag_t
 		}		
 		if(_read1)       free(_read1);
 		if(_read2)       free(_read2);
+		if(prof)         free(prof);
 		if(gene_counter) str_ctr_destory(&gene_counter);
 	}
+	if(uniq) free(uniq);
 	
-	// determine gene order by kmer matches
-	int order;
-	char** gnames;
-	bag_t *cur;
-	for(cur=bag; cur!=NULL; cur=cur->hh.next){
+	// clean the mess up
+	if(ret == -2) die("[%s] R1 and R2 out of step after %llu pairs, %s and %s (see --resync)", __func__, (unsigned long long)fq->n_pairs, fq->r_name, fq->r_name2);
+	if(fq->n_unpaired > 0) fprintf(stderr, "[%s] warning: %llu reads dropped without a mate\n", __func__, (unsigned long long)fq->n_unpaired);
+	if(fq->n_trimmed > 0 || fq->n_masked > 0) fprintf(stderr, "[%s] %llu bases trimmed and %llu reads masked\n", __func__, (unsigned long long)fq->n_trimmed, (unsigned long long)fq->n_masked);
+	HASH_ITER(hh, dups, d, d_tmp){
+		if(dup_ht != NULL && all_pairs) continue;
+		if(d->edge) free(d->edge);
+		d->edge = NULL; d->n_edge = 0; d->gene = NULL;
+		if(dup_ht != NULL && d->n > 1) continue;
+		HASH_DEL(dups, d);
+		free(d);
+	}
+	if(dup_ht != NULL) *dup_ht = dups;
+	st->reads_unpaired += fq->n_unpaired;
+	st->bases_trimmed += fq->n_trimmed;
+	st->reads_masked += fq->n_masked;
+	st->fastq_bytes += fq_tell(fq);
+	fq_close(fq);
+	return bag;
+}
+
+
+/* exon ename is an exon of gene gname, gname.N */
+static inline int exon_of(const char *ename, const char *gname){
+	size_t l = strlen(gname);
+	return strncmp(ename, gname, l)==0 && ename[l]=='.';
+}
+
+/* runs of the hits of strand j of a read of length l in uniq, reversed if rc */
+static inline int hit_runs(hit_run_t *run, const int *uniq, int l, int _k, int j, int rc){
+	int p, e, n = 0;
+	for(p=0; p<=l-_k; p++){
+		if((e = uniq[2*((rc) ? l-_k-p : p)+j]) < 0) continue;
+		if(n > 0 && run[n-1].exon == e && run[n-1].pos + run[n-1].len == p) run[n-1].len++;
+		else{run[n].exon = e; run[n].pos = p; run[n].len = 1; n++;}
+	}
+	return n;
+}
+
+/*
+ * hit profile of a pair kept as rev_com(a)_b from the hits of find_all_genes
+ * on a and b, the antisense hits of a and the sense hits of b.
+ */
+static hit_prof_t *prof_pair(const int *uniq_a, int l_a, const int *uniq_b, int l_b, int _k){
+	hit_prof_t *prof = malloc(sizeof(hit_prof_t) + (l_a + l_b) * sizeof(hit_run_t));
+	prof->n[0] = hit_runs(prof->run, uniq_a, l_a, _k, 1, 1);
+	prof->n[1] = hit_runs(prof->run + prof->n[0], uniq_b, l_b, _k, 0, 0);
+	return realloc(prof, sizeof(hit_prof_t) + (prof->n[0] + prof->n[1]) * sizeof(hit_run_t));
+}
+
+/* hit profile of the pair read1_read2 by scanning it */
+static hit_prof_t *prof_scan(const char *evidence, kidx_t *kmer_ht, int _k, stats_t *st){
+	int l1 = strchr(evidence, '_') - evidence;
+	int pos, strand, e, i, p, n = 0;
+	uint64_t kmer;
+	kmer_itr_t itr;
+	hit_prof_t *prof = malloc(sizeof(hit_prof_t) + strlen(evidence) * sizeof(hit_run_t));
+	hit_run_t *run = prof->run;
+	prof->n[0] = prof->n[1] = 0;
+	/* '_' stops kmers, so none of them spans both reads */
+	kmer_itr_init(&itr, evidence, _k);
+	while(kmer_itr_next(&itr, &pos, &kmer, &strand)){
+		st->kmer_probes++;
+		if((e=kidx_uniq_hit(kmer_ht, kmer, strand)) < 0) continue;
+		st->kmer_hits++;
+		i = (pos > l1);
+		p = (i) ? pos - l1 - 1 : pos;
+		if(prof->n[i] > 0 && run[n-1].exon == e && run[n-1].pos + run[n-1].len == p) run[n-1].len++;
+		else{run[n].exon = e; run[n].pos = p; run[n].len = 1; n++; prof->n[i]++;}
+	}
+	return realloc(prof, sizeof(hit_prof_t) + n * sizeof(hit_run_t));
+}
+
+/* hit profile of the i-th kept pair of edge e, scanned once if the scan didn't keep it */
+static inline hit_prof_t *bag_prof(bag_t *e, int i, kidx_t *kmer_ht, int _k, stats_t *st){
+	if(e->prof[i] == NULL) e->prof[i] = prof_scan(e->evidence[i], kmer_ht, _k, st);
+	return e->prof[i];
+}
+
+/*
+ * the second half of bag_construct, order the genes of every edge by
+ * the kmer hits of its pairs and remove duplicate pairs. edges without
+ * an order are dropped.
+ */
+static int
+bag_order(bag_t **bag, kidx_t *kmer_ht, int _k, int min_kmer_matches, stats_t *st){
+	int order, num = 0, i;
+	char **gnames;
+	bag_t *cur, *tmp;
+	HASH_ITER(hh, *bag, cur, tmp){
 		order = 0;
-		gnames = NULL;
-		gnames = strsplit(cur->edge, '_', &num); if(num!=2) continue;
-		for(i=0; i<cur->weight; i++){
-			hits = NULL;
-			hits = strsplit(cur->evidence[i], '_', &num);
-			if(num!=2) continue;
-			order += gene_order(gnames[0], gnames[1], hits[0], hits[1], kmer_ht, _k, min_kmer_matches);
-			if(hits){free(hits[0]); free(hits[1]);}
-		}
+		gnames = strsplit(cur->edge, '_', &num);
+		if(num!=2){for(i=0; i<num; i++) free(gnames[i]); free(gnames); continue;}
+		for(i=0; i<cur->n_evidence; i++)
+			order += gene_order(gnames[0], gnames[1], bag_prof(cur, i, kmer_ht, _k, st), strchr(cur->evidence[i], '_') - cur->evidence[i], kmer_ht, min_kmer_matches);
 		if(order > 0){
 			cur->gname1 = strdup(gnames[1]); 
 			cur->gname2 = strdup(gnames[0]);
@@ -192,57 +382,37 @@ static bag_t
 			cur->gname1 = strdup(gnames[0]); 
 			cur->gname2 = strdup(gnames[1]);
 		}
-		if(order == 0){HASH_DEL(bag, cur); free(cur);}		
-		if(gnames){free(gnames[0]); free(gnames[1]);}
+		if(order == 0){HASH_DEL(*bag, cur); free(cur);}		
+		free(gnames[0]); free(gnames[1]); free(gnames);
 	}
-	// clean the mess up
-	kseq_destroy(seq1);
-	kseq_destroy(seq2);	
-	gzclose(fp1);
-	gzclose(fp2);
-	
-	if(bag_uniq(&bag)!=0){
+	if(bag_uniq(bag)!=0){
 		fprintf(stderr, "[%s] fail to remove duplicate supportive reads \n", __func__);
-		return NULL;		
+		return -1;		
 	}
-	return bag;
+	return 0;
 }
 
 /*
- * determine the order of fusion genes.
- * negative means gene1 in front of gene1 from 5'-3'
+ * determine the order of fusion genes from the hit profile of a pair,
+ * l1 is the length of read1. negative means gene1 in front of gene1 
+ * from 5'-3'
  */
 static int 
-gene_order(char* gname1, char* gname2, char* read1, char* read2, kmer_t *kmer_ht, int k, int min_kmer_match){
-	if(gname1==NULL || gname2==NULL || read1==NULL || read2==NULL || kmer_ht==NULL) return 0;
-	register int i;
-	int *gene1 = mycalloc(strlen(read1)+strlen(read2), int);
-	int *gene2 = mycalloc(strlen(read1)+strlen(read2), int);
+gene_order(char* gname1, char* gname2, const hit_prof_t *prof, int l1, kidx_t *kmer_ht, int min_kmer_match){
+	if(gname1==NULL || gname2==NULL || prof==NULL || kmer_ht==NULL) return 0;
+	register int i, j;
+	const hit_run_t *r;
+	int n = 0;
+	for(i=0; i<prof->n[0]+prof->n[1]; i++) n += prof->run[i].len;
+	int gene1[n+1], gene2[n+1];
 	int gene1_pos = 0;	
 	int gene2_pos = 0;	
-	int num;
-	char* gname_tmp;
-	register kmer_t *kmer_cur;
-	char *buff = mycalloc(k+1, char);
-	for(i=0; i<strlen(read1)-k+1; i++){
-		memset(buff, '\0', k+1);
-		strncpy(buff, read1 + i, k); buff[k] = '\0';			
-		if((kmer_cur=find_kmer(kmer_ht, buff)) == NULL) continue;
-		if(kmer_cur->count == 1){  // uniq match
-			gname_tmp = strsplit(kmer_cur->seq_names[0], '.', &num)[0];
-			if(strcmp(gname_tmp, gname1)==0) gene1[gene1_pos++] = i;
-			if(strcmp(gname_tmp, gname2)==0) gene2[gene2_pos++] = i;
-		}
-	}
-	for(i=0; i<strlen(read2)-k+1; i++){
-		memset(buff, '\0', k+1);
-		strncpy(buff, read2 + i, k); buff[k] = '\0';			
-		if((kmer_cur=find_kmer(kmer_ht, buff)) == NULL) continue;
-		if(kmer_cur->count == 1){  // uniq match
-			gname_tmp = strsplit(kmer_cur->seq_names[0], '.', &num)[0];
-			if(strcmp(gname_tmp, gname1)==0) gene1[gene1_pos++] = i+strlen(read1);
-			if(strcmp(gname_tmp, gname2)==0) gene2[gene2_pos++] = i+strlen(read1);
-		}
+	int offset;
+	for(i=0; i<prof->n[0]+prof->n[1]; i++){
+		r = &prof->run[i];
+		offset = (i < prof->n[0]) ? 0 : l1;
+		if(exon_of(kmer_ht->names[r->exon], gname1)) for(j=0; j<r->len; j++) gene1[gene1_pos++] = r->pos+j+offset;
+		if(exon_of(kmer_ht->names[r->exon], gname2)) for(j=0; j<r->len; j++) gene2[gene2_pos++] = r->pos+j+offset;
 	}
 	int t = 0;
 	if(gene1_pos >= min_kmer_match && gene2_pos >= min_kmer_match){
@@ -256,73 +426,70 @@ gene_order(char* gname1, char* gname2, char* read1, char* read2, kmer_t *kmer_ht
 }
 
 /* 
- * Find all exons uniquely matched with kmers on _read.          
- * hash     - a hash table count number of matches between _read and every gene
- * _read    - inqury read
- * _k       - kmer length
+ * Find all exons uniquely matched with kmers of a read from its hits.          
+ * exon     - exons matched in the order they are first matched, at most max_exon
+ * cnt      - number of matches between the read and every exon
+ * run      - hit runs of the read
+ * returns the number of exons.
  */
 static inline int
-find_all_exons(str_ctr **hash, kmer_t *KMER_HT, char* _read, int _k){
-/*--------------------------------------------------------------------*/
-	/* check parameters */
-	if(_read == NULL || _k < 0) die("find_all_MEKMs: parameter error\n");
-/*--------------------------------------------------------------------*/
-	/* declare vaiables */
-	int _read_pos = 0;
-	char* exon = NULL;
-	register kmer_t *s_kmer = NULL; 
-	char *buff = mycalloc(_k+1, char);
-/*--------------------------------------------------------------------*/
-	while(_read_pos<(strlen(_read)-_k+1)){
-		/* copy a kmer of string */
-		memset(buff, '\0', _k+1);
-		strncpy(buff, _read + _read_pos, _k); buff[_k] = '\0';	
-		if(strlen(buff) != _k) continue;
-		/*------------------------------------------------------------*/
-		if((s_kmer=find_kmer(KMER_HT, buff)) == NULL){_read_pos++; continue;} // kmer not in table but not an error
-		if(s_kmer->count == 1){str_ctr_add(hash, s_kmer->seq_names[0]);}
-		_read_pos++;
-	}
-	if(buff)    free(buff);
-	return 0;
+find_all_exons(int *exon, int *cnt, int max_exon, const hit_run_t *run, int n_run){
+	int i, j, n = 0;
+	for(j=0; j<n_run; j++){
+		for(i=0; i<n && exon[i]!=run[j].exon; i++);
+		if(i < n){cnt[i] += run[j].len; continue;}
+		if(n == max_exon) continue;
+		exon[n] = run[j].exon; cnt[n++] = run[j].len;
+	}
+	return n;
 }
+
 /*
  * Find all genes uniquely matched with kmers on _read.          
- * hash     - a hash table count number of matches between _read and every gene
+ * sense    - a hash table count number of matches between _read and every gene
+ * anti     - same as sense but for the reverse complement of _read
+ * n_sense  - incremented by the number of kmers counted in sense
+ * n_anti   - incremented by the number of kmers counted in anti
+ * uniq     - the exon uniquely hit by the kmer at every position of _read
+ *            on either strand, uniq[2*pos+strand], -1 for none
  * _read    - inqury read
  * _k       - kmer length
  */
 static inline int
-find_all_genes(str_ctr **hash, kmer_t *kmer_ht, char* _read, int _k){
+find_all_genes(str_ctr **sense, str_ctr **anti, int *n_sense, int *n_anti, int *uniq, kidx_t *kmer_ht, char* _read, int _k, stats_t *st){
 	/* check parameters */
 	if(_read == NULL || kmer_ht == NULL || _k < 0) die("[%s]: parameter error\n", __func__);
 	/* declare vaiables */
-	str_ctr *s;
-	int _read_pos = 0;
-	int num;
-	kmer_t *s_kmer = NULL; 
-	char buff[_k];
+	int _read_pos, strand, exon;
+	int num, count;
+	uint64_t kmer;
+	const uint32_t *post;
 	char** fields = NULL;
-	int i;
+	int i, j;
+	kmer_itr_t itr;
 /*--------------------------------------------------------------------*/
-	while(_read_pos<(strlen(_read)-_k+1)){
-	//	/* copy a kmer of string */
-		strncpy(buff, _read + _read_pos, _k); buff[_k] = '\0';	
-		if(strlen(buff) != _k) continue;
-		if((s_kmer=find_kmer(kmer_ht, buff)) == NULL){_read_pos++; continue;} // kmer not in table but not an error
-		if(s_kmer->count == 1){ // only count the uniq match 
-			fields = strsplit(s_kmer->seq_names[0], '.', &num);
-			if(num!=2) continue;
-			str_ctr_add(hash, fields[0]);
+	for(i=2*strlen(_read)-1; i>=0; i--) uniq[i] = -1;
+	kmer_itr_init(&itr, _read, _k);
+	while(kmer_itr_next(&itr, &_read_pos, &kmer, &strand)){
+		st->kmer_probes++;
+		if((count=kidx_get(kmer_ht, kmer, &post)) == 0) continue; // kmer not in table but not an error
+		st->kmer_hits++;
+		for(j=0; j<2; j++){ // only count the uniq match on either strand
+			if((exon=kmer_uniq_hit(post, count, strand^j)) < 0) continue;
+			uniq[2*_read_pos+j] = exon;
+			fields = strsplit(kmer_ht->names[exon], '.', &num);
+			if(num==2){
+				str_ctr_add((j==0) ? sense : anti, fields[0]);
+				(*((j==0) ? n_sense : n_anti))++;
+			}
 			if(fields) {for(i=0; i<num; i++) free(fields[i]); free(fields);}
 		}
-		_read_pos++;
 	}	
 	return 0;
 }
 
 static junction_t
-*edge_junction_gen(bag_t *eg, fasta_t *fasta_u, kmer_t *kmer_ht, opt_t *opt){
+*edge_junction_gen(bag_t *eg, fasta_t *fasta_u, kidx_t *kmer_ht, opt_t *opt, stats_t *st){
 	if(eg==NULL || fasta_u==NULL || opt==NULL) return NULL;
 	/* variables */
 	int _k = opt->k;
@@ -339,23 +506,25 @@ static junction_t
 	gname2 = eg->gname2;
 	if(gname1==NULL || gname2==NULL) return NULL;
 	register int i, j;
-	register kmer_t *s_kmer; 
 	solution_t *sol1, *sol2;           /* alignment solution for read1 and read2 */
 	int start1, start2;
 	int junc_pos;                               /* position of junction */
 	int strlen2;
 	char** fields;
 	junction_t *m, *n, *ret = NULL;
+	exon_cache_t *cache = NULL;
+	hit_prof_t *prof;
 	
-	for(i=0; i<eg->weight; i++){
+	for(i=0; i<eg->n_evidence; i++){
 		fields = NULL;
 		fields = strsplit(eg->evidence[i], '_', &num);
 		if(num!=2) continue;
 		if(fields[0]==NULL || fields[1]==NULL) continue;
 		sol1 = sol2 = NULL;
 		/* string concatnated by exon sequences of two genes */
-		if((str1 =  concat_exons(fields[0], fasta_u, kmer_ht, _k, gname1, gname2, &ename1, &ename2, &junc_pos, opt->min_kmer_match))!=NULL){
-			if((sol1 =align(fields[0], str1, junc_pos, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_gene))!=NULL){
+		prof = bag_prof(eg, i, kmer_ht, _k, st);
+		if((str1 =  concat_exons(prof->run, prof->n[0], fasta_u, kmer_ht, gname1, gname2, &ename1, &ename2, &junc_pos, opt->min_kmer_match, &cache, st))!=NULL){
+			if((sol1 = stats_align(st, align(fields[0], str1, junc_pos, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_gene), fields[0], str1, opt->min_align_score))!=NULL){
 				if(sol1->jump == true && sol1->prob >= opt->min_align_score){
 					/* idx = exon1.start.exon2.end (uniq id)*/
 					idx = concat(concat(ename1, "."), ename2); // idx for junction
@@ -386,16 +555,16 @@ static junction_t
 			}
 		}
 
-		if((str2 =  concat_exons(fields[1], fasta_u, kmer_ht, _k, gname1, gname2, &ename1, &ename2, &junc_pos, opt->min_kmer_match))!=NULL){
-			if((sol2 = align(fields[1], str2, junc_pos, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_gene))!=NULL){
+		if((str2 =  concat_exons(prof->run + prof->n[0], prof->n[1], fasta_u, kmer_ht, gname1, gname2, &ename1, &ename2, &junc_pos, opt->min_kmer_match, &cache, st))!=NULL){
+			if((sol2 = stats_align(st, align(fields[1], str2, junc_pos, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_gene), fields[1], str2, opt->min_align_score))!=NULL){
 				if(sol2->jump == true && sol2->prob >= opt->min_align_score){			
 					idx = concat(concat(ename1, "."), ename2); // idx for junction
 					HASH_FIND_STR(ret, idx, m);
 					if(m==NULL){ // this junction not in ret
 						m = junction_init(opt->seed_len);				
 						m->idx   = idx;
-						m->exon1  = ename1;
-						m->exon2  = ename2;				
+						m->exon1  = strdup(ename1);
+						m->exon2  = strdup(ename2);				
 						m->hits  = 1;
 						m->likehood = 10*log(sol2->prob); 				
 						memcpy( m->s, &str2[sol2->jump_start-opt->seed_len/2-1], opt->seed_len/2);
@@ -427,10 +596,7 @@ static junction_t
 			}
 		}
 	}
-	if(ename1)         free(ename1);
-	if(ename2)         free(ename2);
-	if(str1)           free(str1);
-	if(str2)           free(str2);
+	exon_cache_destroy(&cache);
 	if(sol1)           solution_destory(&sol1);
 	if(sol2)           solution_destory(&sol2);
 	if(idx)            free(idx);
@@ -550,13 +716,13 @@ static junction_t
  * generate junction string of every edge based on supportive reads.
  */
 static int
-bag_junction_gen(bag_t **bag, fasta_t *fa, kmer_t *kmer, opt_t *opt){
+bag_junction_gen(bag_t **bag, fasta_t *fa, kidx_t *kmer, opt_t *opt, stats_t *st){
 	if(*bag==NULL || fa==NULL || opt==NULL) return -1;	
 	bag_t *edge, *bag_cur;
 	register int i;
 	junction_t *junc_cur;
 	for(edge=*bag; edge!=NULL; edge=edge->hh.next) {
-		if((junc_cur = edge_junction_gen(edge, fa, kmer, opt))==NULL){ // no junction detected
+		if((junc_cur = edge_junction_gen(edge, fa, kmer, opt, st))==NULL){ // no junction detected
 			edge->junc_flag = false;
 			edge->junc = NULL;
 		}else{
@@ -586,61 +752,92 @@ bag_transcript_gen(bag_t **bag, fasta_t *fa, opt_t *opt){
 	}   
 	return 0;
 }
+static void exon_cache_destroy(exon_cache_t **cache){
+	exon_cache_t *c, *tmp;
+	HASH_ITER(hh, *cache, c, tmp){
+		HASH_DEL(*cache, c);
+		free(c->key);
+		free(c->seq);
+		free(c);
+	}
+}
+
 /*
- * construct concatnated exon string based on kmer matches
+ * construct concatnated exon string based on the kmer hits of a read, the string,
+ * ename1 and ename2 belong to cache and are only valid until the next
+ * call with it. reads of an edge hitting the same exons of both genes
+ * share the string.
  */
 static char 
-*concat_exons(char* _read, fasta_t *fa_ht, kmer_t *kmer_ht, int _k, char *gname1, char* gname2, char** ename1, char** ename2, int *junc_pos, int min_kmer_match){
-	if(_read == NULL || fa_ht == NULL || kmer_ht==NULL || gname1==NULL || gname2==NULL) return NULL;
+*concat_exons(const hit_run_t *run, int n_run, fasta_t *fa_ht, kidx_t *kmer_ht, char *gname1, char* gname2, char** ename1, char** ename2, int *junc_pos, int min_kmer_match, exon_cache_t **cache, stats_t *st){
+	if(run == NULL || fa_ht == NULL || kmer_ht==NULL || gname1==NULL || gname2==NULL) return NULL;
 	/* variables */
-	char *str1, *str2, *gname_cur;
-	*ename1 = *ename2 = str1 = str2 = gname_cur = NULL;
-	int num_tmp;
-	char buff[_k];
-	str_ctr *s_ctr, *exons=NULL;
-	fasta_t *fa_tmp = NULL;
+	int l = n_run + 1;
+	int exon[l], cnt[l], key[l+2];
+	int i, j, n, n1, n2, len1, len2;
+	exon_cache_t *c;
+	fasta_t *fa_tmp;
+	*ename1 = *ename2 = NULL;
 	/* find all exons that uniquely match with gene by kmer */
-	find_all_exons(&exons, kmer_ht, _read, _k);
-	if(exons==NULL) return NULL; // no exon found
-	for(s_ctr=exons; s_ctr!=NULL; s_ctr=s_ctr->hh.next){
-		if(s_ctr->SIZE >= min_kmer_match){ //denoise
-			gname_cur = strsplit(s_ctr->KEY, '.', &num_tmp)[0]; // name of gene
-			// extract string of gene1
-			if(strcmp(gname_cur, gname1)==0){
-				fa_tmp = find_fasta(fa_ht, s_ctr->KEY);
-				if(str1 == NULL){
-					str1 = strdup(fa_tmp->seq);
-					*ename1 = strdup(s_ctr->KEY);
-				}else{
-					*ename1 = strdup(s_ctr->KEY);
-					str1 = concat(str1, fa_tmp->seq);
-				}				
-			}
-			// extract string of gene2
-			if(strcmp(gname_cur, gname2)==0){
-				fa_tmp = find_fasta(fa_ht, s_ctr->KEY);
-				if(str2 == NULL){
-					str2 = strdup(fa_tmp->seq);
-					*ename2 = strdup(s_ctr->KEY);
-				}else{
-					str2 = concat(str2, fa_tmp->seq);
-				}				
-			}
+	if((n = find_all_exons(exon, cnt, l, run, n_run))==0) return NULL; // no exon found
+	for(i=n1=0; i<n; i++) //denoise
+		if(cnt[i] >= min_kmer_match && exon_of(kmer_ht->names[exon[i]], gname1)) key[1+n1++] = exon[i];
+	for(i=n2=0; i<n; i++)
+		if(cnt[i] >= min_kmer_match && exon_of(kmer_ht->names[exon[i]], gname2)) key[2+n1+n2++] = exon[i];
+	if(n1 == 0 || n2 == 0) return NULL; // only if two genes identified
+	key[0] = n1; key[1+n1] = n2;
+	n = (n1 + n2 + 2) * sizeof(int);
+	HASH_FIND(hh, *cache, key, n, c);
+	if(c != NULL){
+		/* most recently used go to the end */
+		HASH_DELETE(hh, *cache, c);
+		HASH_ADD_KEYPTR(hh, *cache, c->key, c->l_key, c);
+		st->exon_cache_hits++;
+	}else{
+		/* exons of gene1 then gene2 in one go */
+		for(i=len1=0; i<n1; i++){
+			if((fa_tmp = find_fasta(fa_ht, kmer_ht->names[key[1+i]]))==NULL) return NULL;
+			len1 += strlen(fa_tmp->seq);
+		}
+		for(i=len2=0; i<n2; i++){
+			if((fa_tmp = find_fasta(fa_ht, kmer_ht->names[key[2+n1+i]]))==NULL) return NULL;
+			len2 += strlen(fa_tmp->seq);
+		}
+		c = mycalloc(1, exon_cache_t);
+		c->key = mycalloc(n1 + n2 + 2, int);
+		memcpy(c->key, key, n);
+		c->l_key = n;
+		c->seq = mycalloc(len1 + len2 + 1, char);
+		for(i=j=0; i<n1+n2; i++){
+			fa_tmp = find_fasta(fa_ht, kmer_ht->names[key[(i < n1) ? 1+i : 2+i]]);
+			l = strlen(fa_tmp->seq);
+			memcpy(&c->seq[j], fa_tmp->seq, l);
+			j += l;
+		}
+		c->junc_pos = len1;
+		c->ename1 = kmer_ht->names[key[n1]];
+		c->ename2 = kmer_ht->names[key[2+n1]];
+		HASH_ADD_KEYPTR(hh, *cache, c->key, c->l_key, c);
+		if(HASH_COUNT(*cache) > EXON_CACHE_SIZE){
+			/* least recently used is the first */
+			exon_cache_t *lru = *cache;
+			HASH_DELETE(hh, *cache, lru);
+			free(lru->key);
+			free(lru->seq);
+			free(lru);
 		}
 	}
-	if(gname_cur)     free(gname_cur);
-	if(exons)         str_ctr_destory(&exons);
-	if(str1 == NULL || str2 == NULL) return NULL; // only if two genes identified
-	char *ret = concat(str1, str2);
-	*junc_pos = strlen(str1);	
-	return ret;
+	*ename1 = c->ename1;
+	*ename2 = c->ename2;
+	*junc_pos = c->junc_pos;
+	return c->seq;
 }
 
-static int test_fusion(solution_pair_t **res, bag_t **bag, opt_t *opt){
+static int test_fusion(solution_pair_t **res, bag_t **bag, opt_t *opt, stats_t *st){
 	if(*bag==NULL || opt==NULL) return -1;
 	bag_t *edge;
 	for(edge=*bag; edge!=NULL; edge=edge->hh.next){		
-		if((update_fusion(&edge, res, opt))!=0) return -1;
+		if((update_fusion(&edge, res, opt, st))!=0) return -1;
 	}
 	return 0;
 }
@@ -649,11 +846,11 @@ static int test_fusion(solution_pair_t **res, bag_t **bag, opt_t *opt){
  * align supportive reads of every edge to edge's constructed transcript
  */
 static int 
-update_fusion(bag_t **edge, solution_pair_t **res, opt_t *opt){
+update_fusion(bag_t **edge, solution_pair_t **res, opt_t *opt, stats_t *st){
 	if(*edge==NULL || opt==NULL) return -1;
 	char* junc_name = NULL;
-	int weight = (*edge)->weight;
-	(*edge)->weight = (*edge)->likehood = 0;
+	int weight = (*edge)->n_evidence;
+	(*edge)->likehood = 0;
 	int num, rc;
 	register int i, j;
 	solution_t *sol1, *sol2; sol1 = sol2 = NULL;
@@ -674,9 +871,9 @@ update_fusion(bag_t **edge, solution_pair_t **res, opt_t *opt){
 		/* iterate every junction then */
 		for(junc_cur=(*edge)->junc; junc_cur!=NULL; junc_cur=junc_cur->hh.next){
 			/* release every memory used */
-			if((sol1 = align_exon_jump(read1, junc_cur->transcript, junc_cur->S1, junc_cur->S2, junc_cur->S1_num, junc_cur->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon))==NULL) continue;
+			if((sol1 = stats_align(st, align_exon_jump(read1, junc_cur->transcript, junc_cur->S1, junc_cur->S2, junc_cur->S1_num, junc_cur->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon), read1, junc_cur->transcript, opt->min_align_score))==NULL) continue;
 			if(sol1->prob < opt->min_align_score){solution_destory(&sol1); continue;}
-			if((sol2 = align_exon_jump(read2, junc_cur->transcript, junc_cur->S1, junc_cur->S2, junc_cur->S1_num, junc_cur->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon))==NULL) continue;			
+			if((sol2 = stats_align(st, align_exon_jump(read2, junc_cur->transcript, junc_cur->S1, junc_cur->S2, junc_cur->S1_num, junc_cur->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon), read2, junc_cur->transcript, opt->min_align_score))==NULL) continue;			
 			if(sol2->prob < opt->min_align_score){solution_destory(&sol2); continue;}
 			
 			if(sol_cur!=NULL){ // if exists and update if align score is high enough
@@ -722,101 +919,149 @@ update_fusion(bag_t **edge, solution_pair_t **res, opt_t *opt){
  *-------
  * solution_pair_t object that contains alignment results of all reads.
  */
-static int test_junction(solution_pair_t **res, bag_t **bag, opt_t *opt){
+static int test_junction(solution_pair_t **res, bag_t **bag, opt_t *opt, dup_t *dups, kidx_t *kmer_ht, const char *spill, stats_t *st){
 	if(*bag==NULL || opt==NULL) return -1;
 	bag_t *bag_cur;
 	junction_t *junc_cur;
 	char* junc_name;
+	int pass = 0;
 	for(bag_cur=*bag; bag_cur!=NULL; bag_cur=bag_cur->hh.next){		
 		if(bag_cur->junc_flag==false) continue;
-		fprintf(stderr, "[predict] junctions between %s and %s is being tested ... \n", bag_cur->gname1, bag_cur->gname2);		
+		if(opt->verbose) fprintf(stderr, "[predict] junctions between %s and %s is being tested ... \n", bag_cur->gname1, bag_cur->gname2);		
 		for(junc_cur=bag_cur->junc; junc_cur!=NULL; junc_cur=junc_cur->hh.next){
 			if(junc_cur->s==NULL || junc_cur->transcript==NULL || junc_cur->S1==NULL ||  junc_cur->S2==NULL) continue;
 			junc_name = (bag_cur->junc_flag==true) ? junc_cur->idx : NULL;
-			if((update_junction(&junc_cur, res, opt, bag_cur->edge, junc_name))!=0) return -1;
+			if((update_junction(&junc_cur, res, opt, bag_cur, junc_name, dups, ++pass, kmer_ht, spill, st))!=0) return -1;
 		}
 	}
 	return 0;
 }
 
 
+/*
+ * align one pair to a junction transcript and keep the solution if it
+ * is the best of the pair so far. read1 is the reverse complement of 
+ * the antisense read, read2 the sense read.
+ */
+static void junction_pair(junction_t *junc, solution_pair_t **sol_pair, opt_t *opt, char* fuse_name, char* junc_name, char *name, char *_read1, char *_read2, stats_t *st){
+	solution_t *sol1, *sol2;
+	solution_pair_t *s_sp;
+	// alignment with jump state between exons 
+	if((sol1 = stats_align(st, align_exon_jump(_read1, junc->transcript, junc->S1, junc->S2, junc->S1_num, junc->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon), _read1, junc->transcript, opt->min_align_score))==NULL) return;
+	if(sol1->prob < opt->min_align_score){ solution_destory(&sol1); return;}
+	if((sol2 = stats_align(st, align_exon_jump(_read2, junc->transcript, junc->S1, junc->S2, junc->S1_num, junc->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon), _read2, junc->transcript, opt->min_align_score))==NULL){solution_destory(&sol1); return;}
+	if(sol2->prob < opt->min_align_score){solution_destory(&sol1); solution_destory(&sol2); return;}
+	s_sp = find_solution_pair(*sol_pair, name);
+	if(s_sp!=NULL){ // if exists
+		if(s_sp->prob < sol1->prob*sol2->prob){
+			junc->hits ++;
+			junc->likehood += 10*log(sol1->prob); 				
+			junc->likehood += 10*log(sol2->prob);
+			s_sp->r1 = sol1; s_sp->r2=sol2; 
+			s_sp->prob = (sol1->prob)*(sol2->prob); 
+			s_sp->junc_name = strdup(junc_name);
+			s_sp->fuse_name = strdup(fuse_name);		
+		}else{
+			if(sol1) solution_destory(&sol1);
+			if(sol2) solution_destory(&sol2);	
+		}
+	}else{
+		junc->hits ++;
+		junc->likehood += 10*log(sol1->prob); 				
+		junc->likehood += 10*log(sol2->prob); 				
+		s_sp = solution_pair_init();
+		s_sp->idx = strdup(name); 
+		s_sp->junc_name = strdup(junc_name);
+		s_sp->fuse_name = strdup(fuse_name);				
+		s_sp->r1 = sol1;			
+		s_sp->r2 = sol2;
+		s_sp->prob = sol1->prob*sol2->prob;
+		HASH_ADD_STR(*sol_pair, idx, s_sp);
+	}
+}
+
+/*
+ * 1 if bag_scan adds the pair of fq to edge, both of its genes are hit by
+ * min_kmer_match kmers of the pair on the strand with the most hits.
+ */
+static int pair_on_edge(fq_pair_t *fq, bag_t *edge, kidx_t *kmer_ht, int _k, int min_kmer_match, stats_t *st){
+	str_ctr *gene_counter = NULL, *flip_counter = NULL, *s1, *s2;
+	int hits_std = 0, hits_flip = 0, ret;
+	int *uniq;
+	if(fq->l1 < _k || fq->l2 < _k) return 0;
+	uniq = mycalloc(2 * (fq->l1 + fq->l2), int);
+	find_all_genes(&flip_counter, &gene_counter, &hits_flip, &hits_std, uniq, kmer_ht, fq->r1, _k, st);
+	find_all_genes(&gene_counter, &flip_counter, &hits_std, &hits_flip, uniq + 2 * fq->l1, kmer_ht, fq->r2, _k, st);
+	s1 = find_str_ctr((hits_flip > hits_std) ? flip_counter : gene_counter, edge->gname1);
+	s2 = find_str_ctr((hits_flip > hits_std) ? flip_counter : gene_counter, edge->gname2);
+	ret = (s1 != NULL && s2 != NULL && s1->SIZE >= min_kmer_match && s2->SIZE >= min_kmer_match);
+	if(gene_counter) str_ctr_destory(&gene_counter);
+	if(flip_counter) str_ctr_destory(&flip_counter);
+	free(uniq);
+	return ret;
+}
+
 /*
  * align reads to one junction transcript
 
  * junc      - one junction identified before
  * opt       - opt_t object
+ * edge      - the edge of junc, its own pairs are skipped if they are a sample
  * *sol_pair - solution_pair_t object that contains alignment solutions for all read pair agains junc
+ * dups      - pairs with exact duplicates, one copy is aligned in pass
+ * kmer_ht   - kmer index to tell the pairs of a sampled edge
+ * spill     - if not NULL, pairs already cleaned by bag_scan are read from it
 
  */
-static int update_junction(junction_t **junc, solution_pair_t **sol_pair, opt_t *opt, char* fuse_name, char* junc_name){
-	if(*junc==NULL || opt==NULL || fuse_name==NULL) return -1;
+static int update_junction(junction_t **junc, solution_pair_t **sol_pair, opt_t *opt, bag_t *edge, char* junc_name, dup_t *dups, int pass, kidx_t *kmer_ht, const char *spill, stats_t *st){
+	if(*junc==NULL || opt==NULL || edge==NULL) return -1;
 	// junction
 	(*junc)->hits     = 0;
 	(*junc)->likehood = 0;
 
-	gzFile fp1, fp2;
-	int l1, l2;
-	kseq_t *seq1, *seq2;
+	fq_pair_t *fq;
+	int ret, sampled = BAG_SAMPLED(edge, opt);
 	register char *_read1, *_read2;
-	solution_t *sol1, *sol2;
-	sol1 = sol2 = NULL;
-	solution_pair_t *s_sp, *tmp_sp;
-	if((fp1  = gzopen(opt->fq1, "r")) == NULL)   die("[%s] fail to read fastq files\n",  __func__);
-	if((fp2  = gzopen(opt->fq2, "r")) == NULL)   die("[%s] fail to read fastq files\n",  __func__);	
-	if((seq1 = kseq_init(fp1))   == NULL)        die("[%s] fail to read fastq files\n",  __func__);
-	if((seq2 = kseq_init(fp2))   == NULL)        die("[%s] fail to read fastq files\n",  __func__);	
+	char *junc_rc, *seq_sense, *seq_anti;
+	uint64_t key[2];
+	dup_t *d;
+	fq = (spill != NULL) ? fq_open(spill, NULL, 0, NULL) : fq_open(opt->fq1, opt->fq2, opt->resync, &opt->trim);
+	if(fq == NULL) die("[%s] fail to read fastq files\n",  __func__);
+	/* 
+	 * instead of turning every R1 to the positive strand, match the raw 
+	 * antisense read against the reverse complement of the junction string.
+	 */
+	if((junc_rc = rev_com((*junc)->s)) == NULL) return -1;
 	
-	while ((l1 = kseq_read(seq1)) >= 0 && (l2 = kseq_read(seq2)) >= 0 ) {
-		_read1 = rev_com(seq1->seq.s); // reverse complement of read1
-		_read2 = strdup(seq2->seq.s);		
-		if(_read1 == NULL || _read2 == NULL){
+	while ((ret = fq_read(fq)) >= 0) {
+		st->pairs_rescanned++;
+		seq_sense = (opt->flip) ? fq->r1 : fq->r2;
+		seq_anti  = (opt->flip) ? fq->r2 : fq->r1;
+		if((min_mismatch(seq_anti, junc_rc)) <= opt->max_mismatch || (min_mismatch(seq_sense, (*junc)->s)) <= opt->max_mismatch ){	
+			/* the copies of a pair collapsed by bag_scan are aligned once */
+			if(dups != NULL){
+				fq_hash(fq, key);
+				HASH_FIND(hh, dups, key, sizeof(key), d);
+				if(d != NULL && d->pass == pass) continue;
+				if(d != NULL) d->pass = pass;
+			}
+			/*
+			 * the pairs of a sampled edge are only aligned by test_fusion
+			 * from its kept sample, pairs spanning the junction without
+			 * hitting both genes are all aligned here.
+			 */
+			if(sampled && pair_on_edge(fq, edge, kmer_ht, opt->k, opt->min_kmer_match, st)) continue;
+			_read1 = rev_com(seq_anti); // reverse complement of the antisense read
+			_read2 = strdup(seq_sense);		
+			if(_read1 != NULL && _read2 != NULL) junction_pair(*junc, sol_pair, opt, edge->edge, junc_name, fq->r_name, _read1, _read2, st);
 			if(_read1)  free(_read1);
 			if(_read2)  free(_read2);
-			continue;	
 		}
-		if((min_mismatch(_read1, (*junc)->s)) <= opt->max_mismatch || (min_mismatch(_read2, (*junc)->s)) <= opt->max_mismatch ){	
-			// alignment with jump state between exons 
-			if((sol1 = align_exon_jump(_read1, (*junc)->transcript, (*junc)->S1, (*junc)->S2, (*junc)->S1_num, (*junc)->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon))==NULL) continue;
-			if(sol1->prob < opt->min_align_score){ solution_destory(&sol1); continue;}
-			if((sol2 = align_exon_jump(_read2, (*junc)->transcript, (*junc)->S1, (*junc)->S2, (*junc)->S1_num, (*junc)->S2_num, opt->match, opt->mismatch, opt->gap, opt->extension, opt->jump_exon))==NULL) continue;
-			if(sol2->prob < opt->min_align_score){solution_destory(&sol2);  continue;}
-			s_sp = find_solution_pair(*sol_pair, seq1->name.s);
-			if(s_sp!=NULL){ // if exists
-				if(s_sp->prob < sol1->prob*sol2->prob){
-					(*junc)->hits ++;
-					(*junc)->likehood += 10*log(sol1->prob); 				
-					(*junc)->likehood += 10*log(sol2->prob);
-					s_sp->r1 = sol1; s_sp->r2=sol2; 
-					s_sp->prob = (sol1->prob)*(sol2->prob); 
-					s_sp->junc_name = strdup(junc_name);
-					s_sp->fuse_name = strdup(fuse_name);		
-				}else{
-					if(sol1) solution_destory(&sol1);
-					if(sol2) solution_destory(&sol2);	
-				}
-			}else{
-				if(sol1->prob >= opt->min_align_score && sol2->prob >= opt->min_align_score){
-					(*junc)->hits ++;
-					(*junc)->likehood += 10*log(sol1->prob); 				
-					(*junc)->likehood += 10*log(sol2->prob); 				
-					s_sp = solution_pair_init();
-					s_sp->idx = strdup(seq1->name.s); 
-					s_sp->junc_name = strdup(junc_name);
-					s_sp->fuse_name = strdup(fuse_name);				
-					s_sp->r1 = sol1;			
-					s_sp->r2 = sol2;
-					s_sp->prob = sol1->prob*sol2->prob;
-					HASH_ADD_STR(*sol_pair, idx, s_sp);
-				}
-			}
-		}
-		if(_read1)  free(_read1);
-		if(_read2)  free(_read2);
 	}
-	if(seq1)     kseq_destroy(seq1);
-	if(seq2)     kseq_destroy(seq2);	
-	if(fp1)      gzclose(fp1);
-	if(fp2)      gzclose(fp2);
+	free(junc_rc);
+	if(ret == -2) die("[%s] R1 and R2 out of step after %llu pairs, %s and %s", __func__, (unsigned long long)fq->n_pairs, fq->r_name, fq->r_name2);
+	st->fastq_bytes += fq_tell(fq);
+	fq_close(fq);
 	return 0;	
 }
 
@@ -917,13 +1162,12 @@ static solution_pair_t *solution_uniq(solution_pair_t *sol){
 	return sol_ret;
 }
 
-static int fuse_score(solution_pair_t *sol, bag_t **bag, gene_t *gene, back_t *back, opt_t *opt){
+static int fuse_score(solution_pair_t *sol, bag_t **bag, gene_t *gene, null_t *back, opt_t *opt){
 	if(sol==NULL || *bag==NULL) return -1;
 	solution_pair_t *sol_cur;
 	bag_t *bag_cur, *bag_tmp;
-	back_t *back_cur = NULL;
 	int alpha = opt->alpha;
-	float prob;
+	float prob, scale;
 	int i, j;
 	/* initilize */
 	for(bag_cur=*bag; bag_cur!=NULL; bag_cur=bag_cur->hh.next){
@@ -937,17 +1181,42 @@ static int fuse_score(solution_pair_t *sol, bag_t **bag, gene_t *gene, back_t *b
 			bag_cur->weight++;
 		}
 	}
-	
+	/*
+	 * the kept pairs of an edge whose evidence is a sample stand for
+	 * n_seen/n_evidence pairs each, in its likelihood and in the weight
+	 * checked against -w. pairs only spanning its junctions are all
+	 * aligned and counted once.
+	 */
+	for(bag_cur=*bag; bag_cur!=NULL; bag_cur=bag_cur->hh.next){
+		if(!BAG_SAMPLED(bag_cur, opt)) continue;
+		scale = (float)bag_cur->n_seen / bag_cur->n_evidence - 1;
+		for(i=j=0; i<bag_cur->n_evidence; i++){
+			if((sol_cur=find_solution_pair(sol, bag_cur->read_names[i]))==NULL || strcmp(sol_cur->fuse_name, bag_cur->edge)!=0) continue;
+			prob = sol_cur->r1->prob*sol_cur->r2->prob;
+			bag_cur->likehood += scale * ((sol_cur->junc_name!=NULL) ? -alpha*log10(1.1 - prob) : -log10(1.1 - prob));
+			j++;
+		}
+		bag_cur->weight = (int)(bag_cur->weight + j * scale + 0.5);
+	}
+	/* with --raw-depth every pair also stands for its exact duplicates */
+	for(bag_cur=*bag; opt->raw_depth && bag_cur!=NULL; bag_cur=bag_cur->hh.next){
+		if(bag_cur->n_dup == 0 || bag_cur->n_seen == 0) continue;
+		scale = (float)(bag_cur->n_seen + bag_cur->n_dup) / bag_cur->n_seen;
+		bag_cur->likehood *= scale;
+		bag_cur->weight = (int)(bag_cur->weight * scale + 0.5);
+	}
+
 	gene_t *cur_gene1, *cur_gene2;
-	float num = 1;	
-	
+	int depth;
+
 	HASH_ITER(hh, *bag, bag_cur, bag_tmp){
-		num = 1;
 		if(bag_cur->weight < opt->min_edge_weight){
 			HASH_DEL(*bag,bag_cur);
 			free(bag_cur);
 			continue;
 		}
+		/* a sampled edge reports the exact number of its pairs */
+		if(BAG_SAMPLED(bag_cur, opt)) bag_cur->weight = bag_cur->n_seen + ((opt->raw_depth) ? bag_cur->n_dup : 0);
 		bag_cur->pvalue = 1;
 		cur_gene1 = find_gene(gene, bag_cur->gname1);
 		cur_gene2 = find_gene(gene, bag_cur->gname2);
@@ -956,29 +1225,39 @@ static int fuse_score(solution_pair_t *sol, bag_t **bag, gene_t *gene, back_t *b
 			if(cur_gene2) gene_destory(&cur_gene2);
 			continue;
 		}
-		bag_cur->likehood = (bag_cur->likehood/(cur_gene1->hits + cur_gene2->hits+1))*1000000;
-		if((back_cur = find_back(back, bag_cur->edge))!=NULL){
-			for(i=0; i<back_cur->arr_num; i++){
-				if(back_cur->arr[i]>=bag_cur->likehood) num++; 
-			}
-		}
-		bag_cur->pvalue = num/200;
+		depth = cur_gene1->hits + cur_gene2->hits;
+		if(opt->raw_depth) depth += cur_gene1->dups + cur_gene2->dups;
+		bag_cur->likehood = (bag_cur->likehood/(depth+1))*1000000;
+		bag_cur->pvalue = null_pvalue(back, bag_cur->edge, bag_cur->likehood);
 	}
 	return 0;
 }
 
-static int output(bag_t *bag, gene_t *gene, opt_t *opt){
+static int output(bag_t *bag, gene_t *gene, opt_t *opt, FILE *fp){
 	if(bag==NULL) return -1;
 	if(HASH_COUNT(bag)==0) return -1;
 	bag_t  *cur_bag;
-	for(cur_bag=BAGR_HT; cur_bag!=NULL; cur_bag=cur_bag->hh.next)
-		printf("%s\t%s\t%5d\tscore=%.2f\tpvalue=%f\n", cur_bag->gname1, cur_bag->gname2, cur_bag->weight, cur_bag->likehood, cur_bag->pvalue);
+	for(cur_bag=bag; cur_bag!=NULL; cur_bag=cur_bag->hh.next){
+		if(cur_bag->pvalue > opt->pvalue) continue;
+		fprintf(fp, "%s\t%s\t%5d\tscore=%.2f\tpvalue=%f", cur_bag->gname1, cur_bag->gname2, cur_bag->weight, cur_bag->likehood, cur_bag->pvalue);
+		if(BAG_SAMPLED(cur_bag, opt)) fprintf(fp, "\tsampled=%d/%d", cur_bag->n_evidence, cur_bag->n_seen);
+		if(cur_bag->n_dup > 0) fprintf(fp, "\tduplicates=%d", cur_bag->n_dup);
+		fprintf(fp, "\n");
+	}
 	return 0;
 }
 
+/* parse the argument of -i */
+static int index_type(char *str){
+	if(strcmp(str, "hash") == 0)   return KIDX_HASH;
+	if(strcmp(str, "sorted") == 0) return KIDX_SORTED;
+	die("[%s] -i must be 'hash' or 'sorted'", __func__);
+	return KIDX_HASH;
+}
+
 static int pred_usage(opt_t *opt){
 	fprintf(stderr, "\n");
-			fprintf(stderr, "Usage:   tafuco predict [options] <gname.txt> <genes.gtf> <in.fa> <R1.fq> <R2.fq>\n\n");
+			fprintf(stderr, "Usage:   tafuco predict [options] <gname.txt> <genes.gtf> <in.fa> <R1.fq> [R2.fq]\n\n");
 			fprintf(stderr, "Details: predict gene fusion from pair-end RNA-seq data\n\n");
 			fprintf(stderr, "Options:\n");
 			
@@ -986,6 +1265,7 @@ static int pred_usage(opt_t *opt){
 			fprintf(stderr, "         -k INT    kmer length for indexing in.fa [%d]\n", opt->k);
 			fprintf(stderr, "         -n INT    min unique kmer matches for a hit between gene and pair [%d]\n", opt->min_kmer_match);
 			fprintf(stderr, "         -w INT    edges in graph of weight smaller than -w will be removed [%d]\n", opt->min_edge_weight);
+			fprintf(stderr, "         -c INT    max read pairs per edge kept for alignment, 0 for all [%d]\n", opt->max_evidence);
 			
 			fprintf(stderr, "   -- Alignment:\n");
 			fprintf(stderr, "         -m INT    score for match [%d]\n", opt->match);
@@ -1004,13 +1284,24 @@ static int pred_usage(opt_t *opt){
 			fprintf(stderr, "   -- Fusion:\n");
 			fprintf(stderr, "         -A INT    weight for junction containing reads [%d]\n", opt->alpha);					
 			fprintf(stderr, "         -p FLOAT  p-value cutoff for fusions [%.2f]\n", opt->pvalue);
+			fprintf(stderr, "         --raw-depth  score exact duplicate pairs as well, collapsed by default\n");
+			
+			fprintf(stderr, "   -- Misc:\n");
+			fprintf(stderr, "         -t INT    number of threads [%d]\n", opt->n_threads);
+			fprintf(stderr, "         -i STR    kmer index, 'hash' or 'sorted' (smaller) [%s]\n", (opt->index_type == KIDX_SORTED) ? "sorted" : "hash");
+			fprintf(stderr, "         --stats FILE  write timing, memory and counters of every stage to FILE as JSON\n");
+			fprintf(stderr, "         --checkpoint DIR  save every stage to DIR and resume from it\n");
+			fprintf(stderr, "         --resync INT  reads looked ahead for the mate of a read out of step, 0 stops on it [%d]\n", opt->resync);
+			fprintf(stderr, "         --adapter STR  3' adapter trimmed from every read, e.g. AGATCGGAAGAGC [none]\n");
+			fprintf(stderr, "         --trim-qual INT  trim 3' ends of reads below quality INT, 0 for none [%d]\n", opt->trim.min_qual);
+			fprintf(stderr, "         --min-entropy FLOAT  trim homopolymer tails and mask reads of lower entropy (0-1), 0 for none [%.2f]\n", opt->trim.min_entropy);
 			
 			fprintf(stderr, "\n");
 			fprintf(stderr, "Inputs:  gname.txt plain txt file that contains name of gene candidates\n");
 			fprintf(stderr, "         genes.gtf gtf file that contains gene annotation\n");
 			fprintf(stderr, "         in.fa     fasta file that contains reference genome\n");
-			fprintf(stderr, "         R1.fq     5'->3' end of pair-end sequencing reads\n");
-			fprintf(stderr, "         R2.fq     the other end of sequencing reads\n");
+			fprintf(stderr, "         R1.fq     5'->3' end of pair-end sequencing reads, '-' for stdin\n");
+			fprintf(stderr, "         R2.fq     the other end of sequencing reads, R1.fq is interleaved without it\n");
 			return 1;
 }
 
@@ -1036,59 +1327,195 @@ static fasta_t* convert_exon_seq(fasta_t *fa){
 	return ret;
 }
 
-static back_t* read_background(char* fname){
-	if(fname==NULL) return NULL;
-	back_t *back_cur, *back_ret = NULL;
-	char  *line = NULL;
-	size_t len = 0;
-	int l;
-	ssize_t read;
-	char  **fields = NULL;
-	int num; 
-	char *edge_name;
-	int i, j;
-	FILE * fp = fopen (fname, "r");
-	if(fp==NULL) die("[%s] can't open %s", __func__, fname); 
-	while ((read = getline(&line, &len, fp)) != -1) {
-		if((fields = strsplit(line, 0, &num))==NULL) continue; // get rid of \n 
-		if(num==4){
-			int rc = strcmp(fields[0], fields[1]);
-			if(rc<0)  edge_name = concat(concat(fields[0], "_"), fields[1]);
-			if(rc>0)  edge_name = concat(concat(fields[1], "_"), fields[0]);
-			if(rc==0) edge_name = NULL;
-			if(edge_name!=NULL){
-				if((back_cur = find_back(back_ret, edge_name))==NULL){
-					back_cur = back_init();
-					back_cur->key = strdup(edge_name);
-					back_cur->arr_num = 1;
-					back_cur->arr = mycalloc(1, float);
-					back_cur->arr[0] = atof(fields[3]);
-					HASH_ADD_STR(back_ret, key, back_cur);
-				}else{
-					back_cur->arr_num ++;
-					back_cur->arr = realloc(back_cur->arr, back_cur->arr_num*sizeof(*back_cur->arr));
-					back_cur->arr[back_cur->arr_num-1] = atof(fields[3]);
-				}
-			}		
+/* the compiled null model if there is one, the text model otherwise */
+static null_t* read_background(){
+	null_t *ret;
+	if(access(BACKGROUND_PACK, R_OK) == 0){
+		if((ret = null_open(BACKGROUND_PACK)) == NULL) die("[%s] can't open %s", __func__, BACKGROUND_PACK);
+		return ret;
+	}
+	if((ret = null_open(BACKGROUND_FILE)) == NULL) die("[%s] can't open %s", __func__, BACKGROUND_FILE);
+	return ret;
+}
+/*
+ * state of a sample on sh with its own copy of opt, stats is copied
+ * if not NULL so that a report can include loading and indexing.
+ */
+static pipe_t *pipe_init(const shared_t *sh, const opt_t *opt, const stats_t *stats){
+	pipe_t *p = mycalloc(1, pipe_t);
+	p->sh = sh;
+	p->opt = *opt;
+	if(stats) p->stats = *stats; else stats_init(&p->stats);
+	if((p->gene = fasta_get_info(sh->exon)) == NULL) die("[%s] fail to gene genes' information", __func__);
+	p->bag = NULL;
+	p->sol = NULL;
+	return p;
+}
+
+static void pipe_destroy(pipe_t *p){
+	if(p == NULL) return;
+	if(p->bag)            bag_destory(&p->bag);
+	if(p->sol)  solution_pair_destory(&p->sol);
+	if(p->gene)          gene_destory(&p->gene);
+	if(p->spill){unlink(p->spill); free(p->spill);}
+	if(p->dups)           dup_destroy(&p->dups);
+	free(p);
+}
+
+static void shared_destroy(shared_t *sh){
+	if(sh->exon)          fasta_destroy(&sh->exon);
+	if(sh->kmer)           kidx_destroy(sh->kmer);
+	if(sh->back)           null_close(sh->back);
+	sh->exon = NULL; sh->kmer = NULL; sh->back = NULL;
+}
+
+/*
+ * run the pipeline from graph construction to scoring on the reads of
+ * p->opt. scored fusions are left in p->bag, p->sol is NULL if nothing
+ * is found. with p->opt.checkpoint the stages saved by an earlier run 
+ * of the same inputs and options are loaded instead of being rerun.
+ * reads of a stream are read once, the pairs hitting a gene are spilled
+ * to p->spill and rescanned from there.
+ */
+static int fusion_pipeline(pipe_t *p){
+	opt_t *opt = &p->opt;
+	stats_t *st = &p->stats;
+	uint64_t hash[CKPT_NUM];
+	int done = CKPT_NONE;
+	FILE *spill = NULL;
+	if(fq_is_stream(opt->fq1) || fq_is_stream(opt->fq2)){
+		if(opt->checkpoint != NULL) fprintf(stderr, "[%s] warning: no checkpoints of reads from a stream\n", __func__);
+		opt->checkpoint = NULL;
+		if((spill = fq_spill_open(&p->spill)) == NULL) die("[%s] can't create a temporary file to spill read pairs", __func__);
+	}
+	if(opt->checkpoint != NULL){
+		ckpt_hash(opt, hash);
+		if((done = ckpt_load(p, hash)) != CKPT_NONE) fprintf(stderr, "[%s] resuming after stage %s of %s\n", __func__, CKPT_NAMES[done], opt->checkpoint);
+		if(done != CKPT_NONE) return fusion_call(p, done, hash);
+	}
+	if(opt->verbose) fprintf(stderr, "[%s] constructing breakend associated graph ... \n", __func__);
+	stats_begin(st, STAGE_BAG);
+	p->bag = bag_construct(p->sh->kmer, &p->gene, opt->fq1, opt->fq2, opt->min_kmer_match, opt->min_edge_weight, opt->k, opt->max_evidence, opt->seed, opt->resync, &opt->trim, &opt->flip, spill, &p->dups, st);
+	stats_end(st, STAGE_BAG);
+	if(spill != NULL){
+		if(fclose(spill) != 0) die("[%s] fail to spill read pairs to %s", __func__, p->spill);
+		opt->fq1 = p->spill;
+		opt->fq2 = NULL;
+	}
+	if(p->bag == NULL && opt->checkpoint == NULL) return 0;
+	return fusion_call(p, CKPT_NONE, hash);
+}
+
+/* write the checkpoint of stage if p->opt.checkpoint is set, a failure only warns */
+static void fusion_save(pipe_t *p, int stage, const uint64_t *hash){
+	if(p->opt.checkpoint == NULL) return;
+	if(ckpt_save(p, stage, hash) != 0) fprintf(stderr, "[%s] warning: can't write checkpoint %s to %s\n", __func__, CKPT_NAMES[stage], p->opt.checkpoint);
+}
+
+/*
+ * the pipeline after graph construction, p->bag is trimmed, its junctions
+ * and transcripts are built and its pairs aligned and scored, stages up
+ * to done are already in p. reads are rescanned for pairs spanning a 
+ * junction unless p->opt.fq1 is NULL.
+ */
+static int fusion_call(pipe_t *p, int done, const uint64_t *hash){
+	opt_t *opt = &p->opt;
+	stats_t *st = &p->stats;
+	int ret;
+	if(done < CKPT_BAG){
+		if(opt->verbose) fprintf(stderr, "[%s] triming graph by removing edges of weight smaller than %d... \n", __func__, opt->min_edge_weight);
+		stats_begin(st, STAGE_TRIM);
+		ret = (p->bag == NULL) ? 0 : bag_trim(&p->bag, opt->min_edge_weight);
+		stats_end(st, STAGE_TRIM);
+		if(ret!=0){
+			fprintf(stderr, "[%s] fail to trim graph \n", __func__);
+			return -1;
 		}
-		if(fields){
-			for(i=0; i<num; i++) free(fields[i]);
-			free(fields);
+		fusion_save(p, CKPT_BAG, hash);
+	}
+	if(p->bag == NULL) return 0;
+	
+	if(done < CKPT_JUNCTION){
+		if(opt->verbose) fprintf(stderr, "[%s] identifying junctions for every fusion candiates... \n", __func__);
+		stats_begin(st, STAGE_JUNCTION);
+		ret = bag_junction_gen(&p->bag, p->sh->exon, p->sh->kmer, opt, st);
+		stats_end(st, STAGE_JUNCTION);
+		if(ret!=0){
+			fprintf(stderr, "[%s] fail to identify junctions\n", __func__);
+			return -1;	
 		}
+		if(p->bag == NULL) return 0;
 		
-		free(edge_name);
+		if(opt->verbose) fprintf(stderr, "[%s] constructing transcript for identified junctions ... \n", __func__);		
+		stats_begin(st, STAGE_TRANSCRIPT);
+		ret = bag_transcript_gen(&p->bag, p->sh->exon, opt);
+		stats_end(st, STAGE_TRANSCRIPT);
+		if(ret!=0){
+			fprintf(stderr, "[%s] fail to construct transcript\n", __func__);
+			return -1;	
+		}
+		fusion_save(p, CKPT_JUNCTION, hash);
 	}
-	fclose(fp);
-	return back_ret;
+	
+	if(done < CKPT_SOLUTION){
+		if(opt->verbose) fprintf(stderr, "[%s] testing junctions ... \n", __func__);		
+		stats_begin(st, STAGE_TEST_JUNCTION);
+		ret = (opt->fq1 != NULL) ? test_junction(&p->sol, &p->bag, opt, p->dups, p->sh->kmer, p->spill, st) : 0;
+		stats_end(st, STAGE_TEST_JUNCTION);
+		if(ret!=0){
+			fprintf(stderr, "[%s] fail to rescan reads\n", __func__);
+			return -1;		
+		}
+		 
+		if(opt->verbose) fprintf(stderr, "[%s] testing fusion ... \n", __func__);			
+		stats_begin(st, STAGE_TEST_FUSION);
+		ret = test_fusion(&p->sol, &p->bag, opt, st);
+		stats_end(st, STAGE_TEST_FUSION);
+		if(ret!=0){
+			fprintf(stderr, "[%s] fail to align supportive reads to transcript\n", __func__);
+			return -1;			
+		}
+		fusion_save(p, CKPT_SOLUTION, hash);
+	}
+	
+	if(p->sol==NULL){
+    	if(opt->verbose) fprintf(stderr, "[%s] no fusion identified\n", __func__);
+    	return 0;		
+	}
+
+	/* score the fusion */
+	stats_begin(st, STAGE_SCORE);
+	ret = fuse_score(p->sol, &p->bag, p->gene, p->sh->back, opt);
+	stats_end(st, STAGE_SCORE);
+	if(ret!=0){
+    	fprintf(stderr, "[%s] fail to score fusion\n", __func__);
+		return -1;
+	}
+	return 0;
+}
+
+/* reads of opt are two fastq files or one interleaved, only one of them can be stdin */
+static void check_reads(const opt_t *opt){
+	if(opt->fq2 != NULL && strcmp(opt->fq1, "-") == 0 && strcmp(opt->fq2, "-") == 0) die("[%s] R1 and R2 can't both be read from stdin", __func__);
 }
+
 /*--------------------------------------------------------------------*/
 /*  predict  */
 int predict(int argc, char *argv[]) {
 	opt_t *opt = opt_init(); // initlize options with default settings
 	int c, i;
 	srand48(11);
-	while ((c = getopt(argc, argv, "m:w:k:n:u:o:e:g:s:h:l:x:a:")) >= 0) {
+	while ((c = getopt_long(argc, argv, "m:w:k:n:u:o:e:g:s:h:l:x:a:t:i:c:A:p:", LONG_OPTS, NULL)) >= 0) {
 				switch (c) {
+				case OPT_STATS: opt->stats = optarg; break;
+				case OPT_CKPT: opt->checkpoint = optarg; break;
+				case OPT_RESYNC: opt->resync = atoi(optarg); break;
+				case OPT_ADAPTER: opt->trim.adapter = optarg; break;
+				case OPT_TRIMQ: opt->trim.min_qual = atoi(optarg); break;
+				case OPT_ENTROPY: opt->trim.min_entropy = atof(optarg); break;
+				case OPT_RAWDEPTH: opt->raw_depth = 1; break;
+				case 'A': opt->alpha = atoi(optarg); break;
+				case 'p': opt->pvalue = atof(optarg); break;
 				case 'k': opt->k = atoi(optarg); break;	
 				case 'n': opt->min_kmer_match = atoi(optarg); break;
 				case 'w': opt->min_edge_weight = atoi(optarg); break;
@@ -1102,193 +1529,1058 @@ int predict(int argc, char *argv[]) {
 				case 'l': opt->seed_len = atoi(optarg); break;
 				case 'x': opt->max_mismatch = atoi(optarg); break;
 				case 'a': opt->min_align_score = atof(optarg); break;
+				case 't': opt->n_threads = atoi(optarg); break;
+				case 'i': opt->index_type = index_type(optarg); break;
+				case 'c': opt->max_evidence = atoi(optarg); break;
 				default: return 1;
 		}
 	}
 
-	if (optind + 5 > argc) return pred_usage(opt);
+	if (optind + 4 > argc) return pred_usage(opt);
 	opt->gfile  = argv[optind];    // gnames.txt
 	opt->gtf  = argv[optind+1];    // genes.gtf
 	opt->fa  = argv[optind+2];     // hg19.fa
 	opt->fq1 = argv[optind+3];     // read1.fq
-	opt->fq2 = argv[optind+4];     // read2.fq
+	opt->fq2 = (optind + 4 < argc) ? argv[optind+4] : NULL; // read2.fq, NULL if read1.fq is interleaved
+	check_reads(opt);
 	
 	if(opt->k < MIN_KMER_LEN || opt->k > MAX_KMER_LEN) die("[%s] -k must be within [%d, %d]", __func__, MIN_KMER_LEN, MAX_KMER_LEN); 	
 	if(opt->min_kmer_match < MIN_MIN_KMER_MATCH) die("[%s] -n must be within [%d, +INF)", __func__,   MIN_MIN_KMER_MATCH); 	
 	if(opt->min_edge_weight < MIN_MIN_EDGE_WEIGHT) die("[%s] -w must be within [%d, +INF)", __func__, MIN_MIN_EDGE_WEIGHT); 	
 	if(opt->min_hits < MIN_MIN_HITS) die("[%s] -h must be within [%d, +INF)", __func__, MIN_MIN_HITS); 	
 	if(opt->min_align_score < MIN_MIN_ALIGN_SCORE || opt->min_align_score > MAX_MIN_ALIGN_SCORE) die("[%s] -a must be within [%d, %d]", __func__, MIN_MIN_ALIGN_SCORE, MAX_MIN_ALIGN_SCORE); 	
+	if(opt->n_threads < MIN_THREADS) die("[%s] -t must be within [%d, +INF)", __func__, MIN_THREADS); 	
+	if(opt->max_evidence < MIN_MAX_EVIDENCE) die("[%s] -c must be within [%d, +INF)", __func__, MIN_MAX_EVIDENCE); 	
+	if(opt->resync < MIN_RESYNC) die("[%s] --resync must be within [%d, +INF)", __func__, MIN_RESYNC); 	
+	if(opt->trim.min_entropy < 0 || opt->trim.min_entropy > 1) die("[%s] --min-entropy must be within [0, 1]", __func__); 	
 	
+	shared_t sh = {NULL, NULL, NULL};
+	stats_t st;
+	ref_t *ref;
+	pipe_t *p;
+	stats_init(&st);
+	stats_begin(&st, STAGE_LOAD);
 	fprintf(stderr, "[%s] loading reference genome sequences ... \n",__func__);
-	if((GENO_HT = fasta_read(opt->fa)) == NULL) die("[%s] can't load reference genome %s", __func__, opt->fa);	
+	if((ref = ref_open(opt->fa)) == NULL) die("[%s] can't load reference genome %s", __func__, opt->fa);	
 	fasta_t *exon_tmp = NULL;
 	fprintf(stderr, "[%s] Exracting exon sequences ... \n",__func__);
-	if((exon_tmp = extract_exon_seq(opt->gfile, opt->gtf, GENO_HT, "exon"))==NULL) die("[%s] can't extract exon sequences of %s", __func__, opt->gfile);
-	if(GENO_HT)          fasta_destroy(&GENO_HT);
+	if((exon_tmp = extract_exon_seq(opt->gfile, opt->gtf, ref, "exon"))==NULL) die("[%s] can't extract exon sequences of %s", __func__, opt->gfile);
+	ref_close(ref);
 
-	EXON_HT = convert_exon_seq(exon_tmp);
+	sh.exon = convert_exon_seq(exon_tmp);
 	if(exon_tmp)          fasta_destroy(&exon_tmp);
+	stats_end(&st, STAGE_LOAD);
 	
+	fprintf(stderr, "[%s] indexing sequneces by kmer hash table ... \n",__func__);
+	stats_begin(&st, STAGE_INDEX);
+	if((sh.kmer = kidx_build(sh.exon, opt->k, opt->n_threads, opt->index_type))==NULL) die("[%s] can't index exon sequences", __func__);
+	stats_end(&st, STAGE_INDEX);
+	fprintf(stderr, "[%s] %zu distinct kmers, %zu postings, %.1fMB build buffer, %.1f bytes per kmer\n", __func__, sh.kmer->size, sh.kmer->n_post, kidx_build_mem(sh.exon, opt->k)/1048576.0, (double)kidx_mem(sh.kmer)/sh.kmer->size);
+    
 	fprintf(stderr, "[%s] getting genes infomration ... \n",__func__);
-	if((GENE_HT = fasta_get_info(EXON_HT)) == NULL) die("[%s] fail to gene genes' information", __func__);	
+	p = pipe_init(&sh, opt, &st);
+	if(fusion_pipeline(p) != 0) return -1;
+	if(p->sol != NULL) output(p->bag, p->gene, &p->opt, stdout);
+	if(opt->stats != NULL){
+		if(stats_write(&p->stats, opt->stats, "predict", opt->fq1, opt->fq2, opt->n_threads) != 0) die("[%s] can't write %s", __func__, opt->stats);
+		fprintf(stderr, "[%s] run report written to %s\n", __func__, opt->stats);
+	}
+		
+	fprintf(stderr, "[%s] cleaning up ... \n", __func__);
+	pipe_destroy(p);
+	shared_destroy(&sh);
+	fprintf(stderr, "[%s] congradualtions! it succeeded! \n", __func__);	
+	return 0;
+}
+
+static int rapid_usage(opt_t *opt, int n_workers){
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco rapid [options] <R1.fq> [R2.fq]\n");
+			fprintf(stderr, "         tafuco rapid [options] --samples manifest.tsv\n\n");
+			fprintf(stderr, "Details: predict fusions in a rapid mode\n\n");
+			fprintf(stderr, "Options: -t INT    number of threads [%d]\n", opt->n_threads);
+			fprintf(stderr, "         -i STR    kmer index, 'hash' or 'sorted' (smaller) [%s]\n", (opt->index_type == KIDX_SORTED) ? "sorted" : "hash");
+			fprintf(stderr, "         -c INT    max read pairs per edge kept for alignment, 0 for all [%d]\n", opt->max_evidence);
+			fprintf(stderr, "         -j INT    samples of the manifest run in parallel [%d]\n", n_workers);
+			fprintf(stderr, "         -A INT    weight for junction containing reads [%d]\n", opt->alpha);
+			fprintf(stderr, "         -p FLOAT  p-value cutoff for fusions [%.2f]\n", opt->pvalue);
+			fprintf(stderr, "         --raw-depth  score exact duplicate pairs as well, collapsed by default\n");
+			fprintf(stderr, "         --stats FILE  write timing, memory and counters of every stage to FILE as JSON\n");
+			fprintf(stderr, "         --checkpoint DIR  save every stage to DIR and resume from it, DIR/name with --samples\n");
+			fprintf(stderr, "         --resync INT  reads looked ahead for the mate of a read out of step, 0 stops on it [%d]\n", opt->resync);
+			fprintf(stderr, "         --adapter STR  3' adapter trimmed from every read, e.g. AGATCGGAAGAGC [none]\n");
+			fprintf(stderr, "         --trim-qual INT  trim 3' ends of reads below quality INT, 0 for none [%d]\n", opt->trim.min_qual);
+			fprintf(stderr, "         --min-entropy FLOAT  trim homopolymer tails and mask reads of lower entropy (0-1), 0 for none [%.2f]\n", opt->trim.min_entropy);
+			fprintf(stderr, "         --samples FILE  'name R1.fq R2.fq' per line, the index is built once for all\n");
+			fprintf(stderr, "         --outdir DIR  name.fusion.txt, name.log and name.stats.json of every sample [.]\n\n");
+			fprintf(stderr, "Inputs:  R1.fq     5'->3' end of pair-end sequencing reads, '-' for stdin\n");
+			fprintf(stderr, "         R2.fq     the other end of sequencing reads, R1.fq is interleaved without it\n");
+			return 1;
+}
+
+/* a sample of the manifest of rapid --samples */
+typedef struct {
+	char *name;
+	char *fq1;
+	char *fq2;
+} sample_t;
+
+/* samples of manifest fname, 'name R1.fq R2.fq' per line */
+static sample_t *read_manifest(const char *fname, int *n){
+	sample_t *ret = NULL;
+	FILE *fp;
+	char line[4096], *tok[3], *p, *save;
+	int n_tok, i;
+	*n = 0;
+	if((fp = fopen(fname, "r")) == NULL) die("[%s] can't open %s", __func__, fname);
+	while(fgets(line, sizeof(line), fp) != NULL){
+		if(line[0] == '#') continue;
+		for(n_tok=0, p=strtok_r(line, " \t\r\n", &save); p!=NULL && n_tok<3; p=strtok_r(NULL, " \t\r\n", &save)) tok[n_tok++] = p;
+		if(n_tok == 0) continue;
+		if(n_tok != 3) die("[%s] sample %s of %s needs R1.fq and R2.fq", __func__, tok[0], fname);
+		if(strchr(tok[0], '/') != NULL) die("[%s] sample name %s contains '/'", __func__, tok[0]);
+		for(i=0; i<*n; i++) if(strcmp(ret[i].name, tok[0]) == 0) die("[%s] sample %s is listed twice", __func__, tok[0]);
+		ret = realloc(ret, (*n + 1) * sizeof(sample_t));
+		ret[*n].name = strdup(tok[0]);
+		ret[*n].fq1 = strdup(tok[1]);
+		ret[*n].fq2 = strdup(tok[2]);
+		(*n)++;
+	}
+	fclose(fp);
+	return ret;
+}
+
+/*
+ * call fusions of one sample in a forked worker, stdout and stderr go
+ * to the files of the sample. the index, exons and null model are
+ * shared with the parent copy-on-write, the graph, solutions and gene
+ * hits are the worker's own.
+ */
+static int rapid_sample(const shared_t *sh, opt_t *opt, sample_t *sample, const char *outdir){
+	pipe_t *p;
+	char *out, *log, *json;
+	out  = join(4, (char*)outdir, "/", sample->name, ".fusion.txt");
+	log  = join(4, (char*)outdir, "/", sample->name, ".log");
+	json = join(4, (char*)outdir, "/", sample->name, ".stats.json");
+	if(freopen(log, "w", stderr) == NULL) return -1;
+	if(freopen(out, "w", stdout) == NULL) die("[%s] can't write %s", __func__, out);
+	opt->fq1 = sample->fq1;
+	opt->fq2 = sample->fq2;
+	if(opt->checkpoint != NULL){
+		if(mkdir(opt->checkpoint, 0777) != 0 && errno != EEXIST) die("[%s] can't create %s", __func__, opt->checkpoint);
+		opt->checkpoint = join(3, opt->checkpoint, "/", sample->name);
+	}
+	fprintf(stderr, "[%s] sample %s: %s %s\n", __func__, sample->name, opt->fq1, opt->fq2);
+	p = pipe_init(sh, opt, NULL);
+	if(fusion_pipeline(p) != 0) return -1;
+	if(p->sol != NULL) output(p->bag, p->gene, &p->opt, stdout);
+	if(opt->stats != NULL && stats_write(&p->stats, json, "rapid", opt->fq1, opt->fq2, 1) != 0) die("[%s] can't write %s", __func__, json);
+	pipe_destroy(p);
+	fprintf(stderr, "[%s] sample %s done\n", __func__, sample->name);
+	return 0;
+}
+
+/* run every sample of manifest on up to n_workers forked workers, return the number of failures */
+static int rapid_batch(const shared_t *sh, opt_t *opt, const char *manifest, const char *outdir, int n_workers){
+	sample_t *samples;
+	pid_t pid, *pids;
+	double *t0;
+	int n, i, w, status, running = 0, failed = 0;
+	if((samples = read_manifest(manifest, &n)) == NULL) die("[%s] no sample in %s", __func__, manifest);
+	if(n_workers > n) n_workers = n;
+	fprintf(stderr, "[%s] %d samples on %d workers, outputs in %s\n", __func__, n, n_workers, outdir);
+	pids = mycalloc(n, pid_t);
+	t0 = mycalloc(n, double);
+	fflush(stdout);
+	fflush(stderr);
+	for(i=0; i<n || running>0; ){
+		if(i < n && running < n_workers){
+			t0[i] = stats_clock();
+			if((pids[i] = fork()) < 0) die("[%s] fail to fork", __func__);
+			if(pids[i] == 0){
+				status = rapid_sample(sh, opt, &samples[i], outdir);
+				fflush(stdout);
+				fflush(stderr);
+				_exit((status == 0) ? 0 : 1);
+			}
+			running++; i++;
+			continue;
+		}
+		if((pid = wait(&status)) < 0) die("[%s] fail to wait for workers", __func__);
+		for(w=0; w<i && pids[w]!=pid; w++);
+		if(w == i) continue;
+		running--;
+		if(WIFEXITED(status) && WEXITSTATUS(status) == 0){
+			fprintf(stderr, "[%s] %s done in %.1fs\n", __func__, samples[w].name, stats_clock() - t0[w]);
+		}else{
+			fprintf(stderr, "[%s] %s failed, see %s/%s.log\n", __func__, samples[w].name, outdir, samples[w].name);
+			failed++;
+		}
+	}
+	for(i=0; i<n; i++){
+		free(samples[i].name);
+		free(samples[i].fq1);
+		free(samples[i].fq2);
+	}
+	free(samples);
+	free(pids);
+	free(t0);
+	return failed;
+}
+
+/* load the null model and exons of rapid mode into sh and index the exons */
+static void rapid_load(opt_t *opt, shared_t *sh, stats_t *st){
+	stats_begin(st, STAGE_LOAD);
+	sh->back = read_background();
+
+	opt->fa = FASTA_NAME;
+	fprintf(stderr, "[%s] loading sequences of targeted genes ... \n",__func__);
+	if((sh->exon = fasta_read(opt->fa)) == NULL) die("[%s] fail to read %s", __func__, opt->fa);	
+	stats_end(st, STAGE_LOAD);
 	
 	fprintf(stderr, "[%s] indexing sequneces by kmer hash table ... \n",__func__);
-	if((KMER_HT = kmer_index(EXON_HT, opt->k))==NULL) die("[%s] can't index exon sequences", __func__);
+	stats_begin(st, STAGE_INDEX);
+	if((sh->kmer = kidx_build(sh->exon, opt->k, opt->n_threads, opt->index_type))==NULL) die("[%s] can't index exon sequences", __func__);
+	stats_end(st, STAGE_INDEX);
+	fprintf(stderr, "[%s] %zu distinct kmers, %zu postings, %.1fMB build buffer, %.1f bytes per kmer\n", __func__, sh->kmer->size, sh->kmer->n_post, kidx_build_mem(sh->exon, opt->k)/1048576.0, (double)kidx_mem(sh->kmer)/sh->kmer->size);
+}
+
+/*--------------------------------------------------------------------*/
+/* rapid mode of prediction. */
+int rapid(int argc, char *argv[]) {
+	opt_t *opt = opt_init(); // initlize options with default settings
+	char *samples = NULL, *outdir = ".";
+	shared_t sh = {NULL, NULL, NULL};
+	stats_t st;
+	pipe_t *p;
+	int c, i, n_workers = sysconf(_SC_NPROCESSORS_ONLN), failed = 0;
+	srand48(11);
+	if(n_workers < MIN_THREADS) n_workers = MIN_THREADS;
+	while ((c = getopt_long(argc, argv, "t:i:c:j:A:p:", RAPID_LONG_OPTS, NULL)) >= 0) {
+				switch (c) {
+				case OPT_STATS: opt->stats = optarg; break;
+				case OPT_CKPT: opt->checkpoint = optarg; break;
+				case OPT_RESYNC: opt->resync = atoi(optarg); break;
+				case OPT_ADAPTER: opt->trim.adapter = optarg; break;
+				case OPT_TRIMQ: opt->trim.min_qual = atoi(optarg); break;
+				case OPT_ENTROPY: opt->trim.min_entropy = atof(optarg); break;
+				case OPT_RAWDEPTH: opt->raw_depth = 1; break;
+				case 'A': opt->alpha = atoi(optarg); break;
+				case 'p': opt->pvalue = atof(optarg); break;
+				case OPT_SAMPLES: samples = optarg; break;
+				case OPT_OUTDIR: outdir = optarg; break;
+				case 't': opt->n_threads = atoi(optarg); break;
+				case 'i': opt->index_type = index_type(optarg); break;
+				case 'c': opt->max_evidence = atoi(optarg); break;
+				case 'j': n_workers = atoi(optarg); break;
+				default: return 1;
+		}
+	}
+
+	if (samples == NULL && optind + 1 > argc) return rapid_usage(opt, n_workers);
+	if(opt->n_threads < MIN_THREADS) die("[%s] -t must be within [%d, +INF)", __func__, MIN_THREADS); 	
+	if(opt->max_evidence < MIN_MAX_EVIDENCE) die("[%s] -c must be within [%d, +INF)", __func__, MIN_MAX_EVIDENCE); 	
+	if(opt->resync < MIN_RESYNC) die("[%s] --resync must be within [%d, +INF)", __func__, MIN_RESYNC); 	
+	if(opt->trim.min_entropy < 0 || opt->trim.min_entropy > 1) die("[%s] --min-entropy must be within [0, 1]", __func__); 	
+	if(n_workers < MIN_THREADS) die("[%s] -j must be within [%d, +INF)", __func__, MIN_THREADS); 	
+	if(samples == NULL){
+		opt->fq1 = argv[optind+0];  // read1
+		opt->fq2 = (optind + 1 < argc) ? argv[optind+1] : NULL; // read2, NULL if read1 is interleaved
+		check_reads(opt);
+	}
+	stats_init(&st);
+	rapid_load(opt, &sh, &st);
     
-	fprintf(stderr, "[%s] constructing breakend associated graph ... \n", __func__);
-	if((BAGR_HT = bag_construct(KMER_HT, &GENE_HT, opt->fq1, opt->fq2, opt->min_kmer_match, opt->min_edge_weight, opt->k)) == NULL) return 0;
-	//
-	fprintf(stderr, "[%s] triming graph by removing edges of weight smaller than %d... \n", __func__, opt->min_edge_weight);
-	if(bag_trim(&BAGR_HT, opt->min_edge_weight)!=0){
-		fprintf(stderr, "[%s] fail to trim graph \n", __func__);
-		return -1;
+	if(samples != NULL){
+		/* the index and the null model are shared by all samples */
+		if((failed = rapid_batch(&sh, opt, samples, outdir, n_workers)) != 0) fprintf(stderr, "[%s] %d samples failed\n", __func__, failed);
+	}else{
+		fprintf(stderr, "[%s] getting genes infomration ... \n",__func__);
+		p = pipe_init(&sh, opt, &st);
+		if(fusion_pipeline(p) != 0) return -1;
+		if(p->sol != NULL) output(p->bag, p->gene, &p->opt, stdout);
+		st = p->stats;
+		pipe_destroy(p);
+	}
+	if(opt->stats != NULL){
+		if(stats_write(&st, opt->stats, "rapid", (samples) ? samples : opt->fq1, opt->fq2, opt->n_threads) != 0) die("[%s] can't write %s", __func__, opt->stats);
+		fprintf(stderr, "[%s] run report written to %s\n", __func__, opt->stats);
+	}
+	
+		
+	fprintf(stderr, "[%s] cleaning up ... \n", __func__);
+	shared_destroy(&sh);
+	if(failed) return 1;
+	fprintf(stderr, "[%s] congradualtions! it succeeded! \n", __func__);	
+	return 0;
+}
+
+
+static int scan_usage(opt_t *opt){
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco scan [options] <R1.fq> [R2.fq] <out.bag>\n\n");
+			fprintf(stderr, "Details: build the graph of one shard of a sample in rapid mode and write it\n");
+			fprintf(stderr, "         to out.bag, shards of a sample are called by tafuco merge\n\n");
+			fprintf(stderr, "Options: -t INT    number of threads [%d]\n", opt->n_threads);
+			fprintf(stderr, "         -i STR    kmer index, 'hash' or 'sorted' (smaller) [%s]\n", (opt->index_type == KIDX_SORTED) ? "sorted" : "hash");
+			fprintf(stderr, "         -c INT    max read pairs per edge kept for alignment, 0 for all [%d]\n", opt->max_evidence);
+			fprintf(stderr, "         --resync INT  reads looked ahead for the mate of a read out of step, 0 stops on it [%d]\n", opt->resync);
+			fprintf(stderr, "         --adapter STR  3' adapter trimmed from every read, e.g. AGATCGGAAGAGC [none]\n");
+			fprintf(stderr, "         --trim-qual INT  trim 3' ends of reads below quality INT, 0 for none [%d]\n", opt->trim.min_qual);
+			fprintf(stderr, "         --min-entropy FLOAT  trim homopolymer tails and mask reads of lower entropy (0-1), 0 for none [%.2f]\n\n", opt->trim.min_entropy);
+
+			fprintf(stderr, "Inputs:  R1.fq     5'->3' end of pair-end sequencing reads of the shard, '-' for stdin\n");
+			fprintf(stderr, "         R2.fq     the other end of sequencing reads, R1.fq is interleaved without it\n");
+			fprintf(stderr, "         out.bag   partial graph of the shard\n");
+			return 1;
+}
+
+/* index of a gene or an edge in the shard */
+typedef struct {
+	void *ptr;
+	int i;
+	UT_hash_handle hh;
+} shard_idx_t;
+
+/*--------------------------------------------------------------------*/
+/* graph of one shard of a sample. */
+int scan(int argc, char *argv[]) {
+	opt_t *opt = opt_init(); // initlize options with default settings
+	shared_t sh = {NULL, NULL, NULL};
+	stats_t st;
+	shard_t shard;
+	shard_idx_t *gidx, *eidx, *gset = NULL, *eset = NULL, *x;
+	bag_t *e;
+	gene_t *gene_cur;
+	dup_t *d;
+	pipe_t *p;
+	int c, i, j, k;
+	while ((c = getopt_long(argc, argv, "t:i:c:", SCAN_LONG_OPTS, NULL)) >= 0) {
+				switch (c) {
+				case OPT_RESYNC: opt->resync = atoi(optarg); break;
+				case OPT_ADAPTER: opt->trim.adapter = optarg; break;
+				case OPT_TRIMQ: opt->trim.min_qual = atoi(optarg); break;
+				case OPT_ENTROPY: opt->trim.min_entropy = atof(optarg); break;
+				case 't': opt->n_threads = atoi(optarg); break;
+				case 'i': opt->index_type = index_type(optarg); break;
+				case 'c': opt->max_evidence = atoi(optarg); break;
+				default: return 1;
+		}
 	}
-	if(BAGR_HT == NULL) return 0;
+	if (optind + 2 > argc) return scan_usage(opt);
+	if(opt->n_threads < MIN_THREADS) die("[%s] -t must be within [%d, +INF)", __func__, MIN_THREADS); 	
+	if(opt->max_evidence < MIN_MAX_EVIDENCE) die("[%s] -c must be within [%d, +INF)", __func__, MIN_MAX_EVIDENCE); 	
+	if(opt->resync < MIN_RESYNC) die("[%s] --resync must be within [%d, +INF)", __func__, MIN_RESYNC); 	
+	if(opt->trim.min_entropy < 0 || opt->trim.min_entropy > 1) die("[%s] --min-entropy must be within [0, 1]", __func__); 	
+	opt->fq1 = argv[optind+0];
+	opt->fq2 = (optind + 3 <= argc) ? argv[optind+1] : NULL;
+	check_reads(opt);
+	stats_init(&st);
+	rapid_load(opt, &sh, &st);
 	
-	fprintf(stderr, "[%s] identifying junctions for every fusion candiates... \n", __func__);
-	if(bag_junction_gen(&BAGR_HT, EXON_HT, KMER_HT, opt)!=0){
-		fprintf(stderr, "[%s] fail to identify junctions\n", __func__);
-		return -1;	
+	fprintf(stderr, "[%s] scanning %s and %s ... \n", __func__, opt->fq1, (opt->fq2) ? opt->fq2 : "its mates");
+	p = pipe_init(&sh, opt, &st);
+	memset(&shard, 0, sizeof(shard));
+	shard.bag = bag_scan(sh.kmer, &p->gene, opt->fq1, opt->fq2, opt->min_kmer_match, opt->k, opt->max_evidence, opt->seed, opt->resync, &opt->trim, &shard.hdr.pairs_std, &shard.hdr.pairs_flip, NULL, &p->dups, 1, &p->stats);
+	shard.hdr.k = opt->k;
+	shard.hdr.min_kmer_match = opt->min_kmer_match;
+	shard.hdr.max_evidence = opt->max_evidence;
+	shard.hdr.seed = opt->seed;
+	shard.hdr.resync = opt->resync;
+	shard.hdr.min_qual = opt->trim.min_qual;
+	shard.hdr.min_entropy = opt->trim.min_entropy;
+	shard.adapter = opt->trim.adapter;
+	shard.hdr.pairs_scanned = p->stats.pairs_scanned;
+	for(gene_cur=p->gene; gene_cur!=NULL; gene_cur=gene_cur->hh.next) if(gene_cur->hits > 0) shard.hdr.n_gene++;
+	shard.gene = mycalloc(shard.hdr.n_gene + 1, char*);
+	shard.hits = mycalloc(shard.hdr.n_gene + 1, int);
+	shard.dups = mycalloc(shard.hdr.n_gene + 1, int);
+	gidx = mycalloc(shard.hdr.n_gene + 1, shard_idx_t);
+	for(i=0, gene_cur=p->gene; gene_cur!=NULL; gene_cur=gene_cur->hh.next){
+		if(gene_cur->hits == 0) continue;
+		gidx[i].ptr = gene_cur;
+		gidx[i].i = i;
+		HASH_ADD_PTR(gset, ptr, &gidx[i]);
+		shard.gene[i] = gene_cur->name;
+		shard.dups[i] = gene_cur->dups;
+		shard.hits[i++] = gene_cur->hits;
+	}
+	/* edges are written in the order of the graph */
+	eidx = mycalloc(HASH_COUNT(shard.bag) + 1, shard_idx_t);
+	for(i=0, e=shard.bag; e!=NULL; e=e->hh.next, i++){
+		eidx[i].ptr = e;
+		eidx[i].i = i;
+		HASH_ADD_PTR(eset, ptr, &eidx[i]);
 	}
-	if(BAGR_HT == NULL) return 0;
+	/* every pair with hits and its edges, so that merge counts a pair of two shards once */
+	shard.hdr.n_pair = HASH_COUNT(p->dups);
+	shard.pair = mycalloc(shard.hdr.n_pair + 1, shard_pair_t);
+	for(d=p->dups; d!=NULL; d=d->hh.next) shard.hdr.n_pair_edge += d->n_edge;
+	shard.pair_edge = mycalloc(shard.hdr.n_pair_edge + 1, uint32_t);
+	for(i=j=0, d=p->dups; d!=NULL; d=d->hh.next, i++){
+		memcpy(shard.pair[i].key, d->key, sizeof(d->key));
+		x = NULL;
+		if(d->gene != NULL) HASH_FIND_PTR(gset, &d->gene, x);
+		shard.pair[i].gene = (x != NULL) ? x->i : -1;
+		shard.pair[i].n = d->n;
+		shard.pair[i].n_edge = d->n_edge;
+		shard.pair[i].edge = j;
+		for(k=0; k<d->n_edge; k++){
+			HASH_FIND_PTR(eset, &d->edge[k], x);
+			shard.pair_edge[j++] = x->i;
+		}
+	}
+	HASH_CLEAR(hh, gset);
+	HASH_CLEAR(hh, eset);
+	free(gidx);
+	free(eidx);
+	if(shard_write(&shard, argv[argc-1]) != 0) die("[%s] can't write %s", __func__, argv[argc-1]);
+	fprintf(stderr, "[%s] %llu pairs, %u edges and %llu genes written to %s\n", __func__, (unsigned long long)shard.hdr.pairs_scanned, HASH_COUNT(shard.bag), (unsigned long long)shard.hdr.n_gene, argv[argc-1]);
 	
-    fprintf(stderr, "[%s] constructing transcript for identified junctions ... \n", __func__);		
-    if((bag_transcript_gen(&BAGR_HT, EXON_HT, opt))!=0){
-    	fprintf(stderr, "[%s] fail to construct transcript\n", __func__);
-    	return -1;	
-    }
-    
-    fprintf(stderr, "[%s] testing junctions ... \n", __func__);		
-    if((test_junction(&SOLU_HT, &BAGR_HT, opt))!=0){
-    	fprintf(stderr, "[%s] fail to rescan reads\n", __func__);
-    	return -1;		
-    }
-	 
-    fprintf(stderr, "[%s] testing fusion ... \n", __func__);			
-    if((test_fusion(&SOLU_HT, &BAGR_HT, opt))!=0){
-    	fprintf(stderr, "[%s] fail to align supportive reads to transcript\n", __func__);
-    	return -1;			
-    }
+	fprintf(stderr, "[%s] cleaning up ... \n", __func__);
+	p->bag = shard.bag;
+	free(shard.gene);
+	free(shard.hits);
+	free(shard.dups);
+	free(shard.pair);
+	free(shard.pair_edge);
+	pipe_destroy(p);
+	shared_destroy(&sh);
+	return 0;
+}
+
+static int merge_usage(opt_t *opt){
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco merge [options] <1.bag> [2.bag ...]\n\n");
+			fprintf(stderr, "Details: merge the graphs of the shards of a sample written by tafuco scan\n");
+			fprintf(stderr, "         and predict fusions in rapid mode\n\n");
+			fprintf(stderr, "Options: -t INT    number of threads [%d]\n", opt->n_threads);
+			fprintf(stderr, "         -i STR    kmer index, 'hash' or 'sorted' (smaller) [%s]\n", (opt->index_type == KIDX_SORTED) ? "sorted" : "hash");
+			fprintf(stderr, "         -1 FILE   R1.fq of the whole sample, rescanned for pairs spanning junctions, interleaved without -2\n");
+			fprintf(stderr, "         -2 FILE   R2.fq of the whole sample, only kept pairs are aligned without -1 and -2\n");
+			fprintf(stderr, "         --raw-depth  score exact duplicate pairs as well, collapsed by default\n");
+			fprintf(stderr, "         --stats FILE  write timing, memory and counters of every stage to FILE as JSON\n\n");
+
+			fprintf(stderr, "Inputs:  1.bag     partial graph of a shard, reads of -1 and -2 are cleaned as the shards were scanned\n");
+			return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* rapid mode on the shards of a sample. */
+int merge(int argc, char *argv[]) {
+	opt_t *opt = opt_init(); // initlize options with default settings
+	shared_t sh = {NULL, NULL, NULL};
+	stats_t st;
+	shard_t *shard;
+	shard_hdr_t hdr;
+	char *adapter;
+	shard_pair_t *pr;
+	bag_t *e, **edge = NULL;
+	char *drop = NULL;
+	gene_t *gene_cur;
+	dup_t *d, *d_tmp;
+	pipe_t *p;
+	uint64_t pairs_std = 0, pairs_flip = 0, k;
+	int c, i, j;
+	while ((c = getopt_long(argc, argv, "t:i:1:2:", LONG_OPTS, NULL)) >= 0) {
+				switch (c) {
+				case OPT_STATS: opt->stats = optarg; break;
+				case OPT_CKPT: die("[%s] --checkpoint is not supported by merge", __func__); break;
+				case OPT_RESYNC: case OPT_ADAPTER: case OPT_TRIMQ: case OPT_ENTROPY:
+					die("[%s] --resync, --adapter, --trim-qual and --min-entropy are taken from the shards", __func__); break;
+				case OPT_RAWDEPTH: opt->raw_depth = 1; break;
+				case 't': opt->n_threads = atoi(optarg); break;
+				case 'i': opt->index_type = index_type(optarg); break;
+				case '1': opt->fq1 = optarg; break;
+				case '2': opt->fq2 = optarg; break;
+				default: return 1;
+		}
+	}
+	if (optind + 1 > argc) return merge_usage(opt);
+	if(opt->n_threads < MIN_THREADS) die("[%s] -t must be within [%d, +INF)", __func__, MIN_THREADS); 	
+	if(opt->fq1 == NULL && opt->fq2 != NULL) die("[%s] -2 needs -1", __func__);
+	if(fq_is_stream(opt->fq1) || fq_is_stream(opt->fq2)) die("[%s] -1 and -2 are read once per junction and can't be a stream", __func__);
 	
-	/* get rid of the duplicate reads*/
-	//if((SOLU_UNIQ_HT = solution_uniq(SOLU_HT))==NULL) return 0;
+	/* the graph is built again with the options of the shards */
+	if((shard = shard_read(argv[optind])) == NULL) die("[%s] %s is not a shard of tafuco scan", __func__, argv[optind]);
+	hdr = shard->hdr;
+	adapter = shard->adapter;
+	shard->adapter = NULL;
+	shard_destroy(shard);
+	opt->k = hdr.k;
+	opt->min_kmer_match = hdr.min_kmer_match;
+	opt->max_evidence = hdr.max_evidence;
+	opt->seed = hdr.seed;
+	opt->resync = hdr.resync;
+	opt->trim.adapter = adapter;
+	opt->trim.min_qual = hdr.min_qual;
+	opt->trim.min_entropy = hdr.min_entropy;
+	stats_init(&st);
+	rapid_load(opt, &sh, &st);
 	
-	if(SOLU_HT==NULL){
-    	fprintf(stderr, "[%s] no fusion identified\n", __func__);
-    	return 0;		
+	p = pipe_init(&sh, opt, &st);
+	stats_begin(&p->stats, STAGE_BAG);
+	for(i=optind; i<argc; i++){
+		fprintf(stderr, "[%s] merging %s ... \n", __func__, argv[i]);
+		if((shard = shard_read(argv[i])) == NULL) die("[%s] %s is not a shard of tafuco scan", __func__, argv[i]);
+		if(shard->hdr.k != hdr.k || shard->hdr.min_kmer_match != hdr.min_kmer_match || shard->hdr.max_evidence != hdr.max_evidence || shard->hdr.seed != hdr.seed
+				|| shard->hdr.resync != hdr.resync || shard->hdr.min_qual != hdr.min_qual || shard->hdr.min_entropy != hdr.min_entropy
+				|| strcmp((shard->adapter) ? shard->adapter : "", (adapter) ? adapter : "") != 0)
+			die("[%s] %s is scanned with options other than %s", __func__, argv[i], argv[optind]);
+		/* a pair read by an earlier shard is a duplicate here, of its gene and its edges */
+		edge = realloc(edge, (shard->hdr.n_edge + 1) * sizeof(bag_t*));
+		for(k=0, e=shard->bag; e!=NULL; e=e->hh.next) edge[k++] = e;
+		for(k=0; k<shard->hdr.n_pair; k++){
+			pr = shard->pair + k;
+			HASH_FIND(hh, p->dups, pr->key, sizeof(pr->key), d);
+			if(d == NULL){d = dup_add(&p->dups, pr->key); d->n = pr->n; continue;}
+			d->n += pr->n;
+			p->stats.pairs_duplicate++;
+			if(pr->gene >= 0){shard->hits[pr->gene]--; shard->dups[pr->gene]++;}
+			for(j=0; j<pr->n_edge; j++){
+				e = edge[shard->pair_edge[pr->edge + j]];
+				e->n_seen--; e->weight--; e->n_dup++;
+			}
+			d->pass = i;
+		}
+		/* and is no longer part of the kept pairs of the shard */
+		for(e=shard->bag; e!=NULL; e=e->hh.next){
+			drop = realloc(drop, e->n_evidence + 1);
+			for(j=0; j<e->n_evidence; j++){
+				HASH_FIND(hh, p->dups, e->key + 2*j, 2 * sizeof(uint64_t), d);
+				drop[j] = (d != NULL && d->pass == i);
+			}
+			bag_drop(e, drop);
+		}
+		for(j=0; j<shard->hdr.n_gene; j++)
+			if((gene_cur = find_gene(p->gene, shard->gene[j])) != NULL){gene_cur->hits += shard->hits[j]; gene_cur->dups += shard->dups[j];}
+		p->stats.pairs_scanned += shard->hdr.pairs_scanned;
+		pairs_std += shard->hdr.pairs_std;
+		pairs_flip += shard->hdr.pairs_flip;
+		bag_merge(&p->bag, shard->bag, opt->max_evidence, opt->seed);
+		shard->bag = NULL;
+		shard_destroy(shard);
 	}
-    
-	/* score the fusion */
-	if(fuse_score(SOLU_HT, &BAGR_HT, GENE_HT, BACK_HT, opt)!=0){
-    	fprintf(stderr, "[%s] fail to score fusion\n", __func__);
-    	return -1;		
+	/* only the pairs with duplicates are left for the junction rescan */
+	HASH_ITER(hh, p->dups, d, d_tmp){
+		d->pass = 0;
+		if(d->n > 1) continue;
+		HASH_DEL(p->dups, d);
+		free(d);
+	}
+	free(edge);
+	free(drop);
+	p->opt.flip = (pairs_flip > pairs_std);
+	if(p->bag != NULL && bag_order(&p->bag, sh.kmer, opt->k, opt->min_kmer_match, &p->stats) != 0) die("[%s] fail to order genes", __func__);
+	stats_end(&p->stats, STAGE_BAG);
+	fprintf(stderr, "[%s] %llu pairs in %d shards, %u edges\n", __func__, (unsigned long long)p->stats.pairs_scanned, argc - optind, HASH_COUNT(p->bag));
+	
+	if(p->bag != NULL && fusion_call(p, CKPT_NONE, NULL) != 0) return -1;
+	if(p->sol != NULL) output(p->bag, p->gene, &p->opt, stdout);
+	if(opt->stats != NULL){
+		if(stats_write(&p->stats, opt->stats, "merge", opt->fq1, opt->fq2, opt->n_threads) != 0) die("[%s] can't write %s", __func__, opt->stats);
+		fprintf(stderr, "[%s] run report written to %s\n", __func__, opt->stats);
 	}
 	
-	output(BAGR_HT, GENE_HT, opt);
-		
 	fprintf(stderr, "[%s] cleaning up ... \n", __func__);
-	if(EXON_HT)          fasta_destroy(&EXON_HT);
-	if(KMER_HT)           kmer_destroy(&KMER_HT);
-	if(BAGR_HT)            bag_destory(&BAGR_HT);
-	if(SOLU_HT)  solution_pair_destory(&SOLU_HT);
-	if(SOLU_UNIQ_HT)  solution_pair_destory(&SOLU_UNIQ_HT);
-	if(GENE_HT)           gene_destory(&GENE_HT);
+	pipe_destroy(p);
+	shared_destroy(&sh);
+	if(adapter) free(adapter);
 	fprintf(stderr, "[%s] congradualtions! it succeeded! \n", __func__);	
 	return 0;
 }
 
-static int rapid_usage(opt_t *opt){
+
+static int nullsim_usage(opt_t *opt, sim_opt_t *sim, int n_rep, long n_pairs, int n_workers){
 	fprintf(stderr, "\n");
-			fprintf(stderr, "Usage:   tafuco rapid <R1.fq> <R2.fq>\n\n");
-			fprintf(stderr, "Details: predict fusions in a rapid mode\n\n");
-			fprintf(stderr, "Inputs:  R1.fq     5'->3' end of pair-end sequencing reads\n");
-			fprintf(stderr, "         R2.fq     the other end of sequencing reads\n");
+			fprintf(stderr, "Usage:   tafuco nullsim [options] <null.bin>\n\n");
+			fprintf(stderr, "Details: build the null model of rapid mode by simulating read pairs from\n");
+			fprintf(stderr, "         normal transcripts of %s and scoring them\n\n", FASTA_NAME);
+			fprintf(stderr, "Options: -n INT    number of simulations [%d]\n", n_rep);
+			fprintf(stderr, "         -N INT    read pairs per simulation [%ld]\n", n_pairs);
+			fprintf(stderr, "         -l INT    read length [%d]\n", sim->read_len);
+			fprintf(stderr, "         -f INT    mean fragment length [%d]\n", sim->frag_mean);
+			fprintf(stderr, "         -d INT    standard deviation of fragment length [%d]\n", sim->frag_sd);
+			fprintf(stderr, "         -e FLOAT  mean substitution error rate [%.4f]\n", sim->err);
+			fprintf(stderr, "         -s INT    seed [%llu]\n", (unsigned long long)opt->seed);
+			fprintf(stderr, "         -t INT    number of simulations run in parallel [%d]\n", n_workers);
+			fprintf(stderr, "         -o STR    also write the scores as a text null model to STR\n\n");
+			fprintf(stderr, "Outputs: null.bin  null model, copy it to %s to be used by rapid\n", BACKGROUND_PACK);
 			return 1;
 }
 
+/*
+ * run simulations w, w+n_workers, ... below n_rep against the exons and
+ * index of sh, fusions of every simulation are appended to fo in the text
+ * null model format. reads are written to dir and removed afterwards.
+ */
+static int nullsim_worker(const shared_t *sh, opt_t *opt, sim_opt_t *sim, sim_tx_t *tx, int n_tx, int w, int n_workers, int n_rep, long n_pairs, const char *dir, FILE *fo){
+	FILE *fo1, *fo2;
+	bag_t *bag_cur;
+	pipe_t *p;
+	char name[32];
+	uint64_t rng;
+	int r, n;
+	for(r=w; r<n_rep; r+=n_workers){
+		sprintf(name, "/sim%d.r1.fq", r); opt->fq1 = join(2, (char*)dir, name);
+		sprintf(name, "/sim%d.r2.fq", r); opt->fq2 = join(2, (char*)dir, name);
+		if((fo1 = fopen(opt->fq1, "w")) == NULL || (fo2 = fopen(opt->fq2, "w")) == NULL) die("[%s] can't write to %s", __func__, dir);
+		/* every simulation has its own stream of random numbers */
+		rng = opt->seed + (uint64_t)r * 0x9E3779B97F4A7C15ULL;
+		sim_pairs(tx, n_tx, n_pairs, sim, &rng, "null", fo1, fo2);
+		fclose(fo1);
+		fclose(fo2);
+		p = pipe_init(sh, opt, NULL);
+		if(fusion_pipeline(p) != 0) return -1;
+		n = 0;
+		if(p->sol != NULL){
+			for(bag_cur=p->bag; bag_cur!=NULL; bag_cur=bag_cur->hh.next, n++)
+				fprintf(fo, "%s\t%s\t%5d\t%.2f\n", bag_cur->gname1, bag_cur->gname2, bag_cur->weight, bag_cur->likehood);
+		}
+		fprintf(stderr, "[nullsim] simulation %d: %d gene pairs\n", r+1, n);
+		pipe_destroy(p);
+		unlink(opt->fq1); unlink(opt->fq2);
+		free(opt->fq1); free(opt->fq2);
+		opt->fq1 = opt->fq2 = NULL;
+	}
+	return 0;
+}
+
 /*--------------------------------------------------------------------*/
-/* rapid mode of prediction. */
-int rapid(int argc, char *argv[]) {
+/* simulate the null model of rapid mode. */
+int nullsim(int argc, char *argv[]) {
 	opt_t *opt = opt_init(); // initlize options with default settings
-	int c, i;
+	sim_opt_t *sim = sim_opt_init();
+	shared_t sh = {NULL, NULL, NULL};
+	sim_tx_t *tx;
+	null_t *null;
+	FILE *fo, *fi;
+	pid_t *pids;
+	char *tmp, *dir, *txt = NULL, *part, name[32], buf[65536];
+	size_t n;
+	long n_pairs = 100000;
+	int c, w, n_tx, n_rep = 200, n_workers = sysconf(_SC_NPROCESSORS_ONLN), status, failed = 0;
 	srand48(11);
-
-	if (optind + 2 > argc) return rapid_usage(opt);
-	opt->fq1 = argv[optind+0];  // read1
-	opt->fq2 = argv[optind+1];  // read2
-	BACK_HT = read_background(BACKGROUND_FILE);
-
+	if(n_workers < MIN_THREADS) n_workers = MIN_THREADS;
+	while ((c = getopt(argc, argv, "n:N:l:f:d:e:s:t:o:")) >= 0) {
+				switch (c) {
+				case 'n': n_rep = atoi(optarg); break;
+				case 'N': n_pairs = atol(optarg); break;
+				case 'l': sim->read_len = atoi(optarg); break;
+				case 'f': sim->frag_mean = atoi(optarg); break;
+				case 'd': sim->frag_sd = atoi(optarg); break;
+				case 'e': sim->err = atof(optarg); break;
+				case 's': opt->seed = strtoull(optarg, NULL, 10); break;
+				case 't': n_workers = atoi(optarg); break;
+				case 'o': txt = optarg; break;
+				default: return 1;
+		}
+	}
+	if (optind + 1 > argc) return nullsim_usage(opt, sim, n_rep, n_pairs, n_workers);
+	if(n_rep < 1) die("[%s] -n must be within [1, +INF)", __func__);
+	if(n_pairs < 1) die("[%s] -N must be within [1, +INF)", __func__);
+	if(sim->read_len < opt->k) die("[%s] -l must be within [%d, +INF)", __func__, opt->k);
+	if(sim->frag_mean < sim->read_len || sim->frag_sd < 0) die("[%s] -f must be at least -l and -d non-negative", __func__);
+	if(sim->err < 0 || sim->err > 0.5) die("[%s] -e must be within [0, 0.5]", __func__);
+	if(n_workers < MIN_THREADS) die("[%s] -t must be within [%d, +INF)", __func__, MIN_THREADS);
+	if(n_workers > n_rep) n_workers = n_rep;
+	
 	opt->fa = FASTA_NAME;
+	opt->n_threads = n_workers;
 	fprintf(stderr, "[%s] loading sequences of targeted genes ... \n",__func__);
-	if((EXON_HT = fasta_read(opt->fa)) == NULL) die("[%s] fail to read %s", __func__, opt->fa);	
-    
-	fprintf(stderr, "[%s] getting genes infomration ... \n",__func__);
-	if((GENE_HT = fasta_get_info(EXON_HT)) == NULL) die("[%s] fail to gene genes' information", __func__);	
+	if((sh.exon = fasta_read(opt->fa)) == NULL) die("[%s] fail to read %s", __func__, opt->fa);
+	if((tx = sim_transcripts(opt->fa, &n_tx)) == NULL) die("[%s] no transcript found in %s", __func__, opt->fa);
 	
 	fprintf(stderr, "[%s] indexing sequneces by kmer hash table ... \n",__func__);
-	if((KMER_HT = kmer_index(EXON_HT, opt->k))==NULL) die("[%s] can't index exon sequences", __func__);
-    
-	fprintf(stderr, "[%s] constructing breakend associated graph ... \n", __func__);
-	if((BAGR_HT = bag_construct(KMER_HT, &GENE_HT, opt->fq1, opt->fq2, opt->min_kmer_match, opt->min_edge_weight, opt->k)) == NULL) return 0;
+	if((sh.kmer = kidx_build(sh.exon, opt->k, opt->n_threads, opt->index_type))==NULL) die("[%s] can't index exon sequences", __func__);
 	
-	fprintf(stderr, "[%s] triming graph by removing edges of weight smaller than %d... \n", __func__, opt->min_edge_weight);
-	if(bag_trim(&BAGR_HT, opt->min_edge_weight)!=0){
-		fprintf(stderr, "[%s] fail to trim graph \n", __func__);
-		return -1;
-	}
-	if(BAGR_HT == NULL) return 0;
+	tmp = getenv("TMPDIR");
+	dir = join(2, (tmp != NULL && tmp[0]) ? tmp : "/tmp", "/tafuco.nullsim.XXXXXX");
+	if(mkdtemp(dir) == NULL) die("[%s] can't create a directory for simulated reads", __func__);
 	
-	fprintf(stderr, "[%s] identifying junctions for every fusion candiates... \n", __func__);
-	if(bag_junction_gen(&BAGR_HT, EXON_HT, KMER_HT, opt)!=0){
-		fprintf(stderr, "[%s] fail to identify junctions\n", __func__);
-		return -1;	
+	/* the index is shared by the workers copy-on-write */
+	fprintf(stderr, "[%s] %d simulations of %ld pairs from %d transcripts on %d workers ... \n", __func__, n_rep, n_pairs, n_tx, n_workers);
+	opt->verbose = 0;
+	pids = mycalloc(n_workers, pid_t);
+	fflush(stdout);
+	for(w=0; w<n_workers; w++){
+		if((pids[w] = fork()) < 0) die("[%s] fail to fork", __func__);
+		if(pids[w] > 0) continue;
+		sprintf(name, "/part%d.txt", w);
+		part = join(2, dir, name);
+		if((fo = fopen(part, "w")) == NULL) die("[%s] can't write %s", __func__, part);
+		status = nullsim_worker(&sh, opt, sim, tx, n_tx, w, n_workers, n_rep, n_pairs, dir, fo);
+		fclose(fo);
+		_exit((status == 0) ? 0 : 1);
+	}
+	for(w=0; w<n_workers; w++){
+		if(waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
 	}
-	if(BAGR_HT == NULL) return 0;
 	
-    fprintf(stderr, "[%s] constructing transcript for identified junctions ... \n", __func__);		
-    if((bag_transcript_gen(&BAGR_HT, EXON_HT, opt))!=0){
-    	fprintf(stderr, "[%s] fail to construct transcript\n", __func__);
-    	return -1;	
-    }
-    
-    fprintf(stderr, "[%s] testing junctions ... \n", __func__);		
-    if((test_junction(&SOLU_HT, &BAGR_HT, opt))!=0){
-    	fprintf(stderr, "[%s] fail to rescan reads\n", __func__);
-    	return -1;		
-    }
-	 
-    fprintf(stderr, "[%s] testing fusion ... \n", __func__);			
-    if((test_fusion(&SOLU_HT, &BAGR_HT, opt))!=0){
-    	fprintf(stderr, "[%s] fail to align supportive reads to transcript\n", __func__);
-    	return -1;			
-    }
+	/* scores of all simulations in one text null model */
+	if(txt == NULL) txt = join(2, dir, "/null.txt"); else txt = strdup(txt);
+	if((fo = fopen(txt, "w")) == NULL) die("[%s] can't write %s", __func__, txt);
+	for(w=0; w<n_workers; w++){
+		sprintf(name, "/part%d.txt", w);
+		part = join(2, dir, name);
+		if((fi = fopen(part, "r")) != NULL){
+			while((n = fread(buf, 1, sizeof(buf), fi)) > 0) fwrite(buf, 1, n, fo);
+			fclose(fi);
+		}
+		unlink(part);
+		free(part);
+	}
+	fclose(fo);
+	if(failed) die("[%s] %d of %d workers failed", __func__, failed, n_workers);
 	
-	/* get rid of the duplicate reads*/
-	//if((SOLU_UNIQ_HT = solution_uniq(SOLU_HT))==NULL) return 0;
+	fprintf(stderr, "[%s] writing null model of %d simulations ... \n", __func__, n_rep);
+	if((null = null_build(txt, n_rep)) == NULL) die("[%s] can't read %s", __func__, txt);
+	if(null_write(null, argv[optind]) != 0) die("[%s] can't write %s", __func__, argv[optind]);
+	fprintf(stderr, "[%s] %llu gene pairs, %.1fKB\n", __func__, (unsigned long long)null->hdr->n_pair, null->size/1024.0);
 	
-	if(SOLU_HT==NULL){
-    	fprintf(stderr, "[%s] no fusion identified\n", __func__);
-    	return 0;		
+	fprintf(stderr, "[%s] cleaning up ... \n", __func__);
+	if(strncmp(txt, dir, strlen(dir)) == 0) unlink(txt);
+	rmdir(dir);
+	null_close(null);
+	sim_transcripts_destroy(tx, n_tx);
+	shared_destroy(&sh);
+	free(pids);
+	free(txt);
+	free(dir);
+	free(sim);
+	return 0;
+}
+
+/*--------------------------------------------------------------------*/
+/* 
+ * tafuco serve keeps the index, exons and null model of rapid mode in
+ * memory and runs jobs sent over a unix socket, one request line per
+ * connection, fields separated by tabs:
+ *   run <max evidence, -1 for the default> <R1.fq> <R2.fq>
+ *   status
+ *   stop
+ * every job runs in a worker forked from the server, so it shares the
+ * index copy-on-write and has its own graph. replies are fusion calls
+ * in the format of rapid and control lines that start with '#':
+ *   #queued <job> <jobs ahead>, #stage <name> <sec> as every stage ends,
+ *   #done <job> <ret> <sec>, #status <running> <queued> <done> <failed>,
+ *   #job <id> <state> <stage> <sec> <R1.fq>, #error <message>
+ */
+
+typedef struct {
+	int id;
+	int fd;                 /* client, closed by the server once the job is forked */
+	char *fq1;
+	char *fq2;
+	int max_evidence;
+	pid_t pid;              /* 0 while queued */
+	double t0;              /* submission time */
+} job_t;
+
+/* a connection whose request line is still being read */
+typedef struct {
+	int fd;
+	int n;
+	double t0;              /* accept time, the client is dropped SERVE_TIMEOUT seconds later */
+	char line[2*PATH_MAX+64];
+} client_t;
+
+#define SERVE_TIMEOUT 5
+
+static volatile sig_atomic_t SERVE_STOP = 0;
+
+static void serve_signal(int sig){
+	SERVE_STOP = 1;
+}
+
+/* 
+ * read what a client polled readable has sent, return 1 once its
+ * request line is complete, 0 if more is to come, -1 if it hung up
+ * without sending anything.
+ */
+static int client_read(client_t *cl){
+	char *p;
+	ssize_t n = read(cl->fd, cl->line + cl->n, sizeof(cl->line) - 1 - cl->n);
+	if(n < 0) return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+	if(n == 0) return (cl->n > 0) ? 1 : -1;
+	cl->n += n;
+	cl->line[cl->n] = '\0';
+	if((p = memchr(cl->line, '\n', cl->n)) != NULL){*p = '\0'; return 1;}
+	return (cl->n == sizeof(cl->line) - 1) ? 1 : 0;
+}
+
+static void job_destroy(job_t *job){
+	if(job == NULL) return;
+	if(job->fd >= 0) close(job->fd);
+	free(job->fq1);
+	free(job->fq2);
+	free(job);
+}
+
+/*
+ * run job in a forked worker, stage timings go to the client as every
+ * stage ends, then calls and #done. the current stage is kept in stage
+ * for the status of the server.
+ */
+static int serve_job(const shared_t *sh, opt_t *opt, job_t *job, volatile int *stage){
+	FILE *fp;
+	pipe_t *p;
+	int ret;
+	if((fp = fdopen(job->fd, "w")) == NULL) return -1;
+	opt->fq1 = job->fq1;
+	opt->fq2 = job->fq2;
+	if(job->max_evidence >= 0) opt->max_evidence = job->max_evidence;
+	opt->verbose = 0;
+	p = pipe_init(sh, opt, NULL);
+	p->stats.log = fp;
+	p->stats.shared = stage;
+	ret = fusion_pipeline(p);
+	if(ret == 0 && p->sol != NULL) output(p->bag, p->gene, &p->opt, fp);
+	fprintf(fp, "#done\t%d\t%d\t%.3f\n", job->id, ret, stats_clock() - job->t0);
+	fclose(fp);
+	pipe_destroy(p);
+	return ret;
+}
+
+/* answer request line of client fd, queue it if it is a job */
+static void serve_request(int fd, char *line, job_t ***queue, int *n_queue, job_t **running, const volatile int *stage, int n_workers, int *n_jobs, int n_done, int n_failed){
+	char *tok[4], *p, *save;
+	job_t *job;
+	FILE *fp;
+	int n_tok, n_run, i;
+	if((fp = fdopen(dup(fd), "w")) == NULL){close(fd); return;}
+	for(n_tok=0, p=strtok_r(line, "\t", &save); p!=NULL && n_tok<4; p=strtok_r(NULL, "\t", &save)) tok[n_tok++] = p;
+	for(i=0, n_run=0; i<n_workers; i++) if(running[i] != NULL) n_run++;
+	if(n_tok == 1 && strcmp(tok[0], "status") == 0){
+		fprintf(fp, "#status\t%d\t%d\t%d\t%d\n", n_run, *n_queue, n_done, n_failed);
+		for(i=0; i<n_workers; i++) if(running[i] != NULL) fprintf(fp, "#job\t%d\trunning\t%s\t%.1f\t%s\n", running[i]->id, (stage[i] >= 0 && stage[i] < STAGE_NUM) ? STAGE_NAMES[stage[i]] : "-", stats_clock() - running[i]->t0, running[i]->fq1);
+		for(i=0; i<*n_queue; i++) fprintf(fp, "#job\t%d\tqueued\t-\t%.1f\t%s\n", (*queue)[i]->id, stats_clock() - (*queue)[i]->t0, (*queue)[i]->fq1);
+	}else if(n_tok == 1 && strcmp(tok[0], "stop") == 0){
+		fprintf(fp, "#status\t%d\t%d\t%d\t%d\n", n_run, *n_queue, n_done, n_failed);
+		SERVE_STOP = 1;
+	}else if(n_tok == 4 && strcmp(tok[0], "run") == 0){
+		if(access(tok[2], R_OK) != 0 || access(tok[3], R_OK) != 0){
+			fprintf(fp, "#error\tcan't read %s or %s\n", tok[2], tok[3]);
+		}else{
+			job = mycalloc(1, job_t);
+			job->id = ++(*n_jobs);
+			job->fd = fd;
+			job->max_evidence = atoi(tok[1]);
+			job->fq1 = strdup(tok[2]);
+			job->fq2 = strdup(tok[3]);
+			job->t0 = stats_clock();
+			*queue = realloc(*queue, (*n_queue + 1) * sizeof(job_t*));
+			(*queue)[(*n_queue)++] = job;
+			fprintf(fp, "#queued\t%d\t%d\n", job->id, *n_queue - 1 + n_run);
+			fprintf(stderr, "[serve] job %d: %s %s\n", job->id, job->fq1, job->fq2);
+			fclose(fp);
+			return;
+		}
+	}else{
+		fprintf(fp, "#error\tunknown request\n");
 	}
+	fclose(fp);
+	close(fd);
+}
 
-	/* score the fusion */
-	if(fuse_score(SOLU_HT, &BAGR_HT, GENE_HT, BACK_HT, opt)!=0){
-    	fprintf(stderr, "[%s] fail to score fusion\n", __func__);
-		return -1;		
+static int serve_usage(opt_t *opt, int n_workers){
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco serve [options] --socket PATH\n\n");
+			fprintf(stderr, "Details: keep the index of rapid mode in memory and call fusions of samples\n");
+			fprintf(stderr, "         sent by tafuco submit over the unix socket PATH\n\n");
+			fprintf(stderr, "Options: -t INT    number of threads to build the index [%d]\n", opt->n_threads);
+			fprintf(stderr, "         -i STR    kmer index, 'hash' or 'sorted' (smaller) [%s]\n", (opt->index_type == KIDX_SORTED) ? "sorted" : "hash");
+			fprintf(stderr, "         -c INT    max read pairs per edge kept for alignment, 0 for all [%d]\n", opt->max_evidence);
+			fprintf(stderr, "         -j INT    jobs run in parallel [%d]\n", n_workers);
+			return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* fusion calling daemon of rapid mode. */
+int serve(int argc, char *argv[]) {
+	opt_t *opt = opt_init(); // initlize options with default settings
+	struct sockaddr_un addr;
+	struct pollfd *pfd = NULL;
+	shared_t sh = {NULL, NULL, NULL};
+	stats_t st;
+	job_t **queue = NULL, **running;
+	client_t **client = NULL, *cl;
+	volatile int *stage;
+	char *path = NULL;
+	pid_t pid;
+	int c, i, j, fd, lfd, status, n_queue = 0, n_jobs = 0, n_done = 0, n_failed = 0, n_run, n_client = 0;
+	int n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	srand48(11);
+	if(n_workers < MIN_THREADS) n_workers = MIN_THREADS;
+	while ((c = getopt_long(argc, argv, "t:i:c:j:", SERVE_LONG_OPTS, NULL)) >= 0) {
+				switch (c) {
+				case OPT_SOCKET: path = optarg; break;
+				case 't': opt->n_threads = atoi(optarg); break;
+				case 'i': opt->index_type = index_type(optarg); break;
+				case 'c': opt->max_evidence = atoi(optarg); break;
+				case 'j': n_workers = atoi(optarg); break;
+				default: return 1;
+		}
 	}
+	if(path == NULL) return serve_usage(opt, n_workers);
+	if(opt->n_threads < MIN_THREADS) die("[%s] -t must be within [%d, +INF)", __func__, MIN_THREADS); 	
+	if(opt->max_evidence < MIN_MAX_EVIDENCE) die("[%s] -c must be within [%d, +INF)", __func__, MIN_MAX_EVIDENCE); 	
+	if(n_workers < MIN_THREADS) die("[%s] -j must be within [%d, +INF)", __func__, MIN_THREADS); 	
+	if(strlen(path) >= sizeof(addr.sun_path)) die("[%s] socket path %s is too long", __func__, path);
 	
-	output(BAGR_HT, GENE_HT, opt);
+	stats_init(&st);
+	rapid_load(opt, &sh, &st);
 	
-		
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) die("[%s] can't create a socket", __func__);
+	unlink(path);
+	if(bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(lfd, 64) != 0) die("[%s] can't listen on %s", __func__, path);
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, serve_signal);
+	signal(SIGTERM, serve_signal);
+	fprintf(stderr, "[%s] listening on %s with %d workers\n", __func__, path, n_workers);
+	
+	running = mycalloc(n_workers, job_t*);
+	/* the stage of every running job, written by its worker */
+	if((stage = mmap(NULL, n_workers * sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) die("[%s] can't map the stages of workers", __func__);
+	for(i=0; i<n_workers; i++) stage[i] = -1;
+	for(n_run=0; !SERVE_STOP || n_queue > 0 || n_run > 0; ){
+		/* finished jobs */
+		while((pid = waitpid(-1, &status, WNOHANG)) > 0){
+			for(i=0; i<n_workers && (running[i] == NULL || running[i]->pid != pid); i++);
+			if(i == n_workers) continue;
+			if(WIFEXITED(status) && WEXITSTATUS(status) == 0) n_done++; else n_failed++;
+			fprintf(stderr, "[%s] job %d %s in %.1fs\n", __func__, running[i]->id, (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "done" : "failed", stats_clock() - running[i]->t0);
+			job_destroy(running[i]);
+			running[i] = NULL;
+			stage[i] = -1;
+			n_run--;
+		}
+		/* queued jobs in the order of submission */
+		for(i=0; i<n_workers && n_queue>0; i++){
+			if(running[i] != NULL) continue;
+			running[i] = queue[0];
+			memmove(queue, queue + 1, (--n_queue) * sizeof(job_t*));
+			fflush(stderr);
+			if((running[i]->pid = fork()) < 0) die("[%s] fail to fork", __func__);
+			if(running[i]->pid == 0){
+				if(lfd >= 0) close(lfd);
+				for(j=0; j<n_queue; j++) close(queue[j]->fd);
+				for(j=0; j<n_client; j++) close(client[j]->fd);
+				_exit((serve_job(&sh, opt, running[i], stage + i) == 0) ? 0 : 1);
+			}
+			close(running[i]->fd);
+			running[i]->fd = -1;
+			n_run++;
+		}
+		/* no new job once stopping */
+		if(SERVE_STOP && lfd >= 0){
+			fprintf(stderr, "[%s] stopping after %d running and %d queued jobs\n", __func__, n_run, n_queue);
+			close(lfd);
+			unlink(path);
+			lfd = -1;
+			for(; n_client > 0; n_client--){close(client[n_client-1]->fd); free(client[n_client-1]);}
+		}
+		if(lfd < 0){usleep(100000); continue;}
+		/* 
+		 * the listening socket and the clients still sending their request
+		 * are polled together, so a slow client never holds up the others.
+		 */
+		pfd = realloc(pfd, (n_client + 1) * sizeof(struct pollfd));
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		for(i=0; i<n_client; i++){pfd[i+1].fd = client[i]->fd; pfd[i+1].events = POLLIN;}
+		if(poll(pfd, n_client + 1, 100) < 0) continue;
+		for(i=n_client-1; i>=0; i--){
+			cl = client[i];
+			j = (pfd[i+1].revents) ? client_read(cl) : 0;
+			if(j == 0 && stats_clock() - cl->t0 < SERVE_TIMEOUT) continue;
+			if(j > 0) serve_request(cl->fd, cl->line, &queue, &n_queue, running, stage, n_workers, &n_jobs, n_done, n_failed);
+			else close(cl->fd);
+			free(cl);
+			client[i] = client[--n_client];
+		}
+		if(!(pfd[0].revents & POLLIN) || (fd = accept(lfd, NULL, NULL)) < 0) continue;
+		client = realloc(client, (n_client + 1) * sizeof(client_t*));
+		cl = client[n_client++] = mycalloc(1, client_t);
+		cl->fd = fd;
+		cl->t0 = stats_clock();
+	}
+	
+	fprintf(stderr, "[%s] %d jobs done, %d failed\n", __func__, n_done, n_failed);
 	fprintf(stderr, "[%s] cleaning up ... \n", __func__);
-	if(EXON_HT)          fasta_destroy(&EXON_HT);
-	if(KMER_HT)           kmer_destroy(&KMER_HT);
-	if(BAGR_HT)            bag_destory(&BAGR_HT);
-	if(SOLU_HT)  solution_pair_destory(&SOLU_HT);
-	if(SOLU_UNIQ_HT)  solution_pair_destory(&SOLU_UNIQ_HT);
-	if(GENE_HT)           gene_destory(&GENE_HT);
-	if(BACK_HT)           back_destory(&BACK_HT);
-	fprintf(stderr, "[%s] congradualtions! it succeeded! \n", __func__);	
+	shared_destroy(&sh);
+	munmap((void*)stage, n_workers * sizeof(int));
+	free(running);
+	if(queue)  free(queue);
+	if(client) free(client);
+	if(pfd)    free(pfd);
 	return 0;
 }
 
+static int submit_usage(){
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco submit [options] --socket PATH <R1.fq> <R2.fq>\n");
+			fprintf(stderr, "         tafuco submit --socket PATH --status|--stop\n\n");
+			fprintf(stderr, "Details: call fusions of a sample on a running tafuco serve, calls go to\n");
+			fprintf(stderr, "         stdout as in rapid mode and stage timings to stderr as they end\n\n");
+			fprintf(stderr, "Options: -c INT    max read pairs per edge kept for alignment, 0 for all [server's]\n");
+			fprintf(stderr, "         --status  print running and queued jobs\n");
+			fprintf(stderr, "         --stop    finish running and queued jobs and stop the server\n");
+			return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* client of tafuco serve. */
+int submit(int argc, char *argv[]) {
+	struct sockaddr_un addr;
+	char *path = NULL, *req = NULL, line[4096], fq1[PATH_MAX], fq2[PATH_MAX];
+	FILE *fp;
+	int c, fd, max_evidence = -1, ret = 1, done = 0;
+	while ((c = getopt_long(argc, argv, "c:", SERVE_LONG_OPTS, NULL)) >= 0) {
+				switch (c) {
+				case OPT_SOCKET: path = optarg; break;
+				case OPT_STATUS: req = "status"; break;
+				case OPT_STOP: req = "stop"; break;
+				case 'c': max_evidence = atoi(optarg); break;
+				default: return 1;
+		}
+	}
+	if(path == NULL || (req == NULL && optind + 2 > argc)) return submit_usage();
+	if(strlen(path) >= sizeof(addr.sun_path)) die("[%s] socket path %s is too long", __func__, path);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) die("[%s] can't create a socket", __func__);
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) die("[%s] no server on %s", __func__, path);
+	if((fp = fdopen(fd, "r+")) == NULL) die("[%s] fdopen fails", __func__);
+	if(req != NULL){
+		fprintf(fp, "%s\n", req);
+	}else{
+		/* the server may run in another directory */
+		if(realpath(argv[optind], fq1) == NULL) die("[%s] can't find %s", __func__, argv[optind]);
+		if(realpath(argv[optind+1], fq2) == NULL) die("[%s] can't find %s", __func__, argv[optind+1]);
+		fprintf(fp, "run\t%d\t%s\t%s\n", max_evidence, fq1, fq2);
+	}
+	fflush(fp);
+	while(fgets(line, sizeof(line), fp) != NULL){
+		if(line[0] != '#'){fputs(line, stdout); continue;}
+		if(strncmp(line, "#error\t", 7) == 0){fprintf(stderr, "[%s] %s", __func__, line + 7); break;}
+		if(strncmp(line, "#status\t", 8) == 0 || strncmp(line, "#job\t", 5) == 0){fputs(line + 1, stdout); ret = 0; continue;}
+		if(strncmp(line, "#queued\t", 8) == 0 || strncmp(line, "#stage\t", 7) == 0){fprintf(stderr, "[%s] %s", __func__, line + 1); continue;}
+		if(strncmp(line, "#done\t", 6) == 0){
+			fprintf(stderr, "[%s] %s", __func__, line + 1);
+			if(sscanf(line + 6, "%*d\t%d", &ret) != 1) ret = 1;
+			done = 1;
+			break;
+		}
+	}
+	fclose(fp);
+	if(req == NULL && !done){
+		fprintf(stderr, "[%s] the job ended without a result\n", __func__);
+		return 1;
+	}
+	return (ret == 0) ? 0 : 1;
+}
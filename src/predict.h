@@ -19,22 +19,32 @@
 #include "kseq.h"
 #include "alignment.h"
 #include "kmer_uthash.h"
+#include "kmer_index.h"
 #include "bag.h"
 #include "fasta_uthash.h"
+#include "reference.h"
+#include "fastq.h"
+#include "null_model.h"
+#include "stats.h"
 #include "utils.h"
 #include "uthash.h"
 
 //define input parameter valid range 
-#define MAX_KMER_LEN                40
+#define MAX_KMER_LEN                KM_MAX_LEN
 #define MIN_KMER_LEN                10
 #define MIN_MIN_KMER_MATCH          1
 #define MIN_MIN_EDGE_WEIGHT         1
 #define MIN_MIN_HITS                1
 #define MIN_MIN_ALIGN_SCORE         0
 #define MAX_MIN_ALIGN_SCORE         1
+#define MIN_THREADS                 1
+#define MIN_MAX_EVIDENCE            0
+#define MIN_RESYNC                  0
+#define EXON_CACHE_SIZE             64      /* exon concatenations cached per edge */
 #define EPSILON                     0.1
 #define FASTA_NAME                  "./data/exon.fa.gz"
 #define BACKGROUND_FILE             "./data/null.txt"
+#define BACKGROUND_PACK             "./data/null.bin"   /* compiled by nullpack, preferred over BACKGROUND_FILE */
 
 //gene_t object 
 typedef struct {
@@ -42,9 +52,43 @@ typedef struct {
 	int len;
 	int exon_num;
 	int hits;
+	int dups;           /* exact duplicates of the pairs in hits */
     UT_hash_handle hh;
 } gene_t;
 
+/* 
+ * a pair hitting the index seen by bag_scan, keyed by the 128-bit hash
+ * of its reads. exact duplicates only add to the counts of the gene
+ * and the edges of the first copy. the pairs with duplicates are kept
+ * after the scan so that the junction rescan aligns one copy of them.
+ */
+typedef struct {
+	uint64_t key[2];
+	int n;              /* copies seen */
+	int flip;
+	gene_t *gene;       /* the gene whose hits count the pair, NULL if none */
+	int n_edge;
+	bag_t **edge;       /* edges the pair was added to */
+	int pass;           /* last rescan that aligned a copy */
+    UT_hash_handle hh;
+} dup_t;
+
+/*
+ * exons of gene1 and gene2 concatenated by concat_exons for the reads of
+ * an edge, keyed by the exons of both genes hit by a read in the order
+ * they are hit, {n1, n1 exons of gene1, n2, n2 exons of gene2}. the
+ * cache of an edge is kept in least recently used order.
+ */
+typedef struct {
+	int *key;
+	int l_key;          /* bytes of key */
+	char *seq;          /* exons of gene1 then exons of gene2 */
+	int junc_pos;       /* length of the exons of gene1 */
+	char *ename1;       /* last exon of gene1 */
+	char *ename2;       /* first exon of gene2 */
+    UT_hash_handle hh;
+} exon_cache_t;
+
 //opt_t object 
 typedef struct {
 	char* gfile;
@@ -67,25 +111,43 @@ typedef struct {
 	int alpha;
 	double min_align_score;
 	double pvalue;
+	int n_threads;
+	int index_type;       /* KIDX_HASH or KIDX_SORTED */
+	int max_evidence;     /* read pairs kept per edge for alignment, 0 keeps all */
+	uint64_t seed;        /* seed of the evidence reservoir */
+	int flip;             /* R1 on the positive strand, detected by bag_construct */
+	int verbose;          /* report every stage of the pipeline */
+	char *stats;          /* JSON run report, NULL for none */
+	char *checkpoint;     /* directory of stage checkpoints, NULL for none */
+	int resync;           /* reads looked ahead for the mate of an unpaired read, 0 for none */
+	fq_trim_t trim;       /* adapter, quality and low complexity cleaning of reads, off by default */
+	int raw_depth;        /* fuse_score counts exact duplicate pairs */
 } opt_t;
 
-//back_t - the background distribution
+/* evidence of the edge is a reservoir sample of its read pairs */
+#define BAG_SAMPLED(b, opt)         ((opt)->max_evidence > 0 && (b)->n_seen > (opt)->max_evidence)
+
+/* 
+ * state of a run, split so that samples can be called concurrently:
+ * shared_t is built once and only read by the pipeline, every sample 
+ * has its own pipe_t.
+ */
 typedef struct {
-	char* key;
-	int arr_num;
-	float *arr;	
-    UT_hash_handle hh;
-} back_t;
-
-/* global variables */
-static          fasta_t   *EXON_HT          = NULL;  // stores sequences in in.fa
-static           kmer_t   *KMER_HT          = NULL;  // kmer hash table by indexing in.fa
-static            bag_t   *BAGR_HT          = NULL;  // Breakend Associated Graph (BAG)
-static           gene_t   *GENE_HT          = NULL; 
-static  solution_pair_t   *SOLU_HT          = NULL;  // alignment solition of reads against JUN0_HT
-static  solution_pair_t   *SOLU_UNIQ_HT     = NULL;  // alignment solition of reads against JUN0_HT
-static          fasta_t   *GENO_HT          = NULL;
-static           back_t   *BACK_HT          = NULL;
+	fasta_t *exon;          /* exon sequences named gene.idx */
+	kidx_t  *kmer;          /* kmer index of exon */
+	null_t  *back;          /* null model of fusion scores, NULL for 1/200 */
+} shared_t;
+
+typedef struct {
+	const shared_t *sh;
+	opt_t opt;              /* own copy, fq1, fq2 and flip are per sample */
+	bag_t *bag;             /* Breakend Associated Graph (BAG) */
+	gene_t *gene;           /* genes and the pairs hitting them */
+	solution_pair_t *sol;   /* alignments of read pairs against transcripts */
+	stats_t stats;          /* timing and counters of the sample */
+	char *spill;            /* pairs of a stream input hitting a gene, rescanned in its place */
+	dup_t *dups;            /* pairs with exact duplicates, by the hash of their bases */
+} pipe_t;
 
 /* intitlize opt_t object */
 static inline opt_t *opt_init(){
@@ -110,47 +172,22 @@ static inline opt_t *opt_init(){
 	opt->max_mismatch = 2;
 	opt->pvalue=0.05;
 	opt->alpha=3;
+	opt->n_threads=1;
+	opt->index_type=KIDX_HASH;
+	opt->max_evidence=5000;
+	opt->seed=11;
+	opt->flip=0;
+	opt->verbose=1;
+	opt->stats=NULL;
+	opt->checkpoint=NULL;
+	opt->resync=0;
+	opt->trim.adapter=NULL;
+	opt->trim.min_qual=0;
+	opt->trim.min_entropy=0;
+	opt->raw_depth=0;
 	return opt;
 }
 
-/* intilize a back_t object */
-static inline back_t *back_init(){
-	back_t *ret = mycalloc(1, back_t);
-	ret->key    = NULL;
-	ret->arr_num  = 0;
-	ret->arr    = NULL;
-	return ret;
-}
-
-static inline int back_destory(back_t **back){
-	if(*back==NULL) return -1;
-	back_t *back_cur, *back_tmp;
-	HASH_ITER(hh, *back, back_cur, back_tmp) {
-	    HASH_DEL(*back, back_cur);  /* delete; users advances to next */
-		free(back_cur);            /* optional- if you want to free  */
-	}
-	return 0;
-}
-
-static inline back_t *find_back(back_t* back, char* name){
-	if(back==NULL || name==NULL) return NULL;
-	back_t *s = NULL;
-	HASH_FIND_STR(back, name, s);
-	return s;
-}
-
-static inline void display_back(back_t* back){
-	back_t *s;
-	int i;
-	for(s=back; s != NULL; s=s->hh.next){
-		printf("%s: ", s->key);
-		for(i=0; i<s->arr_num; i++){
-			printf("%f\t", s->arr[i]);
-		}
-		printf("\n");
-	}
-}
-
 /* destory opt_t object */
 static inline void destory_opt(opt_t *opt){
 	if(opt->gfile) free(opt->gfile);
@@ -167,6 +204,7 @@ static inline gene_t *gene_init(){
 	instance->name = NULL;
 	instance->exon_num = 0;
 	instance->hits = 0;
+	instance->dups = 0;
 	instance->len = 0;
 	return instance;
 }
@@ -198,6 +236,26 @@ static inline int gene_destory(gene_t **instance){
 	return 0;
 }
 
+/* add the pair of key to dups unless it is in, return it */
+static inline dup_t *dup_add(dup_t **dups, const uint64_t key[2]){
+	dup_t *d;
+	HASH_FIND(hh, *dups, key, 2*sizeof(uint64_t), d);
+	if(d != NULL) return d;
+	d = mycalloc(1, dup_t);
+	memcpy(d->key, key, 2*sizeof(uint64_t));
+	HASH_ADD(hh, *dups, key, 2*sizeof(uint64_t), d);
+	return d;
+}
+
+static inline void dup_destroy(dup_t **dups){
+	dup_t *d, *tmp;
+	HASH_ITER(hh, *dups, d, tmp){
+		HASH_DEL(*dups, d);
+		if(d->edge) free(d->edge);
+		free(d);
+	}
+}
+
 /*
  * usage info
  */
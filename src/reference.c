@@ -0,0 +1,471 @@
+/*--------------------------------------------------------------------*/
+/* reference.c                                                        */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Random access to slices of the reference genome.                   */
+/*--------------------------------------------------------------------*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "reference.h"
+
+static const char REF_NT[] = "ACGT";
+
+/* 1 if fname starts with the gzip magic number */
+static int is_gzip(const char *fname){
+	unsigned char magic[2] = {0, 0};
+	FILE *fp = fopen(fname, "rb");
+	if(fp == NULL) return 0;
+	if(fread(magic, 1, 2, fp) != 2) magic[0] = 0;
+	fclose(fp);
+	return (magic[0] == 0x1f && magic[1] == 0x8b);
+}
+
+/* 1 if fname starts with the refpack magic */
+static int is_pack(const char *fname){
+	char magic[8] = {0};
+	FILE *fp = fopen(fname, "rb");
+	if(fp == NULL) return 0;
+	if(fread(magic, 1, 8, fp) != 8) magic[0] = 0;
+	fclose(fp);
+	return (memcmp(magic, REFPACK_MAGIC, 8) == 0);
+}
+
+static inline int ref_nt4(int c){
+	switch(c){
+		case 'A': case 'a': return 0;
+		case 'C': case 'c': return 1;
+		case 'G': case 'g': return 2;
+		case 'T': case 't': return 3;
+		default: return 4;
+	}
+}
+
+static faidx1_t *fai_add(faidx1_t **fai, char *name){
+	faidx1_t *s;
+	HASH_FIND_STR(*fai, name, s);
+	if(s != NULL) die("[%s] duplicate sequence name %s", __func__, name);
+	s = mycalloc(1, faidx1_t);
+	s->name = strdup(name);
+	HASH_ADD_KEYPTR(hh, *fai, s->name, strlen(s->name), s);
+	return s;
+}
+
+static void fai_destroy(faidx1_t **fai){
+	faidx1_t *cur, *tmp;
+	HASH_ITER(hh, *fai, cur, tmp){
+		HASH_DEL(*fai, cur);
+		free(cur->name);
+		free(cur);
+	}
+}
+
+/* scan an uncompressed fasta and index every sequence */
+static faidx1_t *fai_scan(const char *fname){
+	FILE *fp;
+	faidx1_t *fai = NULL, *s = NULL;
+	char *line = NULL, *p;
+	size_t len = 0;
+	ssize_t n;
+	int64_t offset = 0;
+	int blen, last = 0; /* last - a line shorter than line_blen was seen */
+	if((fp = fopen(fname, "r")) == NULL) return NULL;
+	while((n = getline(&line, &len, fp)) != -1){
+		offset += n;
+		if(line[0] == '>'){
+			for(p=line+1; *p && !isspace((unsigned char)*p); p++);
+			*p = '\0';
+			s = fai_add(&fai, line+1);
+			s->offset = offset;
+			last = 0;
+			continue;
+		}
+		if(s == NULL) continue;
+		for(blen=n; blen>0 && (line[blen-1] == '\n' || line[blen-1] == '\r'); blen--);
+		if(blen == 0){last = 1; continue;}
+		if(s->line_blen == 0){
+			s->line_blen = blen;
+			s->line_len = n;
+		}else if(last || blen > s->line_blen || (blen == s->line_blen && n != s->line_len)){
+			die("[%s] %s has lines of different length in %s, can't be indexed", __func__, fname, s->name);
+		}
+		if(blen < s->line_blen) last = 1;
+		s->len += blen;
+	}
+	if(line) free(line);
+	fclose(fp);
+	return fai;
+}
+
+static int fai_write(faidx1_t *fai, const char *fname){
+	faidx1_t *s;
+	FILE *fp = fopen(fname, "w");
+	if(fp == NULL) return -1;
+	for(s=fai; s!=NULL; s=s->hh.next)
+		fprintf(fp, "%s\t%lld\t%lld\t%d\t%d\n", s->name, (long long)s->len, (long long)s->offset, s->line_blen, s->line_len);
+	fclose(fp);
+	return 0;
+}
+
+static faidx1_t *fai_read(const char *fname){
+	FILE *fp;
+	faidx1_t *fai = NULL, *s;
+	char *line = NULL, name[4096];
+	size_t len = 0;
+	long long l, offset;
+	int blen, llen;
+	if((fp = fopen(fname, "r")) == NULL) return NULL;
+	while(getline(&line, &len, fp) != -1){
+		if(sscanf(line, "%4095s%lld%lld%d%d", name, &l, &offset, &blen, &llen) != 5) die("[%s] %s is not a valid fasta index", __func__, fname);
+		s = fai_add(&fai, name);
+		s->len = l; s->offset = offset;
+		s->line_blen = blen; s->line_len = llen;
+	}
+	if(line) free(line);
+	fclose(fp);
+	return fai;
+}
+
+int fai_build(const char *fname){
+	if(fname == NULL) return -1;
+	faidx1_t *fai;
+	char *fai_name;
+	int ret;
+	if((fai = fai_scan(fname)) == NULL) return -1;
+	fai_name = join(2, (char*)fname, ".fai");
+	ret = fai_write(fai, fai_name);
+	free(fai_name);
+	fai_destroy(&fai);
+	return ret;
+}
+
+int ref_pack(const char *fname, const char *out){
+	if(fname == NULL || out == NULL) return -1;
+	refpack_hdr_t hdr;
+	refpack_seq_t *seqs = NULL;
+	uint64_t *nrun = NULL, n_nrun = 0, m_nrun = 0;
+	char *names = NULL;
+	uint64_t l_names = 0;
+	uint8_t *buf = NULL;
+	size_t m_buf = 0, n_seq = 0, i, bytes;
+	int c, in_n;
+	gzFile fp;
+	kseq_t *seq;
+	FILE *fo;
+	if((fp = gzopen(fname, "r")) == NULL) return -1;
+	if((seq = kseq_init(fp)) == NULL) die("[%s] kseq_init fails", __func__);
+	if((fo = fopen(out, "wb")) == NULL) die("[%s] can't open %s", __func__, out);
+	memset(&hdr, 0, sizeof(hdr));
+	if(fwrite(&hdr, sizeof(hdr), 1, fo) != 1) die("[%s] fail to write %s", __func__, out);
+	while(kseq_read(seq) >= 0){
+		seqs = realloc(seqs, (n_seq+1) * sizeof(refpack_seq_t));
+		seqs[n_seq].len = seq->seq.l;
+		seqs[n_seq].pack_off = ftello(fo);
+		seqs[n_seq].nrun_beg = n_nrun;
+		seqs[n_seq].name_off = l_names;
+		names = realloc(names, l_names + seq->name.l + 1);
+		memcpy(names + l_names, seq->name.s, seq->name.l + 1);
+		l_names += seq->name.l + 1;
+		bytes = (seq->seq.l + 3) / 4;
+		if(bytes > m_buf){m_buf = bytes; buf = realloc(buf, m_buf);}
+		memset(buf, 0, bytes);
+		for(i=0, in_n=0; i<seq->seq.l; i++){
+			if((c = ref_nt4(seq->seq.s[i])) < 4){
+				buf[i>>2] |= c << ((i&3) << 1);
+				in_n = 0;
+				continue;
+			}
+			if(!in_n){ /* open a new N run */
+				if(n_nrun + 2 > m_nrun){m_nrun = (m_nrun) ? m_nrun << 1 : 1024; nrun = realloc(nrun, m_nrun * sizeof(uint64_t));}
+				nrun[n_nrun++] = i;
+				nrun[n_nrun++] = i;
+				in_n = 1;
+			}
+			nrun[n_nrun-1] = i + 1;
+		}
+		seqs[n_seq].nrun_num = (n_nrun - seqs[n_seq].nrun_beg) / 2;
+		seqs[n_seq].nrun_beg /= 2;
+		if(bytes && fwrite(buf, 1, bytes, fo) != bytes) die("[%s] fail to write %s", __func__, out);
+		n_seq++;
+	}
+	/* keep the tables aligned to 8 bytes */
+	while(ftello(fo) % 8) fputc(0, fo);
+	memcpy(hdr.magic, REFPACK_MAGIC, 8);
+	hdr.n_seq = n_seq;
+	hdr.seq_off = ftello(fo);
+	if(n_seq && fwrite(seqs, sizeof(refpack_seq_t), n_seq, fo) != n_seq) die("[%s] fail to write %s", __func__, out);
+	hdr.nrun_off = ftello(fo);
+	if(n_nrun && fwrite(nrun, sizeof(uint64_t), n_nrun, fo) != n_nrun) die("[%s] fail to write %s", __func__, out);
+	hdr.name_off = ftello(fo);
+	if(l_names && fwrite(names, 1, l_names, fo) != l_names) die("[%s] fail to write %s", __func__, out);
+	hdr.size = ftello(fo);
+	if(fseeko(fo, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, fo) != 1) die("[%s] fail to write %s", __func__, out);
+	fclose(fo);
+	fprintf(stderr, "[%s] %zu sequences, %llu N runs, %.1fMB\n", __func__, n_seq, (unsigned long long)n_nrun/2, hdr.size/1048576.0);
+	kseq_destroy(seq);
+	gzclose(fp);
+	if(seqs)  free(seqs);
+	if(nrun)  free(nrun);
+	if(names) free(names);
+	if(buf)   free(buf);
+	return 0;
+}
+
+/* n items of size bytes at off lie within a map of map_size bytes */
+static inline int pack_span(uint64_t off, uint64_t n, uint64_t size, uint64_t map_size){
+	return off <= map_size && n <= (map_size - off) / size;
+}
+
+/* a sequence of a refpack image of map_size bytes lies within it */
+static int pack_check_seq(const uint8_t *map, uint64_t map_size, const refpack_seq_t *s){
+	const refpack_hdr_t *hdr = (const refpack_hdr_t*)map;
+	const uint64_t *nrun = (const uint64_t*)(map + hdr->nrun_off);
+	uint64_t i, name_off;
+	if(s->len / 4 >= map_size || !pack_span(s->pack_off, (s->len + 3) / 4, 1, map_size)) return -1;
+	if(s->nrun_beg > (map_size - hdr->nrun_off) / 16 || !pack_span(hdr->nrun_off + 16 * s->nrun_beg, s->nrun_num, 16, map_size)) return -1;
+	for(i=s->nrun_beg; i<s->nrun_beg+s->nrun_num; i++)
+		if(nrun[2*i] > nrun[2*i+1] || nrun[2*i+1] > s->len || (i > s->nrun_beg && nrun[2*i] < nrun[2*i-1])) return -1;
+	if(s->name_off >= map_size - hdr->name_off) return -1;
+	name_off = hdr->name_off + s->name_off;
+	return (memchr(map + name_off, 0, map_size - name_off) == NULL) ? -1 : 0;
+}
+
+/* map a refpack file and index its sequences by name */
+static int pack_open(ref_t *ref){
+	const refpack_hdr_t *hdr;
+	const refpack_seq_t *seqs;
+	refpack1_t *s;
+	struct stat st;
+	uint64_t i;
+	if((ref->fd = open(ref->fname, O_RDONLY)) < 0 || fstat(ref->fd, &st) != 0) return -1;
+	if(st.st_size < (off_t)sizeof(refpack_hdr_t)) return -1;
+	ref->map_size = st.st_size;
+	if((ref->map = mmap(NULL, ref->map_size, PROT_READ, MAP_SHARED, ref->fd, 0)) == MAP_FAILED){ref->map = NULL; return -1;}
+	hdr = (const refpack_hdr_t*)ref->map;
+	if(hdr->size != ref->map_size) die("[%s] %s is truncated", __func__, ref->fname);
+	/* every table of the header within the file and aligned, then every sequence */
+	if(hdr->seq_off % 8 || hdr->nrun_off % 8 || !pack_span(hdr->seq_off, hdr->n_seq, sizeof(refpack_seq_t), ref->map_size)
+			|| hdr->nrun_off > ref->map_size || hdr->name_off > ref->map_size)
+		die("[%s] %s is corrupt", __func__, ref->fname);
+	seqs = (const refpack_seq_t*)(ref->map + hdr->seq_off);
+	for(i=0; i<hdr->n_seq; i++){
+		if(pack_check_seq(ref->map, ref->map_size, &seqs[i]) != 0) die("[%s] sequence %llu of %s is corrupt", __func__, (unsigned long long)i, ref->fname);
+		s = mycalloc(1, refpack1_t);
+		s->name = (char*)ref->map + hdr->name_off + seqs[i].name_off;
+		s->seq = &seqs[i];
+		HASH_ADD_KEYPTR(hh, ref->pack, s->name, strlen(s->name), s);
+	}
+	return 0;
+}
+
+/* decode bases [beg, end) of a packed sequence to ret */
+static void pack_fetch(ref_t *ref, const refpack_seq_t *s, int64_t beg, int64_t end, char *ret){
+	const refpack_hdr_t *hdr = (const refpack_hdr_t*)ref->map;
+	const uint8_t *p = ref->map + s->pack_off;
+	const uint64_t *nrun = (const uint64_t*)(ref->map + hdr->nrun_off) + 2*s->nrun_beg;
+	uint64_t lo, hi, mid, i, a, b;
+	for(i=beg; i<end; i++) ret[i-beg] = REF_NT[(p[i>>2] >> ((i&3) << 1)) & 3];
+	/* first N run that ends after beg */
+	for(lo=0, hi=s->nrun_num; lo<hi; ){
+		mid = (lo + hi) >> 1;
+		if(nrun[2*mid+1] <= beg) lo = mid + 1; else hi = mid;
+	}
+	for(; lo<s->nrun_num && nrun[2*lo] < end; lo++){
+		a = (nrun[2*lo] > beg) ? nrun[2*lo] : beg;
+		b = (nrun[2*lo+1] < end) ? nrun[2*lo+1] : end;
+		memset(ret + (a - beg), 'N', b - a);
+	}
+}
+
+ref_t *ref_open(const char *fname){
+	if(fname == NULL) return NULL;
+	ref_t *ref;
+	struct stat st_fa, st_fai;
+	char *fai_name;
+	ref = mycalloc(1, ref_t);
+	ref->fname = strdup(fname);
+	ref->fd = -1;
+	if(is_pack(fname)){
+		ref->type = REF_PACK;
+		if(pack_open(ref) != 0){ref_close(ref); return NULL;}
+		return ref;
+	}
+	if(is_gzip(fname)){
+		/* nothing is read until ref_load */
+		ref->type = REF_STREAM;
+		return ref;
+	}
+	ref->type = REF_FAIDX;
+	if(stat(fname, &st_fa) != 0 || (ref->fd = open(fname, O_RDONLY)) < 0){ref_close(ref); return NULL;}
+	fai_name = join(2, (char*)fname, ".fai");
+	if(stat(fai_name, &st_fai) == 0 && st_fai.st_mtime >= st_fa.st_mtime){
+		ref->fai = fai_read(fai_name);
+	}else{
+		fprintf(stderr, "[%s] indexing %s ... \n", __func__, fname);
+		ref->fai = fai_scan(fname);
+		if(ref->fai && fai_write(ref->fai, fai_name) != 0)
+			fprintf(stderr, "[%s] can't write %s, the index is kept in memory\n", __func__, fai_name);
+	}
+	free(fai_name);
+	if(ref->fai == NULL){ref_close(ref); return NULL;}
+	return ref;
+}
+
+/* drop the wanted slices of a REF_STREAM reference */
+static void ref_unload(ref_t *ref){
+	ref_chrom_t *c, *c_tmp;
+	int i;
+	HASH_ITER(hh, ref->want, c, c_tmp){
+		HASH_DEL(ref->want, c);
+		if(c->seq){for(i=0; i<c->n; i++) free(c->seq[i]); free(c->seq);}
+		free(c->iv);
+		free(c->name);
+		free(c);
+	}
+	ref->loaded = 0;
+}
+
+void ref_want(ref_t *ref, const char *chrom, int64_t beg, int64_t end){
+	if(ref == NULL || chrom == NULL || ref->type != REF_STREAM) return;
+	ref_chrom_t *c;
+	/* a new round of wants after a load starts from scratch */
+	if(ref->loaded) ref_unload(ref);
+	HASH_FIND_STR(ref->want, chrom, c);
+	if(c == NULL){
+		c = mycalloc(1, ref_chrom_t);
+		c->name = strdup(chrom);
+		c->len = -1;
+		HASH_ADD_KEYPTR(hh, ref->want, c->name, strlen(c->name), c);
+	}
+	if(c->n == c->m){
+		c->m = (c->m) ? c->m << 1 : 16;
+		c->iv = realloc(c->iv, 2 * c->m * sizeof(int64_t));
+	}
+	c->iv[2*c->n] = (beg < 0) ? 0 : beg;
+	c->iv[2*c->n+1] = (end < beg) ? beg : end;
+	c->n++;
+}
+
+int ref_load(ref_t *ref){
+	if(ref == NULL) return -1;
+	if(ref->type != REF_STREAM || ref->loaded) return 0;
+	gzFile fp;
+	kseq_t *seq;
+	ref_chrom_t *c;
+	int64_t b, e;
+	int i, n = 0;
+	ref->loaded = 1;
+	if((fp = gzopen(ref->fname, "r")) == NULL) return -1;
+	if((seq = kseq_init(fp)) == NULL) die("[%s] kseq_init fails", __func__);
+	/* only one chromosome is held in seq at a time */
+	while(kseq_read(seq) >= 0){
+		HASH_FIND_STR(ref->want, seq->name.s, c);
+		if(c == NULL || c->len >= 0) continue;
+		c->len = seq->seq.l;
+		c->seq = mycalloc(c->n, char*);
+		for(i=0; i<c->n; i++){
+			b = (c->iv[2*i] > c->len) ? c->len : c->iv[2*i];
+			e = (c->iv[2*i+1] > c->len) ? c->len : c->iv[2*i+1];
+			c->iv[2*i] = b; c->iv[2*i+1] = e;
+			c->seq[i] = mycalloc(e - b + 1, char);
+			for(; b<e; b++) c->seq[i][b - c->iv[2*i]] = toupper((unsigned char)seq->seq.s[b]);
+		}
+		if(++n == HASH_COUNT(ref->want)) break;
+	}
+	kseq_destroy(seq);
+	gzclose(fp);
+	return 0;
+}
+
+char *ref_fetch(ref_t *ref, const char *chrom, int64_t beg, int64_t end, int *l){
+	if(ref == NULL || chrom == NULL) return NULL;
+	ref_chrom_t *c = NULL;
+	faidx1_t *s = NULL;
+	refpack1_t *p = NULL;
+	int64_t len, off_beg, off_end;
+	char *buf, *ret;
+	ssize_t n, m;
+	int i, j;
+	if(ref->type == REF_STREAM){
+		if(!ref->loaded) ref_load(ref);
+		HASH_FIND_STR(ref->want, chrom, c);
+		if(c == NULL || c->len < 0) return NULL;
+		len = c->len;
+	}else if(ref->type == REF_PACK){
+		HASH_FIND_STR(ref->pack, chrom, p);
+		if(p == NULL) return NULL;
+		len = p->seq->len;
+	}else{
+		HASH_FIND_STR(ref->fai, chrom, s);
+		if(s == NULL) return NULL;
+		len = s->len;
+	}
+	if(beg < 0) beg = 0;
+	if(end > len) end = len;
+	if(end < beg) end = beg;
+	*l = end - beg;
+	ret = mycalloc(*l + 1, char);
+	if(*l == 0) return ret;
+	if(ref->type == REF_STREAM){
+		/* slices are usually fetched in the order they were wanted */
+		for(j=0; j<c->n; j++){
+			i = (c->cur + j) % c->n;
+			if(c->iv[2*i] > beg || c->iv[2*i+1] < end) continue;
+			memcpy(ret, &c->seq[i][beg - c->iv[2*i]], *l);
+			c->cur = i;
+			return ret;
+		}
+		die("[%s] %s:%lld-%lld was not wanted before %s was loaded", __func__, chrom, (long long)beg, (long long)end, ref->fname);
+	}
+	if(ref->type == REF_PACK){
+		pack_fetch(ref, p->seq, beg, end, ret);
+		return ret;
+	}
+	off_beg = s->offset + beg / s->line_blen * s->line_len + beg % s->line_blen;
+	off_end = s->offset + (end-1) / s->line_blen * s->line_len + (end-1) % s->line_blen + 1;
+	buf = mycalloc(off_end - off_beg, char);
+	for(n=0; n < off_end - off_beg; n += m){
+		if((m = pread(ref->fd, buf + n, off_end - off_beg - n, off_beg + n)) <= 0)
+			die("[%s] fail to read %s:%lld-%lld from %s", __func__, chrom, (long long)beg, (long long)end, ref->fname);
+	}
+	for(i=0, j=0; i<n && j<*l; i++){
+		if(buf[i] == '\n' || buf[i] == '\r') continue;
+		ret[j++] = toupper((unsigned char)buf[i]);
+	}
+	free(buf);
+	return ret;
+}
+
+void ref_close(ref_t *ref){
+	if(ref == NULL) return;
+	refpack1_t *cur, *tmp;
+	HASH_ITER(hh, ref->pack, cur, tmp){
+		HASH_DEL(ref->pack, cur);
+		free(cur);
+	}
+	if(ref->map)     munmap((void*)ref->map, ref->map_size);
+	ref_unload(ref);
+	if(ref->fai)     fai_destroy(&ref->fai);
+	if(ref->fd >= 0) close(ref->fd);
+	if(ref->fname)   free(ref->fname);
+	free(ref);
+}
+
+int refpack_usage(){
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco refpack <in.fa> <out.pack>\n\n");
+			fprintf(stderr, "Details: refpack packs a reference genome into 2 bits per base, out.pack\n");
+			fprintf(stderr, "         can replace in.fa for predict and name2fasta\n\n");
+			fprintf(stderr, "Inputs:  in.fa            .fa file contains the whole genome sequence e.g. [hg19.fa]\n");
+			fprintf(stderr, "         out.pack         packed genome\n");
+			return 1;
+}
+
+int refpack(int argc, char *argv[]) {
+	if (argc < 3) return refpack_usage();
+	fprintf(stderr, "[%s] packing %s ... \n", __func__, argv[1]);
+	if(ref_pack(argv[1], argv[2]) != 0) die("[%s] can't pack %s", __func__, argv[1]);
+	return 0;
+}
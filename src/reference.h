@@ -0,0 +1,144 @@
+/*--------------------------------------------------------------------*/
+/* reference.h                                                        */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Random access to slices of the reference genome.                   */
+/*--------------------------------------------------------------------*/
+/* An uncompressed fasta is read through its faidx index (in.fa.fai), */
+/* which is built next to in.fa the first time it is opened. Only the */
+/* requested bases are read from disk with pread, so extracting exons */
+/* of a few hundred genes from hg19 takes tens of MB instead of       */
+/* loading the whole genome. A gzip'd fasta can't be read at random,  */
+/* the intervals needed are registered with ref_want first, ref_load  */
+/* then streams the fasta one chromosome at a time and only keeps the */
+/* wanted slices, memory is bounded by the largest chromosome.        */
+/*                                                                    */
+/* tafuco refpack converts a fasta into a 2-bit packed file that is   */
+/* memory mapped by ref_open, so that concurrent jobs share one copy  */
+/* through the page cache and nothing is parsed at startup. Layout:   */
+/*   refpack_hdr_t                                                    */
+/*   packed bases, every sequence starts at a byte boundary           */
+/*   refpack_seq_t[n_seq]                                             */
+/*   N runs, [beg, end) pairs of uint64_t sorted within a sequence    */
+/*   sequence names, NUL terminated                                   */
+/* any base other than A, C, G or T is stored as N.                   */
+/*--------------------------------------------------------------------*/
+
+#ifndef _REFERENCE_H
+#define _REFERENCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "fasta_uthash.h"
+#include "uthash.h"
+#include "utils.h"
+
+#define REF_STREAM         0    /* wanted slices of a streamed (gzip'd) fasta */
+#define REF_FAIDX          1    /* uncompressed fasta read through .fai */
+#define REF_PACK           2    /* memory mapped file written by refpack */
+
+#define REFPACK_MAGIC      "TFCPACK1"
+
+typedef struct {
+	char magic[8];
+	uint64_t n_seq;
+	uint64_t seq_off;       /* file offset of refpack_seq_t[n_seq] */
+	uint64_t nrun_off;      /* file offset of the N runs */
+	uint64_t name_off;      /* file offset of the names */
+	uint64_t size;          /* file size */
+} refpack_hdr_t;
+
+typedef struct {
+	uint64_t len;           /* number of bases */
+	uint64_t pack_off;      /* file offset of the packed bases */
+	uint64_t nrun_beg;      /* first N run of the sequence */
+	uint64_t nrun_num;      /* number of N runs */
+	uint64_t name_off;      /* offset of the name in the name block */
+} refpack_seq_t;
+
+/* a sequence of the mapped refpack file */
+typedef struct {
+	char *name;
+	const refpack_seq_t *seq;
+	UT_hash_handle hh;
+} refpack1_t;
+
+/* slices wanted from one chromosome of a streamed fasta */
+typedef struct {
+	char *name;
+	int64_t len;            /* -1 until the chromosome is read */
+	int n, m;
+	int cur;                /* slice of the last ref_fetch */
+	int64_t *iv;            /* n [beg, end) intervals */
+	char **seq;             /* sequence of every interval, filled by ref_load */
+	UT_hash_handle hh;
+} ref_chrom_t;
+
+/* one line of a .fai file */
+typedef struct {
+	char *name;
+	int64_t len;            /* number of bases */
+	int64_t offset;         /* file offset of the first base */
+	int line_blen;          /* bases per line */
+	int line_len;           /* bytes per line including the line end */
+	UT_hash_handle hh;
+} faidx1_t;
+
+typedef struct {
+	int type;               /* REF_STREAM, REF_FAIDX or REF_PACK */
+	char *fname;
+	ref_chrom_t *want;      /* REF_STREAM */
+	int loaded;             /* REF_STREAM, ref_load has been called */
+	int fd;                 /* REF_FAIDX */
+	faidx1_t *fai;          /* REF_FAIDX */
+	const uint8_t *map;     /* REF_PACK */
+	size_t map_size;        /* REF_PACK */
+	refpack1_t *pack;       /* REF_PACK */
+} ref_t;
+
+/* build fname.fai, return 0 on success */
+int fai_build(const char *fname);
+
+/* convert fasta fname (gz ok) into a refpack file, return 0 on success */
+int ref_pack(const char *fname, const char *out);
+
+/*
+ * open a reference genome, fname is a refpack file or a fasta, use or
+ * build fname.fai if the fasta is not compressed, return NULL if fname
+ * can't be read.
+ */
+ref_t *ref_open(const char *fname);
+
+/*
+ * register [beg, end) of chrom to be fetched later, only needed for a
+ * REF_STREAM reference and ignored otherwise.
+ */
+void ref_want(ref_t *ref, const char *chrom, int64_t beg, int64_t end);
+
+/* read the wanted slices of a REF_STREAM reference, return 0 on success */
+int ref_load(ref_t *ref);
+
+/*
+ * upper case bases [beg, end) of chrom (0-based), clipped at the end
+ * of chrom. return NULL if chrom is not in the reference, *l is set to
+ * the number of bases returned. a REF_STREAM reference only returns
+ * intervals within a slice registered by ref_want, it is loaded on the
+ * first call if ref_load was not called.
+ */
+char *ref_fetch(ref_t *ref, const char *chrom, int64_t beg, int64_t end, int *l);
+
+void ref_close(ref_t *ref);
+
+/*
+ * usage info
+ */
+int refpack_usage();
+
+/*
+ * main function of tafuco refpack
+ */
+int refpack(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,178 @@
+/*--------------------------------------------------------------------*/
+/* shard.c                                                            */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Partial Breakend Associated Graphs of a part of the reads.         */
+/*--------------------------------------------------------------------*/
+
+#include <ctype.h>
+#include "shard.h"
+
+static const char SHARD_NT16[] = "=ACMGRSVTWYHKDBN";
+
+/* 4-bit code of base c, N for anything else */
+static inline int shard_code(char c){
+	const char *p;
+	if(c == 0 || (p = strchr(SHARD_NT16, toupper((unsigned char)c))) == NULL) return 15;
+	return p - SHARD_NT16;
+}
+
+static int put_str(FILE *fp, const char *s){
+	uint16_t l = strlen(s);
+	return (fwrite(&l, 2, 1, fp) == 1 && fwrite(s, 1, l, fp) == (size_t)l) ? 0 : -1;
+}
+
+static char *get_str(FILE *fp){
+	uint16_t l;
+	char *s;
+	if(fread(&l, 2, 1, fp) != 1) return NULL;
+	s = mycalloc(l + 1, char);
+	if(fread(s, 1, l, fp) != (size_t)l){free(s); return NULL;}
+	return s;
+}
+
+/* evidence read1_read2 as l1, l2 and the packed bases */
+int shard_put_pair(FILE *fp, const char *evidence){
+	const char *r2 = strchr(evidence, '_');
+	uint16_t l[2];
+	uint8_t buf[1024];
+	size_t m;
+	int i, n;
+	if(r2 == NULL) return -1;
+	l[0] = r2 - evidence; r2++;
+	l[1] = strlen(r2);
+	if(fwrite(l, 2, 2, fp) != 2) return -1;
+	for(i=0, m=0, n=l[0]+l[1]; i<n; i+=2){
+		buf[m++] = shard_code((i < l[0]) ? evidence[i] : r2[i-l[0]]) << 4 | ((i + 1 < n) ? shard_code((i + 1 < l[0]) ? evidence[i+1] : r2[i+1-l[0]]) : 0);
+		if(m == sizeof(buf)){if(fwrite(buf, 1, m, fp) != m) return -1; m = 0;}
+	}
+	return (fwrite(buf, 1, m, fp) == m) ? 0 : -1;
+}
+
+char *shard_get_pair(FILE *fp){
+	uint16_t l[2];
+	uint8_t *buf;
+	char *s;
+	int i, j, n;
+	if(fread(l, 2, 2, fp) != 2) return NULL;
+	n = l[0] + l[1];
+	buf = mycalloc((n + 1) / 2 + 1, uint8_t);
+	if(fread(buf, 1, (n + 1) / 2, fp) != (size_t)(n + 1) / 2){free(buf); return NULL;}
+	s = mycalloc(n + 2, char);
+	for(i=j=0; i<n; i++){
+		if(i == l[0]) s[j++] = '_';
+		s[j++] = SHARD_NT16[(buf[i>>1] >> ((i & 1) ? 0 : 4)) & 0xf];
+	}
+	if(l[1] == 0) s[j++] = '_';
+	free(buf);
+	return s;
+}
+
+int shard_write(const shard_t *shard, const char *fname){
+	if(shard == NULL || fname == NULL) return -1;
+	shard_hdr_t hdr = shard->hdr;
+	bag_t *e;
+	uint32_t u[3];
+	uint64_t j;
+	FILE *fp;
+	int i, ret = 0;
+	if((fp = fopen(fname, "wb")) == NULL) return -1;
+	memcpy(hdr.magic, SHARD_MAGIC, 8);
+	hdr.n_edge = HASH_COUNT(shard->bag);
+	if(fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || put_str(fp, (shard->adapter) ? shard->adapter : "") != 0) ret = -1;
+	for(j=0; ret==0 && j<hdr.n_gene; j++){
+		u[0] = shard->hits[j]; u[1] = shard->dups[j];
+		if(put_str(fp, shard->gene[j]) != 0 || fwrite(u, 4, 2, fp) != 2) ret = -1;
+	}
+	for(e=shard->bag; ret==0 && e!=NULL; e=e->hh.next){
+		u[0] = e->n_seen; u[1] = e->n_dup; u[2] = e->n_evidence;
+		if(put_str(fp, e->edge) != 0 || fwrite(u, 4, 3, fp) != 3) ret = -1;
+		for(i=0; ret==0 && i<e->n_evidence; i++)
+			if(put_str(fp, e->read_names[i]) != 0 || shard_put_pair(fp, e->evidence[i]) != 0 || fwrite(e->key + 2*i, 8, 2, fp) != 2) ret = -1;
+	}
+	if(ret == 0 && hdr.n_pair > 0 && fwrite(shard->pair, sizeof(shard_pair_t), hdr.n_pair, fp) != hdr.n_pair) ret = -1;
+	if(ret == 0 && hdr.n_pair_edge > 0 && fwrite(shard->pair_edge, 4, hdr.n_pair_edge, fp) != hdr.n_pair_edge) ret = -1;
+	if(fclose(fp) != 0) ret = -1;
+	return ret;
+}
+
+shard_t *shard_read(const char *fname){
+	if(fname == NULL) return NULL;
+	shard_t *shard;
+	bag_t *e;
+	uint32_t u[3];
+	uint64_t i, j;
+	FILE *fp;
+	if((fp = fopen(fname, "rb")) == NULL) return NULL;
+	shard = mycalloc(1, shard_t);
+	if(fread(&shard->hdr, sizeof(shard_hdr_t), 1, fp) != 1 || memcmp(shard->hdr.magic, SHARD_MAGIC, 8) != 0) goto FAIL;
+	if((shard->adapter = get_str(fp)) == NULL) goto FAIL;
+	if(shard->adapter[0] == '\0'){free(shard->adapter); shard->adapter = NULL;}
+	shard->gene = mycalloc(shard->hdr.n_gene + 1, char*);
+	shard->hits = mycalloc(shard->hdr.n_gene + 1, int);
+	shard->dups = mycalloc(shard->hdr.n_gene + 1, int);
+	for(i=0; i<shard->hdr.n_gene; i++){
+		if((shard->gene[i] = get_str(fp)) == NULL || fread(u, 4, 2, fp) != 2) goto FAIL;
+		shard->hits[i] = u[0];
+		shard->dups[i] = u[1];
+	}
+	for(i=0; i<shard->hdr.n_edge; i++){
+		e = bag_init();
+		if((e->edge = get_str(fp)) == NULL || fread(u, 4, 3, fp) != 3){free(e->edge); free(e->read_names); free(e->evidence); free(e->prof); free(e); goto FAIL;}
+		HASH_ADD_STR(shard->bag, edge, e);
+		e->weight = e->n_seen = u[0];
+		e->n_dup = u[1];
+		e->read_names = realloc(e->read_names, (u[2] + 1) * sizeof(char*));
+		e->evidence = realloc(e->evidence, (u[2] + 1) * sizeof(char*));
+		e->prof = realloc(e->prof, (u[2] + 1) * sizeof(hit_prof_t*));
+		memset(e->prof, 0, (u[2] + 1) * sizeof(hit_prof_t*));
+		e->key = mycalloc(2 * (u[2] + 1), uint64_t);
+		for(j=0; j<u[2]; j++, e->n_evidence++){
+			if((e->read_names[j] = get_str(fp)) == NULL) goto FAIL;
+			if((e->evidence[j] = shard_get_pair(fp)) == NULL){free(e->read_names[j]); goto FAIL;}
+			if(fread(e->key + 2*j, 8, 2, fp) != 2){free(e->read_names[j]); free(e->evidence[j]); goto FAIL;}
+		}
+	}
+	shard->pair = mycalloc(shard->hdr.n_pair + 1, shard_pair_t);
+	if(fread(shard->pair, sizeof(shard_pair_t), shard->hdr.n_pair, fp) != shard->hdr.n_pair) goto FAIL;
+	shard->pair_edge = mycalloc(shard->hdr.n_pair_edge + 1, uint32_t);
+	if(fread(shard->pair_edge, 4, shard->hdr.n_pair_edge, fp) != shard->hdr.n_pair_edge) goto FAIL;
+	for(i=0; i<shard->hdr.n_pair; i++){
+		if(shard->pair[i].gene < -1 || shard->pair[i].gene >= (int64_t)shard->hdr.n_gene) goto FAIL;
+		if((uint64_t)shard->pair[i].edge + shard->pair[i].n_edge > shard->hdr.n_pair_edge) goto FAIL;
+	}
+	for(i=0; i<shard->hdr.n_pair_edge; i++) if(shard->pair_edge[i] >= shard->hdr.n_edge) goto FAIL;
+	fclose(fp);
+	return shard;
+	FAIL:
+		fclose(fp);
+		shard_destroy(shard);
+		return NULL;
+}
+
+void shard_destroy(shard_t *shard){
+	if(shard == NULL) return;
+	bag_t *e, *tmp;
+	uint64_t i;
+	int j;
+	if(shard->gene){
+		for(i=0; i<shard->hdr.n_gene; i++) if(shard->gene[i]) free(shard->gene[i]);
+		free(shard->gene);
+	}
+	if(shard->hits) free(shard->hits);
+	if(shard->dups) free(shard->dups);
+	if(shard->pair) free(shard->pair);
+	if(shard->pair_edge) free(shard->pair_edge);
+	if(shard->adapter) free(shard->adapter);
+	HASH_ITER(hh, shard->bag, e, tmp){
+		HASH_DEL(shard->bag, e);
+		for(j=0; j<e->n_evidence; j++){free(e->read_names[j]); free(e->evidence[j]); free(e->prof[j]);}
+		free(e->read_names);
+		free(e->evidence);
+		free(e->prof);
+		free(e->key);
+		free(e->edge);
+		free(e);
+	}
+	free(shard);
+}
@@ -0,0 +1,93 @@
+/*--------------------------------------------------------------------*/
+/* shard.h                                                            */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Partial Breakend Associated Graphs of a part of the reads.         */
+/*--------------------------------------------------------------------*/
+/* tafuco scan builds the graph of one part (shard) of a sample and   */
+/* writes it before genes are ordered, tafuco merge adds the shards   */
+/* up and goes on with junctions and scoring. Layout:                 */
+/*   shard_hdr_t                                                      */
+/*   {uint16 l, adapter[l]} --adapter of the scan, l is 0 if none     */
+/*   n_gene x {uint16 l, name[l], uint32 hits, uint32 dups}           */
+/*   n_edge x {uint16 l, edge[l], uint32 n_seen, uint32 n_dup,        */
+/*             uint32 n_evidence,                                     */
+/*             n_evidence x {uint16 l, read_name[l], uint16 l1,       */
+/*             uint16 l2, packed bases of read1 then read2,           */
+/*             uint64 key[2]}}                                        */
+/*   n_pair x shard_pair_t, every pair with hits                      */
+/*   n_pair_edge x {uint32 index of an edge above} edges of the pairs */
+/* keys are fq_hash of the pairs, merge counts a pair read by more    */
+/* than one shard once.                                               */
+/* bases are packed two per byte as 4-bit codes of "=ACMGRSVTWYHKDBN" */
+/* like BAM, integers are in the byte order of the machine.           */
+/*--------------------------------------------------------------------*/
+
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+#include "uthash.h"
+#include "bag.h"
+
+#define SHARD_MAGIC     "TFCBAG05"
+
+typedef struct {
+	char magic[8];
+	int32_t k;              /* options the shard was scanned with */
+	int32_t min_kmer_match;
+	int32_t max_evidence;
+	int32_t resync;
+	int32_t min_qual;       /* read cleaning of the scan but the adapter */
+	int32_t pad;
+	double min_entropy;
+	uint64_t seed;
+	uint64_t pairs_scanned;
+	uint64_t pairs_std;     /* informative pairs with R2 on the positive strand */
+	uint64_t pairs_flip;    /* informative pairs with R1 on the positive strand */
+	uint64_t n_gene;
+	uint64_t n_edge;
+	uint64_t n_pair;
+	uint64_t n_pair_edge;
+} shard_hdr_t;
+
+/* a pair with hits of the shard */
+typedef struct {
+	uint64_t key[2];        /* fq_hash of the pair */
+	int32_t gene;           /* index of the gene its hits count, -1 if none */
+	uint32_t n;             /* copies of the pair in the shard */
+	uint32_t n_edge;        /* edges the pair was added to */
+	uint32_t edge;          /* offset of their indices in pair_edge */
+} shard_pair_t;
+
+typedef struct {
+	shard_hdr_t hdr;
+	char **gene;            /* genes hit by at least one pair */
+	int *hits;
+	int *dups;              /* exact duplicates of the pairs in hits */
+	bag_t *bag;             /* edges with their kept pairs, read1_read2 */
+	shard_pair_t *pair;     /* every pair with hits */
+	uint32_t *pair_edge;    /* indices of the edges of the pairs, in the order of bag */
+	char *adapter;          /* --adapter of the scan, NULL if none */
+} shard_t;
+
+/* write shard to fname, return 0 on success */
+int shard_write(const shard_t *shard, const char *fname);
+
+/* read a shard written by shard_write, NULL if fname is not a shard */
+shard_t *shard_read(const char *fname);
+
+/* free shard and its graph, set the graph to NULL before if it is kept */
+void shard_destroy(shard_t *shard);
+
+/* write evidence read1_read2 as l1, l2 and packed bases, 0 on success */
+int shard_put_pair(FILE *fp, const char *evidence);
+
+/* read a pair written by shard_put_pair as read1_read2, NULL on failure */
+char *shard_get_pair(FILE *fp);
+
+#endif
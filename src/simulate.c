@@ -0,0 +1,351 @@
+/*--------------------------------------------------------------------*/
+/* simulate.c                                                         */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Simulation of pair-end RNA-seq reads from transcripts.             */
+/*--------------------------------------------------------------------*/
+
+#include <math.h>
+#include <unistd.h>
+#include "simulate.h"
+#include "bag.h"
+
+static const char SIM_NT[] = "ACGT";
+
+/* one exon of one transcript */
+typedef struct {
+	char *tx;               /* gene|transcript_id */
+	char *gene;
+	int idx;                /* exon number, increasing with the end position */
+	int minus;
+	char *seq;
+} sim_exon_t;
+
+/* exons of a transcript together, 5'->3' */
+static int sim_exon_cmp(const void *a, const void *b){
+	const sim_exon_t *x = (const sim_exon_t*)a, *y = (const sim_exon_t*)b;
+	int rc = strcmp(x->tx, y->tx);
+	if(rc != 0) return rc;
+	return (x->minus) ? y->idx - x->idx : x->idx - y->idx;
+}
+
+/* uniform in [0, 1) */
+static inline double sim_unif(uint64_t *rng){
+	return (bag_rand(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* standard normal, Box-Muller */
+static inline double sim_norm(uint64_t *rng){
+	double u = 1.0 - sim_unif(rng), v = sim_unif(rng);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+sim_tx_t *sim_transcripts(const char *fname, int *n){
+	if(fname == NULL) return NULL;
+	sim_exon_t *ex = NULL;
+	sim_tx_t *tx = NULL;
+	char *tok[64], *p, *save, *gene, *tx_ids, *t, *dot, **seqs = NULL;
+	int n_ex = 0, m_ex = 0, n_seq = 0, n_tok, i, j, minus;
+	size_t l;
+	gzFile fp;
+	kseq_t *seq;
+	*n = 0;
+	if((fp = gzopen(fname, "r")) == NULL) return NULL;
+	if((seq = kseq_init(fp)) == NULL) die("[%s] kseq_init fails", __func__);
+	while(kseq_read(seq) >= 0){
+		if(seq->comment.l == 0 || (dot = strrchr(seq->name.s, '.')) == NULL) continue;
+		for(n_tok=0, p=strtok_r(seq->comment.s, " \t", &save); p!=NULL && n_tok<64; p=strtok_r(NULL, " \t", &save)) tok[n_tok++] = p;
+		gene = tx_ids = NULL; minus = 0;
+		for(i=0; i+1<n_tok; i++){
+			if(strcmp(tok[i], "strand") == 0)        minus = (strcmp(tok[i+1], "-") == 0);
+			if(strcmp(tok[i], "gene_name") == 0)     gene = tok[i+1];
+			if(strcmp(tok[i], "transcript_id") == 0) tx_ids = tok[i+1];
+		}
+		if(gene == NULL || tx_ids == NULL) continue;
+		/* exon sequences are shared by the transcripts */
+		p = strToUpper(seq->seq.s);
+		seqs = realloc(seqs, (n_seq + 1) * sizeof(char*));
+		seqs[n_seq++] = p;
+		for(t=strtok_r(tx_ids, "|", &save); t!=NULL; t=strtok_r(NULL, "|", &save)){
+			if(n_ex == m_ex){m_ex = (m_ex) ? m_ex << 1 : 1024; ex = realloc(ex, m_ex * sizeof(sim_exon_t));}
+			ex[n_ex].tx = join(3, gene, "|", t);
+			ex[n_ex].gene = strdup(gene);
+			ex[n_ex].idx = atoi(dot + 1);
+			ex[n_ex].minus = minus;
+			ex[n_ex].seq = p;
+			n_ex++;
+		}
+	}
+	kseq_destroy(seq);
+	gzclose(fp);
+	qsort(ex, n_ex, sizeof(sim_exon_t), sim_exon_cmp);
+	for(i=0; i<n_ex; i=j){
+		for(j=i, l=0; j<n_ex && strcmp(ex[j].tx, ex[i].tx) == 0; j++) l += strlen(ex[j].seq);
+		tx = realloc(tx, (*n + 1) * sizeof(sim_tx_t));
+		tx[*n].name = strdup(ex[i].tx);
+		tx[*n].gene = strdup(ex[i].gene);
+		tx[*n].seq = mycalloc(l + 1, char);
+		tx[*n].l = l;
+		tx[*n].exon = mycalloc(j - i, int);
+		tx[*n].end = mycalloc(j - i, int);
+		tx[*n].n_exon = 0;
+		for(j=i, l=0; j<n_ex && strcmp(ex[j].tx, ex[i].tx) == 0; j++){
+			strcpy(tx[*n].seq + l, ex[j].seq);
+			l += strlen(ex[j].seq);
+			tx[*n].exon[tx[*n].n_exon] = ex[j].idx;
+			tx[*n].end[tx[*n].n_exon++] = l;
+		}
+		(*n)++;
+	}
+	for(i=0; i<n_ex; i++){
+		free(ex[i].tx);
+		free(ex[i].gene);
+	}
+	for(i=0; i<n_seq; i++) free(seqs[i]);
+	if(seqs) free(seqs);
+	if(ex)   free(ex);
+	return tx;
+}
+
+void sim_transcripts_destroy(sim_tx_t *tx, int n){
+	int i;
+	if(tx == NULL) return;
+	for(i=0; i<n; i++){
+		free(tx[i].name);
+		free(tx[i].gene);
+		free(tx[i].seq);
+		free(tx[i].exon);
+		free(tx[i].end);
+	}
+	free(tx);
+}
+
+/* copy l bases of s to read, reverse complemented if rc, with errors */
+static void sim_read(const char *s, int l, int rc, const sim_opt_t *opt, uint64_t *rng, char *read, char *qual){
+	const char *b;
+	int i, c, q;
+	double e;
+	for(i=0; i<l; i++){
+		c = (rc) ? s[l-1-i] : s[i];
+		if(rc){
+			switch(c){
+				case 'A': c = 'T'; break;
+				case 'C': c = 'G'; break;
+				case 'G': c = 'C'; break;
+				case 'T': c = 'A'; break;
+				default:  c = 'N'; break;
+			}
+		}
+		e = opt->err * (0.5 + ((l > 1) ? (double)i / (l - 1) : 0.5));
+		if(sim_unif(rng) < e){
+			b = strchr(SIM_NT, c);
+			c = (b != NULL) ? SIM_NT[(b - SIM_NT + 1 + bag_rand(rng) % 3) & 3] : SIM_NT[bag_rand(rng) & 3];
+		}
+		q = (e > 0) ? (int)(-10.0 * log10(e) + 0.5) : 41;
+		q = (q < 2) ? 2 : (q > 41) ? 41 : q;
+		read[i] = c;
+		qual[i] = 33 + q;
+	}
+	read[l] = qual[l] = '\0';
+}
+
+/* the pair of fragment [p, p+fl) of s named prefix n */
+static void sim_pair_write(const char *s, int p, int fl, const sim_opt_t *opt, uint64_t *rng, const char *prefix, long n, char *up, char *dn, char *q_up, char *q_dn, FILE *fo1, FILE *fo2){
+	int L = opt->read_len;
+	sim_read(s + p, L, 0, opt, rng, up, q_up);
+	sim_read(s + p + fl - L, L, 1, opt, rng, dn, q_dn);
+	fprintf(fo1, "@%s%ld/1\n%s\n+\n%s\n", prefix, n, (opt->flip) ? up : dn, (opt->flip) ? q_up : q_dn);
+	fprintf(fo2, "@%s%ld/2\n%s\n+\n%s\n", prefix, n, (opt->flip) ? dn : up, (opt->flip) ? q_dn : q_up);
+}
+
+long sim_pairs(const sim_tx_t *tx, int n_tx, long n_pairs, const sim_opt_t *opt, uint64_t *rng, const char *prefix, FILE *fo1, FILE *fo2){
+	if(tx == NULL || n_tx <= 0 || opt == NULL) return 0;
+	double *cum = mycalloc(n_tx, double), x;
+	char *up, *dn, *q_up, *q_dn;
+	int i, lo, hi, fl, p, L = opt->read_len;
+	long n;
+	/* expression level of every transcript in this library */
+	for(i=0; i<n_tx; i++){
+		x = (tx[i].l >= L) ? tx[i].l * exp(opt->expr_sd * sim_norm(rng)) : 0;
+		cum[i] = ((i) ? cum[i-1] : 0) + x;
+	}
+	if(cum[n_tx-1] <= 0){free(cum); return 0;}
+	up = mycalloc(L + 1, char); dn = mycalloc(L + 1, char);
+	q_up = mycalloc(L + 1, char); q_dn = mycalloc(L + 1, char);
+	for(n=0; n<n_pairs; n++){
+		x = sim_unif(rng) * cum[n_tx-1];
+		for(lo=0, hi=n_tx-1; lo<hi; ){
+			i = (lo + hi) >> 1;
+			if(cum[i] > x) hi = i; else lo = i + 1;
+		}
+		fl = (int)(opt->frag_mean + opt->frag_sd * sim_norm(rng) + 0.5);
+		fl = (fl < L) ? L : (fl > tx[lo].l) ? tx[lo].l : fl;
+		p = bag_rand(rng) % (tx[lo].l - fl + 1);
+		sim_pair_write(tx[lo].seq, p, fl, opt, rng, prefix, n, up, dn, q_up, q_dn, fo1, fo2);
+	}
+	free(up); free(dn); free(q_up); free(q_dn);
+	free(cum);
+	return n;
+}
+
+/* longest transcript of gene that has exon, any exon if exon < 1, -1 if none */
+static int sim_longest(const sim_tx_t *tx, int n_tx, const char *gene, int exon, int *pos){
+	int i, j, best = -1;
+	for(i=0; i<n_tx; i++){
+		if(strcmp(tx[i].gene, gene) != 0 || (best >= 0 && tx[i].l <= tx[best].l)) continue;
+		for(j=0; j<tx[i].n_exon && exon >= 1 && tx[i].exon[j] != exon; j++);
+		if(j == tx[i].n_exon) continue;
+		best = i;
+		*pos = j;
+	}
+	return best;
+}
+
+int sim_fusion(const sim_tx_t *tx, int n_tx, const char *gene1, int exon1, const char *gene2, int exon2, sim_fusion_t *fu){
+	int i1, i2, j1, j2, b1, b2;
+	if(tx == NULL || gene1 == NULL || gene2 == NULL || fu == NULL) return -1;
+	if((i1 = sim_longest(tx, n_tx, gene1, exon1, &j1)) < 0) return -1;
+	if((i2 = sim_longest(tx, n_tx, gene2, exon2, &j2)) < 0) return -1;
+	if(exon1 < 1) j1 = (tx[i1].n_exon - 1) / 2;
+	if(exon2 < 1) j2 = tx[i2].n_exon / 2;
+	b1 = tx[i1].end[j1];                               /* gene1 is [0, b1) */
+	b2 = (j2) ? tx[i2].end[j2-1] : 0;                  /* gene2 is [b2, l) */
+	fu->gene1 = strdup(gene1);
+	fu->gene2 = strdup(gene2);
+	fu->exon1 = tx[i1].exon[j1];
+	fu->exon2 = tx[i2].exon[j2];
+	fu->junction = b1;
+	fu->l = b1 + tx[i2].l - b2;
+	fu->seq = mycalloc(fu->l + 1, char);
+	memcpy(fu->seq, tx[i1].seq, b1);
+	memcpy(fu->seq + b1, tx[i2].seq + b2, tx[i2].l - b2);
+	return 0;
+}
+
+void sim_fusion_destroy(sim_fusion_t *fu){
+	if(fu == NULL) return;
+	free(fu->gene1);
+	free(fu->gene2);
+	free(fu->seq);
+}
+
+long sim_fusion_pairs(const sim_fusion_t *fu, long n_pairs, const sim_opt_t *opt, uint64_t *rng, FILE *fo1, FILE *fo2, long *n_span){
+	char *up, *dn, *q_up, *q_dn, *span, *enc;
+	int fl, lo, hi, p, J, L = opt->read_len;
+	long n, try;
+	*n_span = 0;
+	if(fu == NULL || fu->l < L + 1) return 0;
+	J = fu->junction;
+	up = mycalloc(L + 1, char); dn = mycalloc(L + 1, char);
+	q_up = mycalloc(L + 1, char); q_dn = mycalloc(L + 1, char);
+	span = join(4, fu->gene1, "_", fu->gene2, ".span.");
+	enc = join(4, fu->gene1, "_", fu->gene2, ".enc.");
+	for(n=0, try=0; n<n_pairs && try<100*n_pairs; try++){
+		fl = (int)(opt->frag_mean + opt->frag_sd * sim_norm(rng) + 0.5);
+		fl = (fl < L) ? L : (fl > fu->l) ? fu->l : fl;
+		/* fragments [p, p+fl) with p < J < p+fl */
+		lo = (J - fl + 1 > 0) ? J - fl + 1 : 0;
+		hi = (J - 1 < fu->l - fl) ? J - 1 : fu->l - fl;
+		if(lo > hi) continue;
+		p = lo + bag_rand(rng) % (hi - lo + 1);
+		if((p < J && J < p + L) || (p + fl - L < J && J < p + fl)){
+			sim_pair_write(fu->seq, p, fl, opt, rng, span, *n_span, up, dn, q_up, q_dn, fo1, fo2);
+			(*n_span)++;
+		}else{
+			sim_pair_write(fu->seq, p, fl, opt, rng, enc, n - *n_span, up, dn, q_up, q_dn, fo1, fo2);
+		}
+		n++;
+	}
+	free(up); free(dn); free(q_up); free(q_dn);
+	free(span); free(enc);
+	return n;
+}
+
+int simulate_usage(){
+	sim_opt_t *sim = sim_opt_init();
+	fprintf(stderr, "\n");
+			fprintf(stderr, "Usage:   tafuco simulate [options] <exon.fa> <fusions.txt> <R1.fq> <R2.fq>\n\n");
+			fprintf(stderr, "Details: simulate pair-end reads of fusions on a background of normal transcripts\n\n");
+			fprintf(stderr, "Options: -N INT    background read pairs [1000000]\n");
+			fprintf(stderr, "         -p INT    read pairs covering the junction of every fusion [100]\n");
+			fprintf(stderr, "         -l INT    read length [%d]\n", sim->read_len);
+			fprintf(stderr, "         -f INT    mean fragment length [%d]\n", sim->frag_mean);
+			fprintf(stderr, "         -d INT    standard deviation of fragment length [%d]\n", sim->frag_sd);
+			fprintf(stderr, "         -e FLOAT  mean substitution error rate [%.4f]\n", sim->err);
+			fprintf(stderr, "         -s INT    seed [11]\n");
+			fprintf(stderr, "         -r        R1 on the transcript strand\n\n");
+			fprintf(stderr, "Inputs:  exon.fa       exon sequences written by name2fasta, e.g. data/exon.fa.gz\n");
+			fprintf(stderr, "         fusions.txt   'gene1 exon1 gene2 exon2' per line, gene1 through exon1 is\n");
+			fprintf(stderr, "                       fused to gene2 from exon2, 'gene1 gene2' breaks at middle exons\n\n");
+			fprintf(stderr, "Outputs: R1.fq, R2.fq and 'gene1 exon1 gene2 exon2 spanning encompassing' of\n");
+			fprintf(stderr, "         every fusion to stdout\n");
+			free(sim);
+			return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* simulate reads of fusions. */
+int simulate(int argc, char *argv[]) {
+	sim_opt_t *sim = sim_opt_init();
+	sim_tx_t *tx;
+	sim_fusion_t *fu = NULL;
+	FILE *fi, *fo1, *fo2;
+	char line[1024], *tok[4], *p, *save;
+	uint64_t seed = 11, rng;
+	long n_bg = 1000000, n_pairs = 100, n, n_span;
+	int c, i, n_tx, n_fu = 0, n_tok;
+	while ((c = getopt(argc, argv, "N:p:l:f:d:e:s:r")) >= 0) {
+				switch (c) {
+				case 'N': n_bg = atol(optarg); break;
+				case 'p': n_pairs = atol(optarg); break;
+				case 'l': sim->read_len = atoi(optarg); break;
+				case 'f': sim->frag_mean = atoi(optarg); break;
+				case 'd': sim->frag_sd = atoi(optarg); break;
+				case 'e': sim->err = atof(optarg); break;
+				case 's': seed = strtoull(optarg, NULL, 10); break;
+				case 'r': sim->flip = 1; break;
+				default: free(sim); return 1;
+		}
+	}
+	if (optind + 4 > argc){free(sim); return simulate_usage();}
+	if(n_bg < 0 || n_pairs < 0) die("[%s] -N and -p must be within [0, +INF)", __func__);
+	if(sim->read_len < 1) die("[%s] -l must be within [1, +INF)", __func__);
+	if(sim->frag_mean < sim->read_len || sim->frag_sd < 0) die("[%s] -f must be at least -l and -d non-negative", __func__);
+	if(sim->err < 0 || sim->err > 0.5) die("[%s] -e must be within [0, 0.5]", __func__);
+	
+	fprintf(stderr, "[%s] loading transcripts ... \n",__func__);
+	if((tx = sim_transcripts(argv[optind], &n_tx)) == NULL) die("[%s] no transcript found in %s", __func__, argv[optind]);
+	if((fi = fopen(argv[optind+1], "r")) == NULL) die("[%s] can't open %s", __func__, argv[optind+1]);
+	while(fgets(line, sizeof(line), fi) != NULL){
+		if(line[0] == '#') continue;
+		for(n_tok=0, p=strtok_r(line, " \t\r\n", &save); p!=NULL && n_tok<4; p=strtok_r(NULL, " \t\r\n", &save)) tok[n_tok++] = p;
+		if(n_tok != 2 && n_tok != 4) continue;
+		fu = realloc(fu, (n_fu + 1) * sizeof(sim_fusion_t));
+		if((n_tok == 4 && sim_fusion(tx, n_tx, tok[0], atoi(tok[1]), tok[2], atoi(tok[3]), &fu[n_fu]) != 0) ||
+		   (n_tok == 2 && sim_fusion(tx, n_tx, tok[0], 0, tok[1], 0, &fu[n_fu]) != 0))
+			die("[%s] no transcript of %s and %s has the breakpoint exons", __func__, tok[0], tok[(n_tok == 4) ? 2 : 1]);
+		n_fu++;
+	}
+	fclose(fi);
+	
+	if((fo1 = fopen(argv[optind+2], "w")) == NULL) die("[%s] can't write %s", __func__, argv[optind+2]);
+	if((fo2 = fopen(argv[optind+3], "w")) == NULL) die("[%s] can't write %s", __func__, argv[optind+3]);
+	fprintf(stderr, "[%s] %ld background pairs from %d transcripts ... \n", __func__, n_bg, n_tx);
+	rng = seed;
+	if(n_bg > 0) sim_pairs(tx, n_tx, n_bg, sim, &rng, "bg", fo1, fo2);
+	fprintf(stderr, "[%s] %ld pairs of each of %d fusions ... \n", __func__, n_pairs, n_fu);
+	for(i=0; i<n_fu; i++){
+		/* every fusion has its own stream of random numbers */
+		rng = seed + (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL;
+		n = sim_fusion_pairs(&fu[i], n_pairs, sim, &rng, fo1, fo2, &n_span);
+		printf("%s\t%d\t%s\t%d\t%ld\t%ld\n", fu[i].gene1, fu[i].exon1, fu[i].gene2, fu[i].exon2, n_span, n - n_span);
+	}
+	fclose(fo1);
+	fclose(fo2);
+	
+	for(i=0; i<n_fu; i++) sim_fusion_destroy(&fu[i]);
+	if(fu) free(fu);
+	sim_transcripts_destroy(tx, n_tx);
+	free(sim);
+	return 0;
+}
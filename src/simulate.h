@@ -0,0 +1,111 @@
+/*--------------------------------------------------------------------*/
+/* simulate.h                                                         */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Simulation of pair-end RNA-seq reads from transcripts.             */
+/*--------------------------------------------------------------------*/
+/* Transcripts are built from the exon sequences written by           */
+/* name2fasta, the header of every exon lists the transcripts it      */
+/* belongs to, exons of a transcript are joined 5'->3'. Fragment      */
+/* lengths are normal, transcripts are drawn in proportion to length  */
+/* times a log-normal expression level drawn once per library, so    */
+/* every library has its own expression profile. Substitution errors  */
+/* rise linearly along a read from 0.5 to 1.5 times the error rate,   */
+/* base qualities are the phred score of the error probability. R1    */
+/* is on the reverse strand of the transcript as for dUTP libraries.  */
+/* A fusion transcript is gene1 from its 5' end through exon1 joined  */
+/* to gene2 from exon2 to its 3' end, taken from the longest          */
+/* transcript of each gene that has the exon. Fusion pairs are drawn  */
+/* from fragments that cover the junction, they are spanning if one   */
+/* end crosses the junction and encompassing otherwise.               */
+/*--------------------------------------------------------------------*/
+
+#ifndef _SIMULATE_H
+#define _SIMULATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+
+typedef struct {
+	char *name;             /* gene|transcript_id */
+	char *gene;
+	char *seq;
+	int l;
+	int n_exon;
+	int *exon;              /* exon numbers, 5'->3' */
+	int *end;               /* end of every exon in seq */
+} sim_tx_t;
+
+typedef struct {
+	char *gene1, *gene2;
+	int exon1, exon2;       /* exons at the breakpoint */
+	char *seq;
+	int l;
+	int junction;           /* first base of gene2 in seq */
+} sim_fusion_t;
+
+typedef struct {
+	int read_len;
+	int frag_mean;
+	int frag_sd;
+	float err;              /* mean substitution rate */
+	float expr_sd;          /* sd of log expression levels */
+	int flip;               /* R1 on the transcript strand */
+} sim_opt_t;
+
+static inline sim_opt_t *sim_opt_init(){
+	sim_opt_t *opt = mycalloc(1, sim_opt_t);
+	opt->read_len = 75;
+	opt->frag_mean = 250;
+	opt->frag_sd = 50;
+	opt->err = 0.005;
+	opt->expr_sd = 1.0;
+	opt->flip = 0;
+	return opt;
+}
+
+/*
+ * transcripts of the exon fasta fname, *n is set to the number of
+ * transcripts, return NULL if fname can't be read.
+ */
+sim_tx_t *sim_transcripts(const char *fname, int *n);
+
+void sim_transcripts_destroy(sim_tx_t *tx, int n);
+
+/*
+ * write n_pairs read pairs drawn from tx to fo1 and fo2, read names
+ * start with prefix. rng is the state of the random numbers, the
+ * output only depends on it. return the number of pairs written.
+ */
+long sim_pairs(const sim_tx_t *tx, int n_tx, long n_pairs, const sim_opt_t *opt, uint64_t *rng, const char *prefix, FILE *fo1, FILE *fo2);
+
+/*
+ * fusion of gene1 through exon1 and gene2 from exon2, an exon number
+ * below 1 picks the middle exon of the longest transcript. return -1
+ * if either gene or exon is not found.
+ */
+int sim_fusion(const sim_tx_t *tx, int n_tx, const char *gene1, int exon1, const char *gene2, int exon2, sim_fusion_t *fu);
+
+void sim_fusion_destroy(sim_fusion_t *fu);
+
+/*
+ * write n_pairs read pairs of fragments covering the junction of fu,
+ * *n_span is set to the number of spanning pairs. read names are
+ * gene1_gene2.span.i or gene1_gene2.enc.i
+ */
+long sim_fusion_pairs(const sim_fusion_t *fu, long n_pairs, const sim_opt_t *opt, uint64_t *rng, FILE *fo1, FILE *fo2, long *n_span);
+
+/*
+ * usage info
+ */
+int simulate_usage();
+
+/*
+ * main function of tafuco simulate
+ */
+int simulate(int argc, char *argv[]);
+
+#endif
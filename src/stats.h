@@ -0,0 +1,173 @@
+/*--------------------------------------------------------------------*/
+/* stats.h                                                            */
+/* Author: Rongxin Fang                                               */
+/* E-mail: r3fang@ucsd.edu                                            */
+/* Run time, memory and hot path counters of the pipeline.            */
+/*--------------------------------------------------------------------*/
+/* Every stage is timed with the monotonic clock, memory (VmRSS and   */
+/* VmHWM of /proc/self/status) is sampled at the end of a stage. A    */
+/* stage that runs more than once accumulates its time. Counters are  */
+/* plain increments on the single threaded stages, stats_write dumps  */
+/* everything as one JSON object.                                     */
+/*--------------------------------------------------------------------*/
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/resource.h>
+
+/* stages of the pipeline */
+#define STAGE_LOAD           0
+#define STAGE_INDEX          1
+#define STAGE_BAG            2
+#define STAGE_TRIM           3
+#define STAGE_JUNCTION       4
+#define STAGE_TRANSCRIPT     5
+#define STAGE_TEST_JUNCTION  6
+#define STAGE_TEST_FUSION    7
+#define STAGE_SCORE          8
+#define STAGE_NUM            9
+
+static const char *STAGE_NAMES[STAGE_NUM] = {"load", "index", "bag_construct", "trim", "junction_gen", "transcript_gen", "test_junction", "test_fusion", "score"};
+
+typedef struct {
+	int runs;               /* 0 if the stage never ran */
+	double sec;
+	long rss_kb;            /* at the end of the last run */
+	long hwm_kb;
+} stage_t;
+
+typedef struct {
+	double t_start;         /* start of the run */
+	double t_stage;         /* start of the current stage */
+	int cur;                /* the current stage, -1 between stages */
+	FILE *log;              /* if not NULL, "#stage <name> <sec>" of every run of a stage as it ends */
+	volatile int *shared;   /* if not NULL, cur is mirrored to it for another process */
+	stage_t stage[STAGE_NUM];
+	/* hot path counters */
+	uint64_t pairs_scanned;     /* read pairs read by bag_construct */
+	uint64_t pairs_rescanned;   /* read pairs read again by test_junction */
+	uint64_t reads_unpaired;    /* reads dropped by bag_construct without a mate */
+	uint64_t bases_trimmed;     /* bases trimmed from reads by bag_construct */
+	uint64_t reads_masked;      /* reads of low entropy masked by bag_construct */
+	uint64_t kmer_probes;
+	uint64_t kmer_hits;
+	uint64_t pairs_multi_gene;  /* pairs hitting 2 or more genes */
+	uint64_t pairs_duplicate;   /* exact duplicates of pairs with hits, collapsed by bag_construct */
+	uint64_t exon_cache_hits;   /* exon concatenations reused by concat_exons */
+	uint64_t align_tried;
+	uint64_t align_passed;      /* alignments of identity at least -a */
+	uint64_t dp_cells;
+	uint64_t fastq_bytes;       /* decompressed bytes of fastq read */
+} stats_t;
+
+static inline double stats_clock(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* VmRSS and VmHWM in kB, the peak from getrusage if there is no /proc */
+static inline void stats_mem(long *rss_kb, long *hwm_kb){
+	char line[256];
+	struct rusage ru;
+	FILE *fp;
+	*rss_kb = *hwm_kb = -1;
+	if((fp = fopen("/proc/self/status", "r")) != NULL){
+		while(fgets(line, sizeof(line), fp) != NULL){
+			if(strncmp(line, "VmRSS:", 6) == 0) *rss_kb = atol(line + 6);
+			if(strncmp(line, "VmHWM:", 6) == 0) *hwm_kb = atol(line + 6);
+		}
+		fclose(fp);
+	}
+	if(*hwm_kb < 0 && getrusage(RUSAGE_SELF, &ru) == 0) *hwm_kb = ru.ru_maxrss;
+}
+
+static inline void stats_init(stats_t *st){
+	memset(st, 0, sizeof(stats_t));
+	st->t_start = st->t_stage = stats_clock();
+	st->cur = -1;
+}
+
+/* stages don't nest, every stats_begin is closed by stats_end of the same stage */
+static inline void stats_begin(stats_t *st, int stage){
+	assert(st->cur == -1 && stage >= 0 && stage < STAGE_NUM);
+	st->cur = stage;
+	st->t_stage = stats_clock();
+	if(st->shared != NULL) *st->shared = stage;
+}
+
+static inline void stats_end(stats_t *st, int stage){
+	stage_t *s = &st->stage[stage];
+	double sec = stats_clock() - st->t_stage;
+	assert(st->cur == stage);
+	st->cur = -1;
+	if(st->shared != NULL) *st->shared = -1;
+	s->sec += sec;
+	s->runs++;
+	stats_mem(&s->rss_kb, &s->hwm_kb);
+	if(st->log != NULL){
+		fprintf(st->log, "#stage\t%s\t%.6f\n", STAGE_NAMES[stage], sec);
+		fflush(st->log);
+	}
+}
+
+/* s as a JSON string */
+static inline void stats_json_str(FILE *fp, const char *s){
+	fputc('"', fp);
+	for(; s != NULL && *s; s++){
+		if(*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+		else if((unsigned char)*s < 0x20) fprintf(fp, "\\u%04x", (unsigned char)*s);
+		else fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+/* write the report of command cmd on fq1 and fq2 to fname, return 0 on success */
+static inline int stats_write(const stats_t *st, const char *fname, const char *cmd, const char *fq1, const char *fq2, int n_threads){
+	FILE *fp;
+	long rss_kb, hwm_kb;
+	int i, first = 1;
+	if(st == NULL || fname == NULL) return -1;
+	if((fp = fopen(fname, "w")) == NULL) return -1;
+	stats_mem(&rss_kb, &hwm_kb);
+	fprintf(fp, "{\n  \"command\": "); stats_json_str(fp, cmd);
+	fprintf(fp, ",\n  \"fq1\": "); stats_json_str(fp, fq1);
+	fprintf(fp, ",\n  \"fq2\": "); stats_json_str(fp, fq2);
+	fprintf(fp, ",\n  \"threads\": %d", n_threads);
+	fprintf(fp, ",\n  \"wall_sec\": %.6f", stats_clock() - st->t_start);
+	fprintf(fp, ",\n  \"rss_kb\": %ld,\n  \"hwm_kb\": %ld", rss_kb, hwm_kb);
+	fprintf(fp, ",\n  \"stages\": [");
+	for(i=0; i<STAGE_NUM; i++){
+		if(st->stage[i].runs == 0) continue;
+		fprintf(fp, "%s\n    {\"name\": \"%s\", \"runs\": %d, \"sec\": %.6f, \"rss_kb\": %ld, \"hwm_kb\": %ld}", (first) ? "" : ",",
+				STAGE_NAMES[i], st->stage[i].runs, st->stage[i].sec, st->stage[i].rss_kb, st->stage[i].hwm_kb);
+		first = 0;
+	}
+	fprintf(fp, "\n  ],\n  \"counters\": {\n");
+	fprintf(fp, "    \"pairs_scanned\": %llu,\n",    (unsigned long long)st->pairs_scanned);
+	fprintf(fp, "    \"pairs_rescanned\": %llu,\n",  (unsigned long long)st->pairs_rescanned);
+	fprintf(fp, "    \"reads_unpaired\": %llu,\n",   (unsigned long long)st->reads_unpaired);
+	fprintf(fp, "    \"bases_trimmed\": %llu,\n",    (unsigned long long)st->bases_trimmed);
+	fprintf(fp, "    \"reads_masked\": %llu,\n",     (unsigned long long)st->reads_masked);
+	fprintf(fp, "    \"kmer_probes\": %llu,\n",      (unsigned long long)st->kmer_probes);
+	fprintf(fp, "    \"kmer_hits\": %llu,\n",        (unsigned long long)st->kmer_hits);
+	fprintf(fp, "    \"pairs_multi_gene\": %llu,\n", (unsigned long long)st->pairs_multi_gene);
+	fprintf(fp, "    \"pairs_duplicate\": %llu,\n",  (unsigned long long)st->pairs_duplicate);
+	fprintf(fp, "    \"exon_cache_hits\": %llu,\n",  (unsigned long long)st->exon_cache_hits);
+	fprintf(fp, "    \"align_tried\": %llu,\n",      (unsigned long long)st->align_tried);
+	fprintf(fp, "    \"align_passed\": %llu,\n",     (unsigned long long)st->align_passed);
+	fprintf(fp, "    \"dp_cells\": %llu,\n",         (unsigned long long)st->dp_cells);
+	fprintf(fp, "    \"fastq_bytes\": %llu\n",       (unsigned long long)st->fastq_bytes);
+	fprintf(fp, "  }\n}\n");
+	fclose(fp);
+	return 0;
+}
+
+#endif
@@ -7,6 +7,8 @@
 #include <limits.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
 #include "zlib.h"
 #include "kseq.h"
 #include "uthash.h"